@@ -55,6 +55,15 @@ import subprocess
 # Networkx import for graph management
 import networkx as nx
 
+# Native all-pairs routing engine (native/libcxproute.so), networkx is the fallback when it is not built
+import cxp_route
+
+# Shared memory delay matrix (native/libcxpshm.so) for the readers on this host
+import cxp_shm
+
+# Delay history store (native/libcxptsdb.so), the text logs are the fallback
+import cxp_tsdb
+
 # For beautiful prints of dicts, lists, etc,
 from pprint import pprint as pp
 
@@ -63,6 +72,182 @@ log = core.getLogger()
 bridge2ip = {}      # key: name, value: tunnel ip
 servers = []        # (name,public ip,tunnel ip)
 
+# Binary delay report of the relays, see relay_scripts/report.h
+REPORT_MAGIC = 0x43585052
+REPORT_VERSION = 1
+REPORT_KIND_DELAY = 1
+REPORT_KIND_STATS = 2
+REPORT_KIND_CLOCK = 3
+REPORT_KIND_COORD = 4
+REPORT_KIND_LINK = 5
+REPORT_KIND_BANDWIDTH = 6
+REPORT_LINK_UP = 1
+REPORT_F_DELTA = 0x01
+REPORT_HEADER = struct.Struct('!IBBBBHHIHH')
+REPORT_DELAY = struct.Struct('!HHHHII')
+REPORT_STATS = struct.Struct('!HBBIIIIIII')
+REPORT_CLOCK = struct.Struct('!HHIqiI')
+REPORT_COORD = struct.Struct('!HHiiiII')
+REPORT_LINK = struct.Struct('!HBBII')
+REPORT_BANDWIDTH = struct.Struct('!HBBIII')
+REPORT_METRICS = ('forward', 'reverse', 'rtt', 'turnaround')
+
+# Staggered rounds: in slot k relay i probes relay (i + k) % n, so no reflector gets two senders at once
+PROBE_SLOT_MS = 20
+PROBE_START_MS = 1000       # from the request to the first slot, for the request to reach every relay
+
+# Network coordinates (relay_scripts/coord.h): on overlays larger than PROBE_SAMPLE every relay probes that many
+# peers per round, the next ones in the following round, and the edges nobody measured are predicted from the
+# coordinates the relays report. A measured edge off its prediction by both bounds is flagged.
+PROBE_SAMPLE = 32
+COORD_DISAGREE_RATIO = 0.5
+COORD_DISAGREE_MS = 5.0
+
+# Proactive flows: once every bridge is connected the rules of the lowest delay path of every pair of bridges are
+# installed up front, without timeouts, and brought up to date FLOW_SYNC_S seconds after the delays change at the
+# latest, so no packet waits for the controller. False (the default) installs the rules of a pair on its first
+# packet-in.
+PROACTIVE_FLOWS = False
+FLOW_SYNC_S = 2
+
+# Failover: every pair keeps up to BACKUP_PATHS backups next to its best path, which share no edge and no relay
+# with it nor with each other. When an agent reports an edge down the pairs crossing it switch to a backup at
+# once, before the paths are recomputed.
+BACKUP_PATHS = 2
+
+# Bandwidth (relay_scripts/train.h, agents started with -T): an edge whose available bandwidth is under
+# CONGESTED_SHARE of its capacity is congested, and its delay weighs CONGESTION_PENALTY times more in the paths.
+CONGESTED_SHARE = 0.1
+CONGESTION_PENALTY = 2.0
+
+# Route hysteresis (cxp_route.PathSelector): a pair moves to a new lowest delay path only if it is lower by more
+# than ROUTE_SWITCH_MS, by more than ROUTE_SWITCH_RATIO of the delay of its path and by more than
+# ROUTE_CONFIDENCE times the spread (p90 - median) of the two, and after ROUTE_DWELL_S on its path, so the
+# wiggle of a median does not rewrite the rules of every hop. With all four 0 any lower path is taken.
+ROUTE_SWITCH_MS = 0.5
+ROUTE_SWITCH_RATIO = 0.05
+ROUTE_CONFIDENCE = 1.0
+ROUTE_DWELL_S = 30
+
+class DelayMatrix(object):
+    '''
+        Latest one way delays in memory, indexed by the position of the relays in servers.
+        median and p90 are in ms, loss and reorder are fractions, updated is the time of the last report.
+        stats[src][dst] maps forward/reverse/rtt/turnaround to a dict of count, min, median, p90, p99, ewma and
+        jitter; turnaround is the time src's probes spent queued and answered in dst's reflector.
+        clock[src][dst] is the offset (ms) and skew (ppm) of dst's clock seen from src, with the error bound
+        (ms) of the one way delays split with it.
+        coord[node] is the network coordinate node reported; disagree maps the measured edges that are far
+        from what the coordinates predict to (measured, predicted) round trips in ms.
+        bandwidth[src][dst] is the capacity, available bandwidth (None without paced trains) and dispersion
+        rate in Mbit/s the packet trains of src found, with the number of trains.
+    '''
+    def __init__(self, n):
+        self.n = n
+        self.median = [[None] * n for i in range(n)]
+        self.p90 = [[None] * n for i in range(n)]
+        self.loss = [[None] * n for i in range(n)]
+        self.reorder = [[None] * n for i in range(n)]
+        self.samples = [[0] * n for i in range(n)]
+        self.updated = [[0.] * n for i in range(n)]
+        self.stats = [[{} for j in range(n)] for i in range(n)]
+        self.clock = [[None] * n for i in range(n)]
+        self.coord = [None] * n
+        self.disagree = {}
+        self.bandwidth = [[None] * n for i in range(n)]
+        self.reports = 0
+
+    def set(self, src, dst, median, p90, loss, reorder, samples, now):
+        self.median[src][dst] = median
+        self.p90[src][dst] = p90
+        self.loss[src][dst] = loss
+        self.reorder[src][dst] = reorder
+        self.samples[src][dst] = samples
+        self.updated[src][dst] = now
+
+    def set_stats(self, src, dst, metric, count, values):
+        stats = dict(zip(('min', 'median', 'p90', 'p99', 'ewma', 'jitter'), [v / 1e6 for v in values]))
+        stats['count'] = count
+        self.stats[src][dst][REPORT_METRICS[metric]] = stats
+
+    def set_clock(self, src, dst, points, error, offset, skew, min_delay):
+        self.clock[src][dst] = {'points': points, 'error': error / 1e6, 'offset': offset / 1e6,
+                                'skew': skew / 1e3, 'min_delay': min_delay / 1e6}
+
+    def set_bandwidth(self, src, dst, trains, paced, capacity, available, rate):
+        self.bandwidth[src][dst] = {'trains': trains, 'capacity': capacity / 1e3,
+                                    'available': available / 1e3 if paced else None, 'rate': rate / 1e3}
+
+    def congested(self, src, dst):
+        '''
+            True if the trains of src found less than CONGESTED_SHARE of the capacity of src -> dst available.
+        '''
+        b = self.bandwidth[src][dst]
+        return b is not None and b['available'] is not None and b['available'] < CONGESTED_SHARE * b['capacity']
+
+    def weight(self, src, dst, delay):
+        '''
+            The routing weight of an edge with that delay: CONGESTION_PENALTY times it if the edge is congested.
+        '''
+        if delay is None or not self.congested(src, dst):
+            return delay
+        return delay * CONGESTION_PENALTY
+
+    def set_coord(self, node, updates, v, height, error):
+        self.coord[node] = {'v': [x / 1e3 for x in v], 'height': height / 1e3, 'error': error / 1e6,
+                            'updates': updates}
+
+    def predicted_rtt(self, src, dst):
+        '''
+            The round trip between src and dst from their coordinates, None until both have one.
+        '''
+        a, b = self.coord[src], self.coord[dst]
+        if a is None or b is None or not a['updates'] or not b['updates']:
+            return None
+        return sum((x - y) ** 2 for x, y in zip(a['v'], b['v'])) ** 0.5 + a['height'] + b['height']
+
+    def check_edge(self, src, dst):
+        '''
+            Compare the measured round trip of src -> dst with the prediction. Returns (measured, predicted) when
+            the edge just started to disagree, None otherwise.
+        '''
+        measured = self.stats[src][dst].get('rtt', {}).get('median')
+        predicted = self.predicted_rtt(src, dst)
+        if not measured or predicted is None:
+            return None
+        if abs(predicted - measured) > max(COORD_DISAGREE_MS, COORD_DISAGREE_RATIO * measured):
+            new = (src, dst) not in self.disagree
+            self.disagree[(src, dst)] = (measured, predicted)
+            return (measured, predicted) if new else None
+        self.disagree.pop((src, dst), None)
+        return None
+
+    def accuracy(self):
+        '''
+            How well the coordinates predict the measured edges: (edges, median and p90 relative error).
+        '''
+        errors = []
+        for src in range(self.n):
+            for dst in range(self.n):
+                measured = self.stats[src][dst].get('rtt', {}).get('median')
+                predicted = self.predicted_rtt(src, dst) if src != dst and measured else None
+                if predicted is not None:
+                    errors.append(abs(predicted - measured) / measured)
+        if not errors:
+            return 0, None, None
+        errors.sort()
+        return len(errors), errors[len(errors) / 2], errors[len(errors) * 9 / 10]
+
+    def edge(self, src, dst):
+        '''
+            The edge src -> dst in the fields of the shared memory matrix.
+        '''
+        forward = self.stats[src][dst].get('forward', {})
+        return {'median': self.median[src][dst] or 0, 'p90': self.p90[src][dst] or 0,
+                'min': forward.get('min', 0), 'jitter': forward.get('jitter', 0),
+                'loss': self.loss[src][dst] or 0, 'reorder': self.reorder[src][dst] or 0,
+                'samples': self.samples[src][dst], 'updated': int(self.updated[src][dst])}
+
 class CXP(EventMixin):
 
     _neededComponents = set([])
@@ -72,6 +257,21 @@ class CXP(EventMixin):
         self.dpid2switch = {}       # key: DPID, value: Tunneled Switch
         self.arpmap = {}            # key: IP address, value: Tunneled Switch
         self.G = nx.DiGraph()
+        self.delay_matrix = None
+        self.router = None
+        self.server_index = {}      # key: name, value: position in servers
+        self.shm = None
+        self.history = None
+        self.probe_round = 0
+        self.delay_version = 0      # bumped by every delay update
+        self.flows_version = -1     # delay_version the proactive rules were computed from
+        self.graph_version = -1     # delay_version self.G was built from
+        self.barriers = {}          # key: (DPID, barrier xid), value: (time sent, flow_mods)
+        self.down = set()           # (src, dst) positions in servers of the edges reported down
+        self.paths = {}             # key: (src bridge, dst bridge), value: the path its proactive rules follow
+        self.backups = {}           # key: (src bridge, dst bridge), value: its backup paths
+        self.selector = cxp_route.PathSelector(self.path_delay, self.path_spread, ROUTE_SWITCH_MS, ROUTE_SWITCH_RATIO,
+                                               ROUTE_CONFIDENCE, ROUTE_DWELL_S)
         
         self.check_directories()
 
@@ -83,6 +283,25 @@ class CXP(EventMixin):
 
         # Controller will send bash commands to setup OVS interfaces on the remote nodes
         self.initialize_servers()
+        self.delay_matrix = DelayMatrix(len(servers))
+        self.server_index = dict((s[0], i) for i, s in enumerate(servers))
+        if cxp_route.available():
+            self.router = cxp_route.RouteEngine(len(servers))
+            log.info("Using the native routing engine for %d relays", len(servers))
+        else:
+            log.info("native/libcxproute.so not found, using networkx for the paths")
+        if cxp_shm.available():
+            try:
+                self.shm = cxp_shm.SharedMatrix(len(servers), writable=True)
+                log.info("Publishing the delays to the shared memory matrix %s", cxp_shm.DEFAULT_NAME)
+            except OSError as e:
+                log.warning("No shared memory delay matrix: %s", e)
+        if cxp_tsdb.available():
+            try:
+                self.history = cxp_tsdb.Store('./cxp/tsdb')
+                log.info("Keeping the delay history in ./cxp/tsdb")
+            except OSError as e:
+                log.warning("No delay history store: %s", e)
 
         # Add all the nodes to a Directional Graph 
         for s in bridge2ip:
@@ -93,6 +312,9 @@ class CXP(EventMixin):
             self.listenTo(core)
         self.listenTo(core.openflow)
 
+        if PROACTIVE_FLOWS:
+            Timer(FLOW_SYNC_S, self.sync_flows, recurring = True)
+
     def get_ip_address(self, ifname):
         '''
             Get the IP address of the ifname interface.
@@ -148,6 +370,9 @@ class CXP(EventMixin):
         log.info("Delay controller up and running..")
         while True:
             data, address = sock.recvfrom(4096)
+            if len(data) >= REPORT_HEADER.size and REPORT_HEADER.unpack_from(data)[0] == REPORT_MAGIC:
+                self.decode_report(data)
+                continue
             ss = data.split(" ")
 
             print "Received data %s from %s" %(data,address)
@@ -159,8 +384,207 @@ class CXP(EventMixin):
                 # Append the latest delay on a logs file.
                 with open('./cxp/logs/'+ss[0],'a') as f:
                     f.write( time.strftime("%c \t") + " " + str(data.split("end",1)[0]).replace(ss[0] + " ","") + "\n")
+
+                if ss[0] in self.server_index:
+                    node = self.server_index[ss[0]]
+                    peers = []
+                    for pair in ss[1:]:
+                        sm = pair.split(":")
+                        if len(sm) == 2 and sm[0] in self.server_index:
+                            peer = self.server_index[sm[0]]
+                            self.delay_matrix.set(node, peer, float(sm[1]), None, None, None, 1, time.time())
+                            self.set_weight(node, peer, float(sm[1]))
+                            peers.append(peer)
+                    self.publish_row(node, peers)
+                    self.delay_version += 1
         log.info("Closing delay controller..")
 
+    def set_weight (self, src, dst, weight):
+        '''
+            Give the routing engine the weight of an edge, its delay with the congestion penalty; the edges
+            reported down have none until they are up.
+        '''
+        if self.router is not None:
+            weight = None if (src, dst) in self.down else self.delay_matrix.weight(src, dst, weight)
+            self.router.set_weight(src, dst, weight)
+
+    def set_bandwidth (self, node, peer, trains, paced, capacity, available, rate):
+        '''
+            What node's packet trains found on node -> peer. An edge that becomes congested, or stops being so,
+            gets its weight again and the paths are recomputed.
+        '''
+        m = self.delay_matrix
+        congested = m.congested(node, peer)
+        m.set_bandwidth(node, peer, trains, paced, capacity, available, rate)
+        if m.congested(node, peer) == congested:
+            return
+        b = m.bandwidth[node][peer]
+        if congested:
+            log.info("%s -> %s is no longer congested: %.1f of %.1f Mbit/s available", servers[node][0],
+                     servers[peer][0], b['available'], b['capacity'])
+        else:
+            log.warning("%s -> %s is congested: %.1f of %.1f Mbit/s available", servers[node][0], servers[peer][0],
+                        b['available'], b['capacity'])
+        if m.samples[node][peer] > 0:
+            self.set_weight(node, peer, m.median[node][peer])
+        self.delay_version += 1
+
+    def set_link (self, node, peer, up, losses, silent):
+        '''
+            node's agent saw peer stop answering, or answer again. A lost probe does not tell which way it was
+            lost, so both directions of the edge go down: the routing engine drops them and the flows crossing
+            them move to their backups on the openflow thread. Once up the edges get their weights back, and the
+            next sync of the flows routes over them again.
+        '''
+        edges = set([(node, peer), (peer, node)])
+        if up == (not edges & self.down):
+            return
+        if up:
+            self.down -= edges
+            log.info("%s <-> %s is up again", servers[node][0], servers[peer][0])
+        else:
+            self.down |= edges
+            log.warning("%s <-> %s is down: %d probe(s) lost in a row, no reply for %.0f ms", servers[node][0],
+                        servers[peer][0], losses, silent)
+        m = self.delay_matrix
+        for src, dst in edges:
+            self.set_weight(src, dst, m.median[src][dst] if up and m.samples[src][dst] > 0 else None)
+        self.delay_version += 1
+        if PROACTIVE_FLOWS and not up:
+            core.callLater(self.failover)
+
+    def publish_row (self, node, peers):
+        '''
+            Write the edges of node to the peers to the shared memory matrix, as one update of its row.
+        '''
+        if self.shm is None or not peers:
+            return
+        self.shm.update_row(node, dict((peer, self.delay_matrix.edge(node, peer))
+                                       for peer in set(peers) if peer < self.delay_matrix.n))
+
+    def record_history (self, node, peers):
+        '''
+            Append the latest medians of the edges of node to the peers to the delay history.
+        '''
+        if self.history is None:
+            return
+        for peer in set(peers):
+            if peer >= self.delay_matrix.n:
+                continue
+            stats = self.delay_matrix.stats[node][peer]
+            median = lambda metric: stats[metric]['median'] if metric in stats else None
+            self.history.append(node, peer, median('rtt'), median('forward'), median('reverse'),
+                                self.delay_matrix.loss[node][peer])
+
+    def fill_predicted (self, node):
+        '''
+            Give the routing engine a weight for every edge of node that was never measured: half the round trip
+            the coordinates predict, the one way delays of such an edge being unknown.
+        '''
+        if self.router is None:
+            return
+        m = self.delay_matrix
+        for peer in range(m.n):
+            if peer == node:
+                continue
+            rtt = m.predicted_rtt(node, peer)
+            if rtt is None:
+                continue
+            if m.samples[node][peer] == 0:
+                self.set_weight(node, peer, rtt / 2)
+            if m.samples[peer][node] == 0:
+                self.set_weight(peer, node, rtt / 2)
+
+    def decode_report (self, data):
+        '''
+            Decode one fragment of a binary delay report straight into the delay matrix. Fragments are
+            independent, so each one is applied as it arrives; a delta report only carries the changed peers.
+        '''
+        magic, version, kind, flags, pad, node, count, seq, fragment, fragments = REPORT_HEADER.unpack_from(data)
+        if version != REPORT_VERSION or kind not in (REPORT_KIND_DELAY, REPORT_KIND_STATS, REPORT_KIND_CLOCK,
+                                                     REPORT_KIND_COORD, REPORT_KIND_LINK, REPORT_KIND_BANDWIDTH):
+            log.warning("Unknown delay report version %d kind %d", version, kind)
+            return
+        if self.delay_matrix is None or node >= self.delay_matrix.n:
+            log.warning("Delay report from unknown node %d", node)
+            return
+
+        if kind == REPORT_KIND_STATS:
+            count = min(count, (len(data) - REPORT_HEADER.size) / REPORT_STATS.size)
+            for i in range(count):
+                fields = REPORT_STATS.unpack_from(data, REPORT_HEADER.size + i * REPORT_STATS.size)
+                if fields[0] < self.delay_matrix.n and fields[1] < len(REPORT_METRICS):
+                    self.delay_matrix.set_stats(node, fields[0], fields[1], fields[3], fields[4:])
+            peers = [REPORT_STATS.unpack_from(data, REPORT_HEADER.size + i * REPORT_STATS.size)[0]
+                     for i in range(count)]
+            self.publish_row(node, peers)
+            self.record_history(node, peers)
+            for peer in set(peers):
+                if peer >= self.delay_matrix.n:
+                    continue
+                flagged = self.delay_matrix.check_edge(node, peer)
+                if flagged is not None:
+                    log.info("%s -> %s: measured %.2f ms round trip, the coordinates predict %.2f ms",
+                             servers[node][0], servers[peer][0], flagged[0], flagged[1])
+            return
+
+        if kind == REPORT_KIND_COORD:
+            if len(data) >= REPORT_HEADER.size + REPORT_COORD.size and count > 0:
+                fields = REPORT_COORD.unpack_from(data, REPORT_HEADER.size)
+                self.delay_matrix.set_coord(node, fields[1], fields[2:5], fields[5], fields[6])
+                self.fill_predicted(node)
+                self.delay_version += 1
+            return
+
+        if kind == REPORT_KIND_LINK:
+            count = min(count, (len(data) - REPORT_HEADER.size) / REPORT_LINK.size)
+            for i in range(count):
+                peer, state, pad, losses, silent = REPORT_LINK.unpack_from(data, REPORT_HEADER.size + i * REPORT_LINK.size)
+                if peer < self.delay_matrix.n and peer != node:
+                    self.set_link(node, peer, state == REPORT_LINK_UP, losses, silent / 1e6)
+            return
+
+        if kind == REPORT_KIND_BANDWIDTH:
+            count = min(count, (len(data) - REPORT_HEADER.size) / REPORT_BANDWIDTH.size)
+            for i in range(count):
+                fields = REPORT_BANDWIDTH.unpack_from(data, REPORT_HEADER.size + i * REPORT_BANDWIDTH.size)
+                if fields[0] < self.delay_matrix.n and fields[0] != node:
+                    self.set_bandwidth(node, *fields)
+            return
+
+        if kind == REPORT_KIND_CLOCK:
+            count = min(count, (len(data) - REPORT_HEADER.size) / REPORT_CLOCK.size)
+            for i in range(count):
+                fields = REPORT_CLOCK.unpack_from(data, REPORT_HEADER.size + i * REPORT_CLOCK.size)
+                if fields[0] < self.delay_matrix.n:
+                    self.delay_matrix.set_clock(node, *fields)
+            return
+
+        count = min(count, (len(data) - REPORT_HEADER.size) / REPORT_DELAY.size)
+        now = time.time()
+        line = ""
+        peers = []
+        for i in range(count):
+            peer, samples, loss, reorder, median, p90 = REPORT_DELAY.unpack_from(data, REPORT_HEADER.size + i * REPORT_DELAY.size)
+            if peer >= self.delay_matrix.n:
+                continue
+            self.delay_matrix.set(node, peer, median / 1e6, p90 / 1e6, loss / 65535., reorder / 65535., samples, now)
+            self.set_weight(node, peer, median / 1e6 if samples > 0 else None)
+            line += "%s:%f " % (servers[peer][0], median / 1e6)
+            peers.append(peer)
+        self.delay_matrix.reports += 1
+        self.delay_version += 1
+        self.publish_row(node, peers)
+
+        log.debug("Report %d fragment %d/%d from %s: %d record(s)%s", seq, fragment + 1, fragments, servers[node][0],
+                  count, " (delta)" if flags & REPORT_F_DELTA else "")
+
+        # Without the history store append the received delays on the logs file; with it they are appended
+        # once the stats report of the same round arrives.
+        if self.history is None:
+            with open('./cxp/logs/' + servers[node][0], 'a') as f:
+                f.write(time.strftime("%c \t") + " " + line + "\n")
+
     def initialize_servers (self):
         '''
             Setup OVS interfaces for each node by sending the bash commands the node will run.
@@ -227,25 +651,54 @@ class CXP(EventMixin):
         '''
         log.info("Requesting delays...")
         sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        # Every relay gets the same schedule: when slot 0 starts, the round number that rotates the slots and
+        # the slot length.
+        self.probe_round += 1
+        schedule = {'start': int(time.time() * 1000) + PROBE_START_MS, 'round': self.probe_round,
+                    'slot': PROBE_SLOT_MS, 'sample': PROBE_SAMPLE if len(servers) - 1 > PROBE_SAMPLE else 0}
+        if self.delay_matrix is not None:
+            edges, median, p90 = self.delay_matrix.accuracy()
+            if edges:
+                log.info("Coordinates: relative error median %.3f p90 %.3f over %d measured edge(s), %d flagged",
+                         median, p90, edges, len(self.delay_matrix.disagree))
         for s in servers:
             server_address = (s[1], 32033)
             new_servers = ['d',s[0]]
-            for k in servers:
-                if k != s: new_servers.append(k)
+            # The relays are numbered by their position in servers; a relay's own id is the one left out.
+            for i, k in enumerate(servers):
+                if k != s: new_servers.append(list(k) + [i])
+            new_servers.append(schedule)
             # Send data
             sent = sock.sendto(json.dumps(new_servers), server_address)
         sock.close()
 
     def calculate_best_paths (self):
         '''
-            Setup a Directional Graph with one way delays as edge weights.
+            Setup a Directional Graph with one way delays as edge weights, unless no delay changed since.
         '''
+        version = self.delay_version
+        if version == self.graph_version:
+            return
+        self.graph_version = version
         tmp = nx.DiGraph()
         tmp.add_nodes_from(self.G.nodes())
         # Delete outdated edges
         self.G.clear()
         self.G.add_nodes_from(tmp)
 
+        # Relays that send binary reports fill the delay matrix directly.
+        if self.delay_matrix is not None and self.delay_matrix.reports > 0:
+            m = self.delay_matrix
+            for src in range(m.n):
+                for dst in range(m.n):
+                    if (src, dst) in self.down:
+                        continue
+                    if src != dst and m.samples[src][dst] > 0:
+                        self.G.add_edge(servers[src][0], servers[dst][0], weight=m.weight(src, dst, m.median[src][dst]))
+                    elif src != dst and m.predicted_rtt(src, dst) is not None:
+                        self.G.add_edge(servers[src][0], servers[dst][0], weight=m.predicted_rtt(src, dst) / 2)
+            return
+
         for server in bridge2ip:
             fname = './cxp/logs/%s' % server
             print "Reading delays for %s bridge" % (fname)
@@ -255,10 +708,208 @@ class CXP(EventMixin):
                     ss = f.readline().split(" ")
                     for i in range(0,len(ss)-1):
                         sm = ss[i].split(":")
+                        if (self.server_index.get(str(server)), self.server_index.get(sm[0])) in self.down:
+                            continue
                         self.G.add_edge(str(server), sm[0], weight=float(sm[1]) )
                 
 
 
+    def best_path (self, src, dst):
+        '''
+            Path between two bridges: the lowest delay one, through the hysteresis of self.selector. The routing
+            engine has it ready as soon as the delays arrive; without it (or before it has a path) the graph is
+            rebuilt and searched with networkx.
+        '''
+        path = None
+        if self.router is not None:
+            path = self.router.path(self.server_index[src], self.server_index[dst])
+            path = [servers[i][0] for i in path] if path else None
+        if path is None:
+            self.calculate_best_paths()
+            path = list(nx.all_shortest_paths(self.G, src, dst, weight='weight'))[0]
+        return self.selector.select((src, dst), path, time.time())
+
+    def path_delay (self, path):
+        '''
+            Delay of a path of bridges with the weights the paths are computed from, None if an edge is gone.
+        '''
+        total = 0.
+        for src, dst in zip(path, path[1:]):
+            if self.router is not None:
+                weight = self.router.weight(self.server_index[src], self.server_index[dst])
+                if not 0 <= weight < float('inf'):
+                    return None
+            elif self.G.has_edge(src, dst):
+                weight = self.G[src][dst]['weight']
+            else:
+                return None
+            total += weight
+        return total
+
+    def path_spread (self, path):
+        '''
+            How far the delay of a path may be off, in ms: the root of the sum of (p90 - median)^2 of its edges,
+            0 for the edges without a p90 (text reports).
+        '''
+        m = self.delay_matrix
+        total = 0.
+        for src, dst in zip(path, path[1:]):
+            src, dst = self.server_index.get(src), self.server_index.get(dst)
+            if m is None or src is None or dst is None:
+                continue
+            if m.p90[src][dst] is not None and m.median[src][dst] is not None:
+                total += max(m.p90[src][dst] - m.median[src][dst], 0.) ** 2
+        return total ** 0.5
+
+    def all_best_paths (self, bridges):
+        '''
+            Lowest delay paths of every ordered pair of bridges, key (src, dst); the pairs without a path are left
+            out. The graph is built and searched once for all of them when there is no routing engine.
+        '''
+        paths = {}
+        if self.router is not None:
+            for src in bridges:
+                for dst in bridges:
+                    if src != dst:
+                        path = self.router.path(self.server_index[src], self.server_index[dst])
+                        if path:
+                            paths[(src, dst)] = [servers[i][0] for i in path]
+            return paths
+        self.calculate_best_paths()
+        for src, reach in dict(nx.all_pairs_dijkstra_path(self.G, weight='weight')).items():
+            for dst, path in reach.items():
+                if src != dst and src in bridges and dst in bridges:
+                    paths[(src, dst)] = path
+        return paths
+
+    def sync_flows (self):
+        '''
+            Proactive flows: if the delays changed since the last time, recompute the paths of every pair of
+            bridges and send each switch the rules that differ from the ones it has, in one batch closed with a
+            barrier. Runs from the timer and when the switches come up, on the openflow thread.
+        '''
+        if len(self.dpid2switch) < len(bridge2ip) or self.delay_version == self.flows_version:
+            return
+        version = self.delay_version
+        switches = dict((tswitch.bridge, tswitch) for tswitch in self.dpid2switch.values())
+
+        starttime = time.time()
+        best = self.all_best_paths(switches.keys())
+        for pair in self.paths:
+            if pair not in best:
+                self.selector.forget(pair)
+        self.paths = dict((pair, self.selector.select(pair, path, starttime)) for pair, path in best.items())
+        self.backups = self.backup_paths(self.paths, switches.keys())
+        endtime = time.time()
+
+        changed = self.push_paths(switches)
+        self.flows_version = version
+        counts = self.selector.counts()
+        log.info("%d path(s) and their backups in %.3f s, %d flow_mod(s) sent; route changes so far: %d applied, "
+                 "%d forced, %d suppressed" % (len(self.paths), endtime - starttime, changed, counts['applied'],
+                 counts['forced'], counts['suppressed']))
+
+    def push_paths (self, switches):
+        '''
+            Send every switch the rules of self.paths that it does not have yet; returns the flow_mods sent.
+        '''
+        rules = dict((bridge, {}) for bridge in switches)
+        for (src, dst), path in self.paths.items():
+            match = (switches[src].ip_addr, switches[dst].ip_addr)
+            for s in range(0, len(path) - 1):
+                rules[path[s]][match] = path[s + 1]
+            rules[path[-1]][match] = None
+
+        changed = 0
+        for bridge, tswitch in switches.items():
+            pushed = tswitch.push_flow_rules(rules[bridge], switches)
+            if pushed is not None:
+                self.barriers[(tswitch.dpid, pushed[0])] = (time.time(), pushed[1])
+                changed += pushed[1]
+        return changed
+
+    def edge_weights (self, bridges):
+        '''
+            Weights of the edges between the bridges the paths were computed from, key (src, dst).
+        '''
+        weights = {}
+        for src in bridges:
+            for dst in bridges:
+                if src == dst:
+                    continue
+                if self.router is not None:
+                    weight = self.router.weight(self.server_index[src], self.server_index[dst])
+                    if 0 <= weight < float('inf'):
+                        weights[(src, dst)] = weight
+                elif self.G.has_edge(src, dst):
+                    weights[(src, dst)] = self.G[src][dst]['weight']
+        return weights
+
+    def backup_paths (self, paths, bridges):
+        '''
+            Up to BACKUP_PATHS backups of every pair, lowest delay first, out of the direct edge and the detours
+            through one other relay: on a mesh of tunnels these are disjoint by construction, so a backup is kept
+            if it shares no edge and no relay with the best path and the backups before it. O(n) per pair, where
+            k shortest disjoint paths would take k searches.
+        '''
+        weights = self.edge_weights(bridges)
+        backups = {}
+        for (src, dst), path in paths.items():
+            edges = set(zip(path, path[1:]))
+            relays = set(path[1:-1])
+            candidates = []
+            if (src, dst) in weights:
+                candidates.append((weights[(src, dst)], [src, dst]))
+            for via in bridges:
+                if via != src and via != dst and (src, via) in weights and (via, dst) in weights:
+                    candidates.append((weights[(src, via)] + weights[(via, dst)], [src, via, dst]))
+            candidates.sort()
+
+            backups[(src, dst)] = []
+            for weight, candidate in candidates:
+                if len(backups[(src, dst)]) == BACKUP_PATHS:
+                    break
+                if edges & set(zip(candidate, candidate[1:])) or relays & set(candidate[1:-1]):
+                    continue
+                backups[(src, dst)].append(candidate)
+                edges |= set(zip(candidate, candidate[1:]))
+                relays |= set(candidate[1:-1])
+        return backups
+
+    def failover (self):
+        '''
+            Move the pairs whose path crosses an edge that is down to their first backup that does not, and send
+            the rules that changed; a pair left without one loses its rules. Runs on the openflow thread, right
+            after the report, and leaves the recomputation of the paths to the next sync.
+        '''
+        if self.flows_version < 0:
+            return
+        down = set((servers[src][0], servers[dst][0]) for src, dst in list(self.down))
+        crosses = lambda path: any(edge in down for edge in zip(path, path[1:]))
+        moved = lost = 0
+        for pair, path in list(self.paths.items()):
+            if not crosses(path):
+                continue
+            backups = [backup for backup in self.backups.get(pair, []) if not crosses(backup)]
+            if backups:
+                self.paths[pair] = backups[0]
+                self.selector.move(pair, backups[0], time.time())
+                moved += 1
+            else:
+                del self.paths[pair]
+                self.selector.forget(pair)
+                lost += 1
+        if moved or lost:
+            changed = self.push_paths(dict((tswitch.bridge, tswitch) for tswitch in self.dpid2switch.values()))
+            log.info("Failover: %d pair(s) moved to a backup path, %d left without one, %d flow_mod(s) sent",
+                     moved, lost, changed)
+
+    def _handle_BarrierIn (self, event):
+        sent = self.barriers.pop((event.dpid, event.xid), None)
+        if sent is not None:
+            log.info("Switch %s: %d rule(s) in place after %.1f ms", dpidToStr(event.dpid), sent[1],
+                     (time.time() - sent[0]) * 1000)
+
     def _handle_ConnectionUp (self, event):
         log.info("Switch %s has come up.", dpidToStr(event.dpid))
         if event.dpid not in self.dpid2switch:
@@ -269,6 +920,8 @@ class CXP(EventMixin):
             log.info("All relay nodes connected.. Learning topology.")
             for tswitch in self.dpid2switch:
                 self.learn_macs(self.dpid2switch[tswitch])
+            if PROACTIVE_FLOWS:
+                self.sync_flows()
 
     def learn_macs(self, tswitch):
         for port_no in tswitch.ports:
@@ -315,13 +968,18 @@ class CXP(EventMixin):
 
             log.debug("Handling IP packet between %s and %s" % (str(srcip), str(dstip)))
 
+            if PROACTIVE_FLOWS and len(self.dpid2switch) == len(bridge2ip):
+                # The rules of the pair are on their way, or there is no path for it yet; the sync that follows
+                # the next delay update installs them.
+                self.sync_flows()
+                return
+
             if srcip in self.arpmap.keys() and dstip in self.arpmap.keys():
-                self.calculate_best_paths()
                 log.info("%s -> %s" % (self.arpmap[dstip].bridge, self.arpmap[srcip].bridge))
 
                 # We find the shortest weight path from the Directional Graph.
                 starttime = time.time()
-                path = list(nx.all_shortest_paths(self.G, self.arpmap[dstip].bridge, self.arpmap[srcip].bridge, weight='weight'))
+                path = [self.best_path(self.arpmap[dstip].bridge, self.arpmap[srcip].bridge)]
                 endtime = time.time()
 
                 log.info(str(path) + " - time elapsed for path calculation: " + str(endtime-starttime))
@@ -333,7 +991,7 @@ class CXP(EventMixin):
                 log.info("%s -> %s" % (self.arpmap[srcip].bridge, self.arpmap[dstip].bridge))
 
                 starttime = time.time()
-                path = list(nx.all_shortest_paths(self.G, self.arpmap[srcip].bridge, self.arpmap[dstip].bridge, weight='weight'))
+                path = [self.best_path(self.arpmap[srcip].bridge, self.arpmap[dstip].bridge)]
                 endtime = time.time()
 
                 log.info(str(path) + " - time elapsed for path calculation: " + str(endtime-starttime))
@@ -371,6 +1029,7 @@ class TunnelSwitch (EventMixin):
         self.ports = {}         # key = port_no, value = (remote host IP, local gre macs)
         self._listeners = None
         self.ip2port = {}       # key = IP, value = outport
+        self.installed = {}     # proactive rules, key = (src IP, dst IP), value = next hop bridge, None if local
 
     def __repr__(self):
         return dpidToStr(self.dpid)
@@ -408,24 +1067,52 @@ class TunnelSwitch (EventMixin):
         log.debug("Sendind ARP reply through port %s" % (outport))
         log.debug(arp_reply)
 
-    def install_flow_rule(self, srcip, dstip, next_hop_switch, last_node=False):
-        log.debug("install_flow_rule src %s dst %s brg %s outport %s" %(srcip, dstip, self.bridge, self.ip2port[next_hop_switch.ip_addr]))
-        msg = of.ofp_flow_mod()
+    def flow_mod(self, srcip, dstip, next_hop_switch=None, command=of.OFPFC_ADD):
+        '''
+            Rule forwarding srcip -> dstip to next_hop_switch, or up to the bridge itself without one.
+        '''
+        msg = of.ofp_flow_mod(command = command)
         msg.match.dl_type = 0x800
         msg.match.nw_src = srcip
         msg.match.nw_dst = dstip
-        msg.actions.append(of.ofp_action_dl_addr.set_dst(next_hop_switch.hw_addr))
-        msg.actions.append(of.ofp_action_output(port = self.ip2port[next_hop_switch.ip_addr]))
+        if command != of.OFPFC_ADD:
+            return msg
+        if next_hop_switch is not None:
+            msg.actions.append(of.ofp_action_dl_addr.set_dst(next_hop_switch.hw_addr))
+            msg.actions.append(of.ofp_action_output(port = self.ip2port[next_hop_switch.ip_addr]))
+        else:
+            msg.actions.append(of.ofp_action_output(port = of.OFPP_LOCAL))
+        return msg
+
+    def push_flow_rules(self, rules, switches):
+        '''
+            Bring the proactive rules of the switch to rules (key (src IP, dst IP), value the next hop bridge or
+            None). The rules that changed are added, the ones that are gone deleted, all in one write closed
+            with a barrier. Returns the barrier's xid and the number of flow_mods, None if nothing changed.
+        '''
+        msgs = []
+        for match, next_hop in rules.items():
+            if match not in self.installed or self.installed[match] != next_hop:
+                msgs.append(self.flow_mod(match[0], match[1], switches[next_hop] if next_hop is not None else None))
+        for match in self.installed:
+            if match not in rules:
+                msgs.append(self.flow_mod(match[0], match[1], command = of.OFPFC_DELETE_STRICT))
+        if not msgs:
+            return None
+        barrier = of.ofp_barrier_request()
+        self.connection.send(b''.join([msg.pack() for msg in msgs] + [barrier.pack()]))
+        self.installed = dict(rules)
+        return barrier.xid, len(msgs)
+
+    def install_flow_rule(self, srcip, dstip, next_hop_switch, last_node=False):
+        log.debug("install_flow_rule src %s dst %s brg %s outport %s" %(srcip, dstip, self.bridge, self.ip2port[next_hop_switch.ip_addr]))
+        msg = self.flow_mod(srcip, dstip, next_hop_switch)
         msg.idle_timeout = 30
         msg.hard_timeout = 300
         self.connection.send(msg)
 
         if last_node:
-            msg = of.ofp_flow_mod()
-            msg.match.dl_type = 0x800
-            msg.match.nw_src = srcip
-            msg.match.nw_dst = dstip
-            msg.actions.append(of.ofp_action_output(port = of.OFPP_LOCAL))
+            msg = self.flow_mod(srcip, dstip)
             msg.idle_timeout = 30
             msg.hard_timeout = 300
             self.connection.send(msg)
@@ -0,0 +1,404 @@
+#!/usr/bin/python
+
+###############################################################################################################
+## [Title]: cxp_replay.py -- replay of the recorded delays through the path computation of the controller
+## [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+##-------------------------------------------------------------------------------------------------------------
+## [Details]:
+## Streams a delay history, in time order and as fast as it can, through the path computation handle_IP_pktin
+## uses (best_path in CXP.py): the native routing engine of cxp_route.py, or with --engine networkx the graph
+## rebuilt from the delays and searched with all_shortest_paths. The histories it reads:
+##
+##     -t dir          a delay history store (cxp_tsdb.py), ./cxp/tsdb of the controller or ./logs/tsdb of an agent
+##     -l dir          the text logs of the controller, ./cxp/logs/<name>
+##     -a name=dir     the logs of an agent of poll_server.c, ./logs/<peer> ("RTT/forward/reverse" blocks),
+##                     one update per block with its median forward delay; repeat for every agent
+##
+## The one way (forward) delay of every record is the weight of its edge; the records without one (lost
+## probes) and those of the ICMP targets of an agent are skipped. After every update the paths of the pairs
+## (all of them, or -p a-b,c-d) are recomputed, or once per --step seconds of history to see what a slower
+## controller would have done. For every pair it reports the latency of the path it was on against the direct
+## edge over the same time, how many times the path changed and the share of the time it was not on the direct
+## edge, and overall the time a recomputation took:
+##
+##     python cxp_replay.py -t ./cxp/tsdb [-c ./cxp/servers.json] [-s start] [-e end] [--step s] [-o out.json]
+##
+## --switch-ms, --switch-ratio and --dwell put the paths through the hysteresis of the controller
+## (cxp_route.PathSelector, ROUTE_* in CXP.py), e.g. --switch-ms 0.5 --switch-ratio 0.05 --dwell 30, and report
+## the route changes it held back next to the ones it made. The history has no spread, so there is no
+## confidence test.
+##
+## Times are unix seconds. The nodes are named from servers.json when there is one (the controller numbers
+## the relays in its order), by their id otherwise.
+##-------------------------------------------------------------------------------------------------------------
+## [Warning]:
+## This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+## secured. Feel free to change or improve it any way you see fit.
+##-------------------------------------------------------------------------------------------------------------
+## [Modification, Distribution, and Attribution]:
+## You are free to modify and/or distribute this script as you wish.  I only ask that you maintain original
+## author attribution.
+###############################################################################################################
+
+from __future__ import print_function
+
+import os
+import sys
+import json
+import math
+import time
+import array
+import optparse
+
+import cxp_route
+import cxp_tsdb
+
+ADDRESS_ID_BASE = 0x8000        # relay_scripts/epoll_server.c: the ids of the ICMP targets and hops
+
+try:
+    import networkx as nx
+except ImportError:
+    nx = None
+
+class Nodes(object):
+    '''
+        Names and ids of the relays: the ids are the positions in servers.json, the names not in it get the
+        next ones.
+    '''
+    def __init__(self, servers=None):
+        self.names = []
+        self.ids = {}
+        if servers and os.path.exists(servers):
+            with open(servers) as f:
+                for server in json.load(f):
+                    self.id(str(server['name']))
+
+    def id(self, name):
+        if name not in self.ids:
+            self.ids[name] = len(self.names)
+            self.names.append(name)
+        return self.ids[name]
+
+    def name(self, i):
+        while len(self.names) <= i:
+            self.names.append(str(len(self.names)))
+        return self.names[i]
+
+def controller_logs(path, nodes):
+    '''
+        (time, src, dst, forward) updates of the text logs of CXP.py, a "%c \\t  peer:delay peer:delay" line
+        per report.
+    '''
+    updates = []
+    for name in sorted(os.listdir(path)):
+        src = nodes.id(name)
+        with open(os.path.join(path, name)) as f:
+            for line in f:
+                if '\t' not in line:
+                    continue
+                stamp, edges = line.split('\t', 1)
+                try:
+                    t = time.mktime(time.strptime(stamp.strip(), '%c'))
+                except ValueError:
+                    continue
+                for edge in edges.split():
+                    peer, sep, delay = edge.rpartition(':')
+                    if sep and peer != name:
+                        try:
+                            updates.append((t, src, nodes.id(peer), float(delay)))
+                        except ValueError:
+                            pass
+    updates.sort()
+    return updates
+
+def agent_logs(name, path, nodes):
+    '''
+        (time, src, dst, forward) updates of the logs of one poll_server.c agent: a timestamp, the
+        "RTT/forward/reverse delays" title and "rtt / forward / reverse" lines per round, in a file per peer.
+    '''
+    updates = []
+    src = nodes.id(name)
+
+    def flush(t, dst, forward):
+        if t is not None and forward:
+            forward.sort()
+            updates.append((t, src, dst, forward[len(forward) // 2]))
+
+    for peer in sorted(os.listdir(path)):
+        if not os.path.isfile(os.path.join(path, peer)) or peer == name:
+            continue
+        dst = nodes.id(peer)
+        t, forward = None, []
+        with open(os.path.join(path, peer)) as f:
+            for line in f:
+                line = line.strip()
+                fields = [field.strip() for field in line.split('/')]
+                if len(fields) == 3:
+                    try:
+                        forward.append(float(fields[1]))
+                    except ValueError:
+                        pass
+                    continue
+                try:
+                    stamp = time.mktime(time.strptime(line, '%Y:%m:%d %H:%M:%S'))
+                except ValueError:
+                    continue
+                flush(t, dst, forward)
+                t, forward = stamp, []
+        flush(t, dst, forward)
+    updates.sort()
+    return updates
+
+class Replay(object):
+    '''
+        The weights as they were at the time of the last update, the path every pair was on and what that cost.
+    '''
+    def __init__(self, n, engine, pairs, step, selector=None):
+        self.n = n
+        self.engine = engine
+        self.pairs = pairs
+        self.step = step
+        self.selector = cxp_route.PathSelector(self.latency, **selector) if selector is not None else None
+        self.weight = [[None] * n for i in range(n)]
+        self.router = cxp_route.RouteEngine(n) if engine == 'native' else None
+        self.path = dict((pair, None) for pair in pairs)
+        self.changes = dict((pair, 0) for pair in pairs)
+        self.achieved = dict((pair, 0.) for pair in pairs)     # ms x s on the path it was on
+        self.direct = dict((pair, 0.) for pair in pairs)       # ms x s on the direct edge, over the same time
+        self.covered = dict((pair, 0.) for pair in pairs)      # s with both known
+        self.detour = dict((pair, 0.) for pair in pairs)       # s of covered off the direct edge
+        self.compute = array.array('d')                         # s per recomputation
+        self.pending = 0.                                       # s of set_weight since the last one
+        self.updates = 0
+        self.now = self.first = None
+        self.next_step = None
+        self.dirty = False
+
+    def latency(self, path):
+        if not path:
+            return None
+        total = 0.
+        for k in range(len(path) - 1):
+            w = self.weight[path[k]][path[k + 1]]
+            if w is None:
+                return None
+            total += w
+        return total
+
+    def account(self, t):
+        '''
+            Charge every pair with its path and its direct edge from the last update until t.
+        '''
+        dt = t - self.now
+        for pair, path in self.path.items():
+            achieved = self.latency(path)
+            direct = self.weight[pair[0]][pair[1]]
+            if achieved is None or direct is None:
+                continue
+            self.achieved[pair] += achieved * dt
+            self.direct[pair] += direct * dt
+            self.covered[pair] += dt
+            if len(path) > 2:
+                self.detour[pair] += dt
+        self.now = t
+
+    def best_paths(self):
+        if self.router is not None:
+            paths = {}
+            for src, dst in self.pairs:
+                paths[(src, dst)] = self.router.path(src, dst) or None
+            return paths
+
+        # calculate_best_paths and best_path of CXP.py, with the graph built once for all the pairs
+        G = nx.DiGraph()
+        G.add_nodes_from(range(self.n))
+        for src in range(self.n):
+            for dst in range(self.n):
+                if src != dst and self.weight[src][dst] is not None:
+                    G.add_edge(src, dst, weight=self.weight[src][dst])
+        paths = {}
+        for src, dst in self.pairs:
+            try:
+                paths[(src, dst)] = list(nx.all_shortest_paths(G, src, dst, weight='weight'))[0]
+            except nx.NetworkXNoPath:
+                paths[(src, dst)] = None
+        return paths
+
+    def recompute(self):
+        start = time.time()
+        paths = self.best_paths()
+        self.compute.append(time.time() - start + self.pending)
+        self.pending = 0.
+        for pair, path in paths.items():
+            if self.selector is not None:
+                path = self.selector.select(pair, path, self.now)
+            if self.path[pair] is not None and path != self.path[pair]:
+                self.changes[pair] += 1
+            self.path[pair] = path
+        self.dirty = False
+
+    def feed(self, t, src, dst, weight):
+        if src >= self.n or dst >= self.n or src == dst:
+            return
+        if weight is not None and (math.isnan(weight) or weight < 0):
+            weight = None
+        if self.now is None:
+            self.now = self.first = t
+            self.next_step = t + self.step
+        if t > self.now:
+            self.account(t)
+        if self.step and self.dirty and t >= self.next_step:
+            self.recompute()
+            self.next_step = t + self.step
+
+        self.weight[src][dst] = weight
+        if self.router is not None:
+            start = time.time()
+            self.router.set_weight(src, dst, weight)
+            self.pending += time.time() - start
+        self.updates += 1
+        self.dirty = True
+        if not self.step:
+            self.recompute()
+
+    def finish(self):
+        if self.dirty:
+            self.recompute()
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+def parse_pairs(spec, nodes, n):
+    if not spec:
+        return [(src, dst) for src in range(n) for dst in range(n) if src != dst]
+    pairs = []
+    for pair in spec.split(','):
+        a, b = pair.split('-', 1)
+        pairs.append(tuple(nodes.ids[x] if x in nodes.ids else int(x) for x in (a, b)))
+    return pairs
+
+def main():
+    parser = optparse.OptionParser()
+    parser.add_option('-t', '--tsdb', help='delay history store')
+    parser.add_option('-l', '--logs', help='text logs of the controller')
+    parser.add_option('-a', '--agent', action='append', default=[], help='name=dir of the logs of an agent')
+    parser.add_option('-c', '--servers', default='./cxp/servers.json')
+    parser.add_option('-s', '--start', type='float', default=0)
+    parser.add_option('-e', '--end', type='float')
+    parser.add_option('-p', '--pairs', help='src-dst,... by name or id, all of them by default')
+    parser.add_option('--step', type='float', default=0, help='seconds of history between recomputations')
+    parser.add_option('--engine', default='native' if cxp_route.available() else 'networkx',
+                      help='native or networkx')
+    parser.add_option('--switch-ms', type='float', help='route hysteresis: least gain of a new path, ms')
+    parser.add_option('--switch-ratio', type='float', help='route hysteresis: least gain, share of the path delay')
+    parser.add_option('--dwell', type='float', help='route hysteresis: least seconds on a path')
+    parser.add_option('-o', '--output', help='JSON file of the results')
+    opts, args = parser.parse_args()
+
+    if opts.engine == 'native' and not cxp_route.available():
+        print("native/libcxproute.so is not built, run make -C native", file=sys.stderr)
+        return 1
+    if opts.engine == 'networkx' and nx is None:
+        print("networkx is not installed", file=sys.stderr)
+        return 1
+    if opts.tsdb and not cxp_tsdb.available():
+        print("native/libcxptsdb.so is not built, run make -C native", file=sys.stderr)
+        return 1
+    if not opts.tsdb and not opts.logs and not opts.agent:
+        parser.error("nothing to replay, give -t, -l or -a")
+
+    nodes = Nodes(opts.servers)
+    updates = []
+    if opts.logs:
+        updates += controller_logs(opts.logs, nodes)
+    for agent in opts.agent:
+        name, path = agent.split('=', 1)
+        updates += agent_logs(name, path, nodes)
+    updates = [u for u in updates if u[0] >= opts.start and (opts.end is None or u[0] < opts.end)]
+    updates.sort()
+
+    n = len(nodes.names)
+    if opts.tsdb:
+        for src, dst in cxp_tsdb.edges(opts.tsdb, opts.start, opts.end):
+            if src < ADDRESS_ID_BASE and dst < ADDRESS_ID_BASE:
+                n = max(n, src + 1, dst + 1)
+    if n < 2:
+        print("no edges to replay", file=sys.stderr)
+        return 1
+    selector = None
+    if opts.switch_ms is not None or opts.switch_ratio is not None or opts.dwell is not None:
+        selector = {'switch_ms': opts.switch_ms or 0., 'switch_ratio': opts.switch_ratio or 0.,
+                    'dwell_s': opts.dwell or 0.}
+    replay = Replay(n, opts.engine, parse_pairs(opts.pairs, nodes, n), opts.step, selector)
+
+    wall = time.time()
+    if opts.tsdb:
+        # the records of the store come in the order they were appended, the text logs are merged in by time
+        merged = [0]
+        def visit(t, src, dst, rtt, fwd, rev, loss):
+            while merged[0] < len(updates) and updates[merged[0]][0] <= t:
+                replay.feed(*updates[merged[0]])
+                merged[0] += 1
+            if not math.isnan(fwd):
+                replay.feed(t, src, dst, fwd)
+        cxp_tsdb.visit(opts.tsdb, visit, opts.start, opts.end)
+        updates = updates[merged[0]:]
+    for update in updates:
+        replay.feed(*update)
+    replay.finish()
+    wall = time.time() - wall
+
+    pairs = []
+    for pair in replay.pairs:
+        covered = replay.covered[pair]
+        entry = {'src': nodes.name(pair[0]), 'dst': nodes.name(pair[1]), 'changes': replay.changes[pair],
+                 'covered_s': covered, 'achieved_ms': None, 'direct_ms': None, 'gain_ms': None, 'detour': None,
+                 'path': [nodes.name(i) for i in replay.path[pair]] if replay.path[pair] else None}
+        if covered > 0:
+            entry['achieved_ms'] = replay.achieved[pair] / covered
+            entry['direct_ms'] = replay.direct[pair] / covered
+            entry['gain_ms'] = entry['direct_ms'] - entry['achieved_ms']
+            entry['detour'] = replay.detour[pair] / covered
+        pairs.append(entry)
+
+    compute = list(replay.compute)
+    simulated = replay.now - replay.first if replay.now is not None else 0
+    summary = {'engine': opts.engine, 'nodes': n, 'pairs': len(pairs), 'updates': replay.updates,
+               'recomputations': len(compute), 'route_changes': sum(replay.changes.values()),
+               'history_s': simulated, 'wall_s': wall, 'speedup': simulated / wall if wall > 0 else None,
+               'compute_us': {'mean': sum(compute) / len(compute) * 1e6 if compute else None,
+                              'median': (percentile(compute, 0.5) or 0) * 1e6,
+                              'p99': (percentile(compute, 0.99) or 0) * 1e6,
+                              'max': max(compute) * 1e6 if compute else None}}
+    if replay.selector is not None:
+        summary['hysteresis'] = dict(selector, **replay.selector.counts())
+
+    fmt = lambda v, f='%.3f': '-' if v is None else f % v
+    print("%12s %12s %10s %10s %10s %8s %8s  %s" % ("src", "dst", "path ms", "direct ms", "gain ms", "detour",
+                                                   "changes", "last path"))
+    for e in pairs:
+        print("%12s %12s %10s %10s %10s %8s %8d  %s" % (e['src'], e['dst'], fmt(e['achieved_ms']),
+              fmt(e['direct_ms']), fmt(e['gain_ms']), fmt(e['detour'], '%.2f'), e['changes'],
+              '>'.join(e['path']) if e['path'] else '-'))
+    print("%d update(s) over %.0f s of history in %.2f s (%sx), %d recomputation(s) with %s: mean %s us, "
+          "median %s us, p99 %s us; %d route change(s)" % (summary['updates'], simulated, wall,
+          fmt(summary['speedup'], '%.0f'), len(compute), opts.engine, fmt(summary['compute_us']['mean'], '%.1f'),
+          fmt(summary['compute_us']['median'], '%.1f'), fmt(summary['compute_us']['p99'], '%.1f'),
+          summary['route_changes']))
+    if replay.selector is not None:
+        counts = replay.selector.counts()
+        print("hysteresis: %d change(s) applied, %d forced by a broken path, %d suppressed (%d gain, %d dwell)" %
+              (counts['applied'], counts['forced'], counts['suppressed'], counts['suppressed_gain'],
+               counts['suppressed_dwell']))
+
+    if opts.output:
+        with open(opts.output, 'w') as f:
+            json.dump({'pairs': pairs, 'summary': summary}, f, indent=1, sort_keys=True)
+            f.write('\n')
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
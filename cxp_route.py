@@ -0,0 +1,193 @@
+#!/usr/bin/python
+
+###############################################################################################################
+## [Title]: cxp_route.py -- python binding of the native routing engine
+## [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+##-------------------------------------------------------------------------------------------------------------
+## [Details]:
+## ctypes wrapper of native/libcxproute.so (build it with `make -C native`). The relays are numbered like the
+## servers list of CXP.py and the weights are one way delays in ms. Every edge update keeps the all-pairs
+## shortest paths up to date incrementally, so a path lookup is a walk of the predecessor array. Set
+## CXP_ROUTE_LIB to load the library from somewhere else.
+##
+## PathSelector keeps every pair on the path it is on until a lower delay one is worth the flow_mods of the move.
+## It is plain python and works on the paths of either the engine or networkx.
+##-------------------------------------------------------------------------------------------------------------
+## [Warning]:
+## This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+## secured. Feel free to change or improve it any way you see fit.
+##-------------------------------------------------------------------------------------------------------------
+## [Modification, Distribution, and Attribution]:
+## You are free to modify and/or distribute this script as you wish.  I only ask that you maintain original
+## author attribution.
+###############################################################################################################
+
+import os
+import math
+import ctypes
+import threading
+
+_lib = None
+
+def load_library(path=None):
+    '''
+        Load libcxproute.so once. Returns None when it is not built, so callers can fall back to networkx.
+    '''
+    global _lib
+    if _lib is not None:
+        return _lib
+
+    if path is None:
+        path = os.environ.get('CXP_ROUTE_LIB',
+                              os.path.join(os.path.dirname(os.path.abspath(__file__)), 'native', 'libcxproute.so'))
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    lib.route_create.restype = ctypes.c_void_p
+    lib.route_create.argtypes = [ctypes.c_int]
+    lib.route_destroy.argtypes = [ctypes.c_void_p]
+    lib.route_set_weight.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_double]
+    lib.route_set_weights.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_double)]
+    lib.route_get_weight.restype = ctypes.c_double
+    lib.route_get_weight.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+    lib.route_distance.restype = ctypes.c_double
+    lib.route_distance.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+    lib.route_path.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_int32), ctypes.c_int]
+    lib.route_recomputed.restype = ctypes.c_uint64
+    lib.route_recomputed.argtypes = [ctypes.c_void_p]
+    _lib = lib
+    return _lib
+
+def available():
+    return load_library() is not None
+
+class RouteEngine(object):
+    '''
+        All-pairs lowest delay paths of n relays. None, negative or infinite weights mean no edge. The calls are
+        serialized with a lock, because the delay controller thread updates the weights while the packet-in
+        handler reads paths.
+    '''
+    def __init__(self, n):
+        self.lib = load_library()
+        if self.lib is None:
+            raise OSError("libcxproute.so is not built, run make -C native")
+        self.n = n
+        self.handle = self.lib.route_create(n)
+        if not self.handle:
+            raise MemoryError("route_create(%d) failed" % n)
+        self.lock = threading.Lock()
+        self.path_buffer = (ctypes.c_int32 * n)()
+
+    def __del__(self):
+        if getattr(self, 'handle', None):
+            self.lib.route_destroy(self.handle)
+            self.handle = None
+
+    def set_weight(self, src, dst, weight):
+        with self.lock:
+            self.lib.route_set_weight(self.handle, src, dst, -1. if weight is None else float(weight))
+
+    def set_weights(self, matrix):
+        '''
+            Replace every weight from an n x n list of lists and recompute all the paths.
+        '''
+        flat = (ctypes.c_double * (self.n * self.n))()
+        for i in range(self.n):
+            row = matrix[i]
+            for j in range(self.n):
+                flat[i * self.n + j] = -1. if row[j] is None else float(row[j])
+        with self.lock:
+            self.lib.route_set_weights(self.handle, flat)
+
+    def weight(self, src, dst):
+        with self.lock:
+            return self.lib.route_get_weight(self.handle, src, dst)
+
+    def distance(self, src, dst):
+        with self.lock:
+            return self.lib.route_distance(self.handle, src, dst)
+
+    def path(self, src, dst):
+        '''
+            The relays of the lowest delay path from src to dst, both included, or [] if dst is unreachable.
+        '''
+        with self.lock:
+            n = self.lib.route_path(self.handle, src, dst, self.path_buffer, self.n)
+            return list(self.path_buffer[:n]) if n > 0 else []
+
+    def recomputed(self):
+        with self.lock:
+            return self.lib.route_recomputed(self.handle)
+
+class PathSelector(object):
+    '''
+        Hysteresis over the lowest delay paths. A pair leaves its path for the new lowest delay one only if that is
+        lower by more than switch_ms, by more than switch_ratio of the delay of its path, and by more than
+        confidence times the spread of the two delays, and only after dwell_s on its path. A pair whose path lost
+        an edge moves at once. cost(path) is the delay of a path in ms, None if one of its edges is gone;
+        spread(path) is how far its delay may be off, in ms. The counters tell the changes applied (a better
+        path), forced (the path broke) and suppressed, by the test that held them back.
+    '''
+    def __init__(self, cost, spread=None, switch_ms=0., switch_ratio=0., confidence=0., dwell_s=0.):
+        self.cost = cost
+        self.spread = spread
+        self.switch_ms = switch_ms
+        self.switch_ratio = switch_ratio
+        self.confidence = confidence
+        self.dwell_s = dwell_s
+        self.current = {}           # key: pair, value: (path, time it moved there)
+        self.applied = 0
+        self.forced = 0
+        self.suppressed = {'gain': 0, 'confidence': 0, 'dwell': 0}
+
+    def move(self, pair, path, now):
+        self.current[pair] = (path, now)
+
+    def forget(self, pair):
+        self.current.pop(pair, None)
+
+    def path(self, pair):
+        return self.current[pair][0] if pair in self.current else None
+
+    def select(self, pair, candidate, now):
+        '''
+            The path pair goes on now that candidate is the lowest delay one; None drops the pair.
+        '''
+        if not candidate:
+            self.forget(pair)
+            return None
+        if pair not in self.current:
+            self.move(pair, candidate, now)
+            return candidate
+        path, since = self.current[pair]
+        if path == candidate:
+            return path
+
+        old, new = self.cost(path), self.cost(candidate)
+        if old is None:
+            self.forced += 1
+            self.move(pair, candidate, now)
+            return candidate
+        if new is None:
+            return path
+        gain = old - new
+        if gain <= max(self.switch_ms, self.switch_ratio * old, 0.):
+            self.suppressed['gain'] += 1
+            return path
+        if self.spread is not None and self.confidence > 0 and \
+           gain <= self.confidence * math.hypot(self.spread(path), self.spread(candidate)):
+            self.suppressed['confidence'] += 1
+            return path
+        if now - since < self.dwell_s:
+            self.suppressed['dwell'] += 1
+            return path
+        self.applied += 1
+        self.move(pair, candidate, now)
+        return candidate
+
+    def counts(self):
+        return {'applied': self.applied, 'forced': self.forced, 'suppressed': sum(self.suppressed.values()),
+                'suppressed_gain': self.suppressed['gain'], 'suppressed_confidence': self.suppressed['confidence'],
+                'suppressed_dwell': self.suppressed['dwell']}
@@ -0,0 +1,108 @@
+#!/usr/bin/python
+
+###############################################################################################################
+## [Title]: cxp_shm.py -- python binding of the shared memory delay matrix
+## [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+##-------------------------------------------------------------------------------------------------------------
+## [Details]:
+## ctypes wrapper of native/libcxpshm.so (build it with `make -C native`), see native/shm.h for the layout. The
+## controller writes the row of every relay that reports to it; other processes map the same matrix read only
+## and get a consistent copy of a row without a lock, a file or a syscall. Set CXP_SHM_LIB to load the library
+## from somewhere else.
+##-------------------------------------------------------------------------------------------------------------
+## [Warning]:
+## This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+## secured. Feel free to change or improve it any way you see fit.
+##-------------------------------------------------------------------------------------------------------------
+## [Modification, Distribution, and Attribution]:
+## You are free to modify and/or distribute this script as you wish.  I only ask that you maintain original
+## author attribution.
+###############################################################################################################
+
+import os
+import ctypes
+
+DEFAULT_NAME = '/cxp-delays'
+FIELDS = ('median', 'p90', 'min', 'jitter', 'loss', 'reorder', 'samples', 'updated')
+
+class Edge(ctypes.Structure):
+    _fields_ = [('median', ctypes.c_float), ('p90', ctypes.c_float), ('min', ctypes.c_float),
+                ('jitter', ctypes.c_float), ('loss', ctypes.c_float), ('reorder', ctypes.c_float),
+                ('samples', ctypes.c_uint32), ('updated', ctypes.c_uint32)]
+
+_lib = None
+
+def load_library(path=None):
+    '''
+        Load libcxpshm.so once. Returns None when it is not built.
+    '''
+    global _lib
+    if _lib is not None:
+        return _lib
+
+    if path is None:
+        path = os.environ.get('CXP_SHM_LIB',
+                              os.path.join(os.path.dirname(os.path.abspath(__file__)), 'native', 'libcxpshm.so'))
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    lib.shm_matrix_open.restype = ctypes.c_void_p
+    lib.shm_matrix_open.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int]
+    lib.shm_matrix_close.argtypes = [ctypes.c_void_p]
+    lib.shm_matrix_size.argtypes = [ctypes.c_void_p]
+    lib.shm_matrix_unlink.argtypes = [ctypes.c_char_p]
+    lib.shm_update_row.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(ctypes.c_int32),
+                                   ctypes.POINTER(Edge), ctypes.c_int]
+    lib.shm_read_row.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(Edge)]
+    _lib = lib
+    return _lib
+
+def available():
+    return load_library() is not None
+
+class SharedMatrix(object):
+    '''
+        The n x n delay matrix called name. A writer creates it (or lays it out again for another n); a reader
+        maps what is there and can pass n=0.
+    '''
+    def __init__(self, n=0, name=DEFAULT_NAME, writable=False):
+        self.lib = load_library()
+        if self.lib is None:
+            raise OSError("libcxpshm.so is not built, run make -C native")
+        self.handle = self.lib.shm_matrix_open(name.encode(), n, 1 if writable else 0)
+        if not self.handle:
+            raise OSError("cannot map the delay matrix %s" % name)
+        self.n = self.lib.shm_matrix_size(self.handle)
+        self.row_buffer = (Edge * self.n)()
+
+    def __del__(self):
+        self.close()
+
+    def close(self):
+        if getattr(self, 'handle', None):
+            self.lib.shm_matrix_close(self.handle)
+            self.handle = None
+
+    def update_row(self, row, edges):
+        '''
+            Publish the edges of row at once. edges is a dict of column -> dict with any of FIELDS, the rest of
+            the row keeps its values.
+        '''
+        cols = (ctypes.c_int32 * len(edges))()
+        values = (Edge * len(edges))()
+        for i, (col, edge) in enumerate(edges.items()):
+            cols[i] = col
+            for field in FIELDS:
+                setattr(values[i], field, edge.get(field, 0))
+        return self.lib.shm_update_row(self.handle, row, cols, values, len(edges)) == 0
+
+    def read_row(self, row):
+        '''
+            A consistent copy of row: a list of n dicts, None for the edges that were never measured.
+        '''
+        if self.lib.shm_read_row(self.handle, row, self.row_buffer) < 0:
+            return None
+        return [dict((field, getattr(e, field)) for field in FIELDS) if e.samples > 0 else None
+                for e in self.row_buffer]
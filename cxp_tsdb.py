@@ -0,0 +1,175 @@
+#!/usr/bin/python
+
+###############################################################################################################
+## [Title]: cxp_tsdb.py -- python binding of the delay history store
+## [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+##-------------------------------------------------------------------------------------------------------------
+## [Details]:
+## ctypes wrapper of native/libcxptsdb.so (build it with `make -C native`), see native/tsdb.h for the layout.
+## Store appends (time, src, dst, rtt, fwd, rev, loss) records to a directory of memory mapped segments;
+## scan, visit, edges and downsample read any store, also one that is being written. Times are unix seconds
+## and the delays ms. Set CXP_TSDB_LIB to load the library from somewhere else.
+##-------------------------------------------------------------------------------------------------------------
+## [Warning]:
+## This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+## secured. Feel free to change or improve it any way you see fit.
+##-------------------------------------------------------------------------------------------------------------
+## [Modification, Distribution, and Attribution]:
+## You are free to modify and/or distribute this script as you wish.  I only ask that you maintain original
+## author attribution.
+###############################################################################################################
+
+import os
+import time
+import ctypes
+
+ANY = -1
+METRICS = ('rtt', 'fwd', 'rev', 'loss')
+
+class Record(ctypes.Structure):
+    _fields_ = [('time', ctypes.c_int64), ('src', ctypes.c_uint16), ('dst', ctypes.c_uint16),
+                ('rtt', ctypes.c_float), ('fwd', ctypes.c_float), ('rev', ctypes.c_float), ('loss', ctypes.c_float)]
+
+class Bucket(ctypes.Structure):
+    _fields_ = [('start', ctypes.c_int64), ('count', ctypes.c_uint32), ('lost', ctypes.c_uint32),
+                ('min', ctypes.c_float), ('mean', ctypes.c_float), ('max', ctypes.c_float), ('loss', ctypes.c_float)]
+
+VISIT = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.POINTER(Record), ctypes.c_void_p)
+
+_lib = None
+
+def load_library(path=None):
+    '''
+        Load libcxptsdb.so once. Returns None when it is not built.
+    '''
+    global _lib
+    if _lib is not None:
+        return _lib
+
+    if path is None:
+        path = os.environ.get('CXP_TSDB_LIB',
+                              os.path.join(os.path.dirname(os.path.abspath(__file__)), 'native', 'libcxptsdb.so'))
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    lib.tsdb_open.restype = ctypes.c_void_p
+    lib.tsdb_open.argtypes = [ctypes.c_char_p]
+    lib.tsdb_close.argtypes = [ctypes.c_void_p]
+    lib.tsdb_rotation.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int64]
+    lib.tsdb_append.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_int, ctypes.c_int, ctypes.c_float,
+                                ctypes.c_float, ctypes.c_float, ctypes.c_float]
+    lib.tsdb_scan.restype = ctypes.c_int64
+    lib.tsdb_scan.argtypes = [ctypes.c_char_p, ctypes.c_int64, ctypes.c_int64, ctypes.c_int, ctypes.c_int, VISIT,
+                              ctypes.c_void_p]
+    lib.tsdb_downsample.argtypes = [ctypes.c_char_p, ctypes.c_int64, ctypes.c_int64, ctypes.POINTER(ctypes.c_uint32),
+                                    ctypes.c_int, ctypes.c_int, ctypes.c_int64, ctypes.POINTER(Bucket), ctypes.c_int]
+    lib.tsdb_edges.argtypes = [ctypes.c_char_p, ctypes.c_int64, ctypes.c_int64, ctypes.POINTER(ctypes.c_uint32),
+                               ctypes.c_int]
+    lib.tsdb_prune.argtypes = [ctypes.c_char_p, ctypes.c_int64]
+    _lib = lib
+    return _lib
+
+def available():
+    return load_library() is not None
+
+def _ns(t):
+    return int(t * 1e9)
+
+def _nan(value):
+    return float('nan') if value is None else float(value)
+
+class Store(object):
+    '''
+        Appends to the store in directory path (created if needed). One writer per directory.
+    '''
+    def __init__(self, path):
+        self.lib = load_library()
+        if self.lib is None:
+            raise OSError("libcxptsdb.so is not built, run make -C native")
+        self.path = path
+        self.handle = self.lib.tsdb_open(path.encode())
+        if not self.handle:
+            raise OSError("cannot open the delay history %s" % path)
+
+    def __del__(self):
+        self.close()
+
+    def close(self):
+        if getattr(self, 'handle', None):
+            self.lib.tsdb_close(self.handle)
+            self.handle = None
+
+    def append(self, src, dst, rtt=None, fwd=None, rev=None, loss=0., when=None):
+        '''
+            Missing delays are stored as NaN.
+        '''
+        return self.lib.tsdb_append(self.handle, _ns(time.time() if when is None else when), src, dst,
+                                    _nan(rtt), _nan(fwd), _nan(rev), _nan(loss)) == 0
+
+def scan(path, start=0, end=None, src=ANY, dst=ANY):
+    '''
+        The records of src -> dst (ANY for all) with start <= time < end as (time, src, dst, rtt, fwd, rev, loss)
+        tuples, in the order they were appended.
+    '''
+    lib = load_library()
+    records = []
+    def visit(r, arg):
+        r = r.contents
+        records.append((r.time / 1e9, r.src, r.dst, r.rtt, r.fwd, r.rev, r.loss))
+        return 0
+    lib.tsdb_scan(path.encode(), _ns(start), _ns(time.time() + 1 if end is None else end), src, dst, VISIT(visit), None)
+    return records
+
+def visit(path, callback, start=0, end=None, src=ANY, dst=ANY):
+    '''
+        Same records as scan, handed to callback(time, src, dst, rtt, fwd, rev, loss) one at a time instead of
+        collected, for histories too long to hold in a list. A true return value of callback stops the scan.
+    '''
+    lib = load_library()
+    def one(r, arg):
+        r = r.contents
+        return 1 if callback(r.time / 1e9, r.src, r.dst, r.rtt, r.fwd, r.rev, r.loss) else 0
+    return lib.tsdb_scan(path.encode(), _ns(start), _ns(time.time() + 1 if end is None else end), src, dst,
+                         VISIT(one), None)
+
+def edges(path, start=0, end=None, max_edges=65536):
+    '''
+        The (src, dst) edges with records between start and end.
+    '''
+    lib = load_library()
+    out = (ctypes.c_uint32 * max_edges)()
+    n = lib.tsdb_edges(path.encode(), _ns(start), _ns(time.time() + 1 if end is None else end), out, max_edges)
+    return [(e >> 16, e & 0xffff) for e in out[:max(0, min(n, max_edges))]]
+
+def downsample(path, start, end, step, metric='fwd', edge_list=None, max_buckets=100000):
+    '''
+        Buckets of step seconds of every edge (all of them by default), in a single scan: a dict of
+        (src, dst) -> list of (start, count, lost, min, mean, max, loss) for the buckets that have records.
+    '''
+    lib = load_library()
+    if edge_list is None:
+        edge_list = edges(path, start, end)
+    edge_list = sorted(edge_list)
+    if not edge_list:
+        return {}
+    per_edge = max(1, min(int((end - start) / step) + 1, max_buckets // len(edge_list)))
+    keys = (ctypes.c_uint32 * len(edge_list))(*[s << 16 | d for s, d in edge_list])
+    buckets = (Bucket * (per_edge * len(edge_list)))()
+    n = lib.tsdb_downsample(path.encode(), _ns(start), _ns(end), keys, len(edge_list), METRICS.index(metric),
+                            _ns(step), buckets, per_edge)
+    result = {}
+    for e, edge in enumerate(edge_list):
+        rows = []
+        for b in buckets[e * max(n, 0):(e + 1) * max(n, 0)]:
+            if b.count or b.lost:
+                rows.append((b.start / 1e9, b.count, b.lost, b.min, b.mean, b.max, b.loss))
+        result[edge] = rows
+    return result
+
+def prune(path, before):
+    '''
+        Remove the segments with only records older than before. Returns how many.
+    '''
+    return load_library().tsdb_prune(path.encode(), _ns(before))
@@ -0,0 +1,147 @@
+#!/usr/bin/python
+
+###############################################################################################################
+## [Title]: bench_route.py -- native routing engine against the networkx path of CXP.py
+## [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+##-------------------------------------------------------------------------------------------------------------
+## [Details]:
+## For every mesh size it builds a full mesh with random one way delays and times:
+##  - networkx: what one IP packet-in costs in CXP.py, i.e. rebuilding the DiGraph from the delays
+##    (calculate_best_paths) plus all_shortest_paths in both directions;
+##  - the engine: the first full computation, single edge updates (half lower, half higher) and the two path
+##    lookups of a packet-in.
+## After the updates the engine is checked against a plain Dijkstra (networkx when it is installed). Runs with
+## python 2 or 3 from anywhere once native/libcxproute.so is built:
+##
+##     make -C native && python native/bench_route.py [-s 10,100,500,1000,2000] [-u updates] [-q lookups]
+##-------------------------------------------------------------------------------------------------------------
+## [Warning]:
+## This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+## secured. Feel free to change or improve it any way you see fit.
+##-------------------------------------------------------------------------------------------------------------
+## [Modification, Distribution, and Attribution]:
+## You are free to modify and/or distribute this script as you wish.  I only ask that you maintain original
+## author attribution.
+###############################################################################################################
+
+from __future__ import print_function
+
+import os
+import sys
+import time
+import heapq
+import random
+import optparse
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+import cxp_route
+
+try:
+    import networkx as nx
+except ImportError:
+    nx = None
+
+def random_mesh(n, rnd):
+    return [[None if i == j else rnd.uniform(1., 100.) for j in range(n)] for i in range(n)]
+
+def dijkstra(matrix, src):
+    n = len(matrix)
+    dist = [float('inf')] * n
+    dist[src] = 0.
+    heap = [(0., src)]
+    while heap:
+        d, u = heapq.heappop(heap)
+        if d > dist[u]:
+            continue
+        row = matrix[u]
+        for v in range(n):
+            if row[v] is not None and d + row[v] < dist[v]:
+                dist[v] = d + row[v]
+                heapq.heappush(heap, (dist[v], v))
+    return dist
+
+def bench_networkx(matrix, queries):
+    n = len(matrix)
+    start = time.time()
+    for src, dst in queries:
+        G = nx.DiGraph()
+        G.add_nodes_from(range(n))
+        for i in range(n):
+            for j in range(n):
+                if matrix[i][j] is not None:
+                    G.add_edge(i, j, weight=matrix[i][j])
+        list(nx.all_shortest_paths(G, src, dst, weight='weight'))
+        list(nx.all_shortest_paths(G, dst, src, weight='weight'))
+    return (time.time() - start) / len(queries), G
+
+def check(engine, matrix, G, sources):
+    worst = 0.
+    for src in sources:
+        if G is not None:
+            dist = nx.single_source_dijkstra_path_length(G, src)
+            dist = [dist.get(v, float('inf')) for v in range(len(matrix))]
+        else:
+            dist = dijkstra(matrix, src)
+        for dst in range(len(matrix)):
+            path = engine.path(src, dst)
+            length = sum(matrix[path[k]][path[k + 1]] for k in range(len(path) - 1))
+            worst = max(worst, abs(length - dist[dst]), abs(engine.distance(src, dst) - dist[dst]))
+    return worst
+
+def main():
+    parser = optparse.OptionParser()
+    parser.add_option('-s', '--sizes', default='10,100,500,1000,2000')
+    parser.add_option('-u', '--updates', type='int', default=200)
+    parser.add_option('-q', '--queries', type='int', default=1000)
+    parser.add_option('-n', '--nx-queries', type='int', default=3, help='packet-ins timed with networkx')
+    parser.add_option('--nx-max', type='int', default=2000, help='largest mesh to time with networkx')
+    opts, args = parser.parse_args()
+
+    if not cxp_route.available():
+        print("native/libcxproute.so is not built, run make -C native")
+        return 1
+    if nx is None:
+        print("networkx is not installed: only the engine is timed, and checked against a plain Dijkstra")
+
+    rnd = random.Random(1)
+    print("%6s %12s %12s %12s %12s %10s %14s %8s" % ("nodes", "nx pktin ms", "build ms", "update us",
+                                                     "pktin us", "dijkstras", "speedup pktin", "error"))
+    for n in [int(s) for s in opts.sizes.split(',')]:
+        matrix = random_mesh(n, rnd)
+        engine = cxp_route.RouteEngine(n)
+
+        start = time.time()
+        engine.set_weights(matrix)
+        build = time.time() - start
+
+        before = engine.recomputed()
+        start = time.time()
+        for k in range(opts.updates):
+            src, dst = rnd.sample(range(n), 2)
+            factor = 0.5 if k % 2 == 0 else 2.
+            matrix[src][dst] = min(max(matrix[src][dst] * factor * rnd.uniform(0.8, 1.2), 0.1), 1000.)
+            engine.set_weight(src, dst, matrix[src][dst])
+        update = (time.time() - start) / max(opts.updates, 1)
+        dijkstras = engine.recomputed() - before
+
+        queries = [tuple(rnd.sample(range(n), 2)) for k in range(opts.queries)]
+        start = time.time()
+        for src, dst in queries:
+            engine.path(src, dst)
+            engine.path(dst, src)
+        lookup = (time.time() - start) / len(queries)
+
+        G = None
+        nx_time = None
+        if nx is not None and n <= opts.nx_max:
+            nx_time, G = bench_networkx(matrix, queries[:opts.nx_queries])
+
+        error = check(engine, matrix, G, rnd.sample(range(n), min(n, 3)))
+        print("%6d %12s %12.1f %12.1f %12.1f %10.2f %14s %8.1e" % (
+            n, "%.1f" % (nx_time * 1e3) if nx_time else "-", build * 1e3, update * 1e6, lookup * 1e6,
+            float(dijkstras) / max(opts.updates, 1), "%.0fx" % (nx_time / lookup) if nx_time else "-", error))
+        sys.stdout.flush()
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
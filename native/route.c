@@ -0,0 +1,304 @@
+/**
+ * [Title]: route.c -- all-pairs lowest delay paths of the relay mesh for the CXP controller
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * See route.h. Distances and weights are floats, which is plenty for delays in ms and halves the memory the
+ * O(n^2) loops stream through. A missing edge or an unreachable pair is INFINITY and has predecessor -1.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "route.h"
+
+#define ROUTE_TILE          128
+
+struct route_engine {
+    int n;
+    float *weight;              /* weight[src * n + dst] */
+    float *dist;                /* dist[src * n + dst] */
+    int32_t *pred;              /* pred[src * n + dst], the node before dst on the path from src */
+    uint8_t *done;              /* Dijkstra scratch */
+    uint64_t recomputed;
+};
+
+static void *alloc_array(size_t count, size_t size)
+{
+    size_t bytes = count * size;
+    void *p;
+
+    if ( posix_memalign( &p, 64, bytes != 0 ? bytes : 64 ) != 0 )
+        return NULL;
+    return p;
+}
+
+/* dense Dijkstra from src: the mesh is (nearly) complete, so scanning for the minimum beats a heap */
+static void route_from(route_engine *r, int src)
+{
+    int n = r->n, i, k, u;
+    float *d = r->dist + (size_t) src * n, *w, best, nd;
+    int32_t *pred = r->pred + (size_t) src * n;
+    uint8_t *done = r->done;
+
+    for ( i = 0; i < n; i++ ) {
+        d[i] = INFINITY;
+        pred[i] = -1;
+        done[i] = 0;
+    }
+    d[src] = 0;
+    pred[src] = src;
+
+    for ( k = 0; k < n; k++ ) {
+        u = -1;
+        best = INFINITY;
+        for ( i = 0; i < n; i++ )
+            if ( !done[i] && d[i] < best ) {
+                best = d[i];
+                u = i;
+            }
+        if ( u < 0 )
+            break;
+        done[u] = 1;
+
+        w = r->weight + (size_t) u * n;
+        for ( i = 0; i < n; i++ ) {
+            nd = best + w[i];
+            if ( nd < d[i] && !done[i] ) {
+                d[i] = nd;
+                pred[i] = u;
+            }
+        }
+    }
+    r->recomputed++;
+}
+
+/* relax every pair of the (ib, jb) tile through every node of the kb tile */
+static void relax_tile(route_engine *r, int ib, int jb, int kb)
+{
+    int n = r->n, i, j, k;
+    int iend = ib + ROUTE_TILE < n ? ib + ROUTE_TILE : n;
+    int jend = jb + ROUTE_TILE < n ? jb + ROUTE_TILE : n;
+    int kend = kb + ROUTE_TILE < n ? kb + ROUTE_TILE : n;
+    int32_t better;
+    float dik, nd;
+    const float *restrict dk;
+    const int32_t *restrict pk;
+    float *restrict di;
+    int32_t *restrict pi;
+
+    for ( k = kb; k < kend; k++ ) {
+        dk = r->dist + (size_t) k * n;
+        pk = r->pred + (size_t) k * n;
+        for ( i = ib; i < iend; i++ ) {
+            di = r->dist + (size_t) i * n;
+            pi = r->pred + (size_t) i * n;
+            dik = di[k];
+            if ( i == k || dik == INFINITY )
+                continue;
+            /* branch free, so it vectorizes */
+            for ( j = jb; j < jend; j++ ) {
+                nd = dik + dk[j];
+                better = -(int32_t) (nd < di[j]);
+                pi[j] = (pk[j] & better) | (pi[j] & ~better);
+                di[j] = nd < di[j] ? nd : di[j];
+            }
+        }
+    }
+}
+
+/*
+ * Blocked Floyd-Warshall over the whole matrix: the same O(n^3) as n Dijkstras, but the inner loop vectorizes
+ * and the three tiles it touches stay in the cache. For every diagonal tile kb the tile itself goes first,
+ * then its row and column, then the rest.
+ */
+static void route_all(route_engine *r)
+{
+    int n = r->n, i, j, kb, ib, jb;
+
+    for ( i = 0; i < n; i++ )
+        for ( j = 0; j < n; j++ ) {
+            r->dist[(size_t) i * n + j] = r->weight[(size_t) i * n + j];
+            r->pred[(size_t) i * n + j] = r->weight[(size_t) i * n + j] < INFINITY ? i : -1;
+        }
+
+    for ( kb = 0; kb < n; kb += ROUTE_TILE ) {
+        relax_tile(r, kb, kb, kb);
+        for ( jb = 0; jb < n; jb += ROUTE_TILE )
+            if ( jb != kb ) {
+                relax_tile(r, kb, jb, kb);
+                relax_tile(r, jb, kb, kb);
+            }
+        for ( ib = 0; ib < n; ib += ROUTE_TILE )
+            for ( jb = 0; jb < n; jb += ROUTE_TILE )
+                if ( ib != kb && jb != kb )
+                    relax_tile(r, ib, jb, kb);
+    }
+    r->recomputed += n;
+}
+
+route_engine *route_create(int n)
+{
+    route_engine *r;
+    size_t cells = (size_t) n * n;
+    int i;
+
+    if ( n <= 0 || ( r = (route_engine *) calloc(1, sizeof(route_engine)) ) == NULL )
+        return NULL;
+
+    r->n = n;
+    r->weight = (float *) alloc_array(cells, sizeof(float));
+    r->dist = (float *) alloc_array(cells, sizeof(float));
+    r->pred = (int32_t *) alloc_array(cells, sizeof(int32_t));
+    r->done = (uint8_t *) alloc_array(n, 1);
+    if ( !r->weight || !r->dist || !r->pred || !r->done ) {
+        route_destroy(r);
+        return NULL;
+    }
+
+    for ( i = 0; i < (int) cells; i++ ) {
+        r->weight[i] = INFINITY;
+        r->dist[i] = INFINITY;
+        r->pred[i] = -1;
+    }
+    for ( i = 0; i < n; i++ ) {
+        r->weight[(size_t) i * n + i] = 0;
+        r->dist[(size_t) i * n + i] = 0;
+        r->pred[(size_t) i * n + i] = i;
+    }
+    return r;
+}
+
+void route_destroy(route_engine *r)
+{
+    if ( !r )
+        return;
+    free(r->weight);
+    free(r->dist);
+    free(r->pred);
+    free(r->done);
+    free(r);
+}
+
+int route_size(const route_engine *r)
+{
+    return r->n;
+}
+
+static float clean_weight(double weight)
+{
+    if ( !( weight >= 0 ) || isinf(weight) )
+        return INFINITY;
+    return (float) weight;
+}
+
+/* every pair (i, j) whose path can now go i -> ... -> src -> dst -> ... -> j */
+static void route_decrease(route_engine *r, int src, int dst, float w)
+{
+    int n = r->n, i, j;
+    const float *from_dst = r->dist + (size_t) dst * n;
+    const int32_t *pred_dst = r->pred + (size_t) dst * n;
+    float *d, via;
+    int32_t *pred;
+
+    for ( i = 0; i < n; i++ ) {
+        d = r->dist + (size_t) i * n;
+        pred = r->pred + (size_t) i * n;
+        via = d[src] + w;
+        if ( !( via < d[dst] ) )
+            continue;           /* if it does not improve dst it improves nothing behind it */
+        for ( j = 0; j < n; j++ )
+            if ( via + from_dst[j] < d[j] ) {
+                d[j] = via + from_dst[j];
+                pred[j] = j == dst ? src : pred_dst[j];
+            }
+    }
+}
+
+int route_set_weight(route_engine *r, int src, int dst, double weight)
+{
+    int n = r->n, i;
+    float w = clean_weight(weight), old;
+
+    if ( src < 0 || dst < 0 || src >= n || dst >= n || src == dst )
+        return -1;
+
+    old = r->weight[(size_t) src * n + dst];
+    if ( w == old )
+        return 0;
+    r->weight[(size_t) src * n + dst] = w;
+
+    if ( w < old ) {
+        route_decrease(r, src, dst, w);
+        return 0;
+    }
+
+    /* only the shortest path trees that hang dst off src can get longer */
+    for ( i = 0; i < n; i++ )
+        if ( r->pred[(size_t) i * n + dst] == src )
+            route_from(r, i);
+    return 0;
+}
+
+int route_set_weights(route_engine *r, const double *weights)
+{
+    int n = r->n, i, j;
+
+    for ( i = 0; i < n; i++ )
+        for ( j = 0; j < n; j++ )
+            r->weight[(size_t) i * n + j] = i == j ? 0 : clean_weight(weights[(size_t) i * n + j]);
+    route_all(r);
+    return 0;
+}
+
+double route_get_weight(const route_engine *r, int src, int dst)
+{
+    if ( src < 0 || dst < 0 || src >= r->n || dst >= r->n )
+        return INFINITY;
+    return r->weight[(size_t) src * r->n + dst];
+}
+
+double route_distance(const route_engine *r, int src, int dst)
+{
+    if ( src < 0 || dst < 0 || src >= r->n || dst >= r->n )
+        return INFINITY;
+    return r->dist[(size_t) src * r->n + dst];
+}
+
+/*
+ * Write the nodes of the path from src to dst (both included) to path. Returns the number of nodes, 0 if dst
+ * is unreachable, or minus the number of nodes if path is shorter than that.
+ */
+int route_path(const route_engine *r, int src, int dst, int32_t *path, int max)
+{
+    const int32_t *pred;
+    int len, i, v;
+
+    if ( src < 0 || dst < 0 || src >= r->n || dst >= r->n )
+        return 0;
+    pred = r->pred + (size_t) src * r->n;
+    if ( pred[dst] < 0 )
+        return 0;
+
+    for ( len = 1, v = dst; v != src; v = pred[v] )
+        len++;
+    if ( len > max )
+        return -len;
+
+    for ( i = len - 1, v = dst; i >= 0; i--, v = pred[v] )
+        path[i] = v;
+    return len;
+}
+
+uint64_t route_recomputed(const route_engine *r)
+{
+    return r->recomputed;
+}
@@ -0,0 +1,48 @@
+/**
+ * [Title]: route.h -- all-pairs lowest delay paths of the relay mesh for the CXP controller
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * The engine keeps three flat row-major n x n arrays: the edge weights (one way delays in ms), the shortest
+ * distances and the predecessor of every node on the shortest path from every source. A path lookup walks the
+ * predecessors, so it costs O(path length). Changing one edge is incremental:
+ *
+ *  - a lower weight relaxes every pair through the edge in O(n^2);
+ *  - a higher weight (or a removed edge) re-runs the O(n^2) dense Dijkstra only for the sources whose shortest
+ *    path tree uses the edge.
+ *
+ * route_set_weights replaces the whole matrix and recomputes everything in O(n^3). The engine is not thread
+ * safe; cxp_route.py serializes the calls.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_ROUTE_H
+#define CXP_ROUTE_H
+
+#include <stdint.h>
+
+typedef struct route_engine route_engine;
+
+route_engine *route_create(int n);
+void route_destroy(route_engine *r);
+int route_size(const route_engine *r);
+
+/* weight in ms; a negative, NaN or infinite weight removes the edge */
+int route_set_weight(route_engine *r, int src, int dst, double weight);
+int route_set_weights(route_engine *r, const double *weights);
+double route_get_weight(const route_engine *r, int src, int dst);
+
+double route_distance(const route_engine *r, int src, int dst);
+int route_path(const route_engine *r, int src, int dst, int32_t *path, int max);
+
+/* Dijkstra runs since route_create, to see what the incremental updates cost */
+uint64_t route_recomputed(const route_engine *r);
+
+#endif
@@ -0,0 +1,224 @@
+/**
+ * [Title]: shm.c -- shared memory delay matrix
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * See shm.h. A writer that opens an object of the right size keeps its contents, so the matrix survives a
+ * restart of the controller; one of a different size is cleared and laid out again.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+#define SHM_ALIGN(x)        ( ( (x) + 63 ) & ~(size_t) 63 )
+
+static size_t copy_size(int n)
+{
+    return SHM_ALIGN( (size_t) n * sizeof(shm_edge) );
+}
+
+static size_t row_size(int n)
+{
+    return 64 + 2 * copy_size(n);
+}
+
+static size_t matrix_size(int n)
+{
+    return sizeof(shm_header) + (size_t) n * row_size(n);
+}
+
+static uint32_t *row_seq(const shm_matrix *m, int row)
+{
+    return (uint32_t *) ( m->rows + (size_t) row * m->header->row_size );
+}
+
+static shm_edge *row_copy(const shm_matrix *m, int row, int copy)
+{
+    return (shm_edge *) ( m->rows + (size_t) row * m->header->row_size + 64 + copy * copy_size(m->n) );
+}
+
+static int header_ok(const shm_header *h, size_t size)
+{
+    return h->magic == SHM_MAGIC && h->version == SHM_VERSION && h->edge_size == sizeof(shm_edge) &&
+           h->row_size == row_size(h->n) && matrix_size(h->n) <= size;
+}
+
+/*
+ * Map the matrix called name. A writer creates it with n rows (or lays it out again if it has another size);
+ * a reader maps whatever is there read only and may pass 0 for n.
+ */
+shm_matrix *shm_matrix_open(const char *name, int n, int writable)
+{
+    shm_matrix *m;
+    struct stat st;
+    size_t size;
+    void *base;
+    int fd, fresh = 0;
+
+    if ( ( fd = shm_open( name, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644 ) ) < 0 ) {
+        perror("shm_matrix_open shm_open");
+        return NULL;
+    }
+    if ( fstat( fd, &st ) < 0 ) {
+        perror("shm_matrix_open fstat");
+        close(fd);
+        return NULL;
+    }
+
+    size = st.st_size;
+    if ( writable ) {
+        if ( n <= 0 ) {
+            close(fd);
+            return NULL;
+        }
+        if ( size != matrix_size(n) ) {
+            size = matrix_size(n);
+            if ( ftruncate( fd, 0 ) < 0 || ftruncate( fd, size ) < 0 ) {
+                perror("shm_matrix_open ftruncate");
+                close(fd);
+                return NULL;
+            }
+            fresh = 1;
+        }
+    } else if ( size < sizeof(shm_header) ) {
+        fprintf(stderr, "shm_matrix_open: %s is not a delay matrix\n", name);
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap( NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+    close(fd);
+    if ( base == MAP_FAILED ) {
+        perror("shm_matrix_open mmap");
+        return NULL;
+    }
+
+    m = (shm_matrix *) calloc(1, sizeof(shm_matrix));
+    m->header = (shm_header *) base;
+    m->rows = (uint8_t *) base + sizeof(shm_header);
+    m->size = size;
+    m->writable = writable;
+
+    if ( writable && ( fresh || !header_ok(m->header, size) || (int) m->header->n != n ) ) {
+        memset(base, 0, size);
+        m->header->version = SHM_VERSION;
+        m->header->n = n;
+        m->header->row_size = row_size(n);
+        m->header->edge_size = sizeof(shm_edge);
+        /* readers check the magic first, so it goes last */
+        __atomic_store_n(&m->header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    if ( __atomic_load_n(&m->header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC || !header_ok(m->header, size) ||
+         ( n > 0 && (int) m->header->n != n ) ) {
+        fprintf(stderr, "shm_matrix_open: %s is not a delay matrix of %d relays\n", name, n);
+        shm_matrix_close(m);
+        return NULL;
+    }
+    m->n = m->header->n;
+    return m;
+}
+
+void shm_matrix_close(shm_matrix *m)
+{
+    if ( !m )
+        return;
+    munmap(m->header, m->size);
+    free(m);
+}
+
+int shm_matrix_size(const shm_matrix *m)
+{
+    return m->n;
+}
+
+int shm_matrix_unlink(const char *name)
+{
+    return shm_unlink(name);
+}
+
+/* Start rewriting a row: returns the copy readers are not using, filled with the current edges. */
+shm_edge *shm_row_write_begin(shm_matrix *m, int row)
+{
+    uint32_t *seq, s;
+    int current;
+
+    if ( !m->writable || row < 0 || row >= m->n )
+        return NULL;
+
+    seq = row_seq(m, row);
+    s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    current = (s >> 1) & 1;
+    __atomic_store_n(seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(row_copy(m, row, !current), row_copy(m, row, current), m->n * sizeof(shm_edge));
+    return row_copy(m, row, !current);
+}
+
+void shm_row_write_end(shm_matrix *m, int row)
+{
+    uint32_t *seq = row_seq(m, row);
+
+    __atomic_store_n(seq, __atomic_load_n(seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&m->header->generation, 1, __ATOMIC_RELAXED);
+}
+
+int shm_update_row(shm_matrix *m, int row, const int32_t *cols, const shm_edge *edges, int count)
+{
+    shm_edge *copy;
+    int i;
+
+    if ( ( copy = shm_row_write_begin(m, row) ) == NULL )
+        return -1;
+    for ( i = 0; i < count; i++ )
+        if ( cols[i] >= 0 && cols[i] < m->n )
+            copy[cols[i]] = edges[i];
+    shm_row_write_end(m, row);
+    return 0;
+}
+
+/* The current copy of a row, to read in place; the ticket goes to shm_row_read_valid afterwards. */
+const shm_edge *shm_row_read_begin(const shm_matrix *m, int row, uint32_t *ticket)
+{
+    if ( row < 0 || row >= m->n )
+        return NULL;
+    *ticket = __atomic_load_n(row_seq(m, row), __ATOMIC_ACQUIRE);
+    return row_copy(m, row, (*ticket >> 1) & 1);
+}
+
+/* 1 if what was read since shm_row_read_begin is a consistent row, 0 if it has to be read again */
+int shm_row_read_valid(const shm_matrix *m, int row, uint32_t ticket)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(row_seq(m, row), __ATOMIC_RELAXED) - (ticket & ~1u) <= 2;
+}
+
+/* Copy a consistent snapshot of a row to out (n edges), for the bindings that cannot read in place. */
+int shm_read_row(const shm_matrix *m, int row, shm_edge *out)
+{
+    const shm_edge *edges;
+    uint32_t ticket;
+
+    do {
+        if ( ( edges = shm_row_read_begin(m, row, &ticket) ) == NULL )
+            return -1;
+        memcpy(out, edges, m->n * sizeof(shm_edge));
+    } while ( !shm_row_read_valid(m, row, ticket) );
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * [Title]: shm.h -- shared memory delay matrix
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * An n x n matrix of per-edge statistics in a POSIX shared memory object (/dev/shm/<name>), written by one
+ * process and mapped by any number of readers. Every row has a sequence number and two copies of its edges:
+ *
+ *     header (64 bytes): magic "CXPM", version, n, row size, edge size, generation
+ *     row r: sequence (64 bytes) | copy 0: n edges | copy 1: n edges     (every part 64 byte aligned)
+ *
+ * A writer makes the sequence odd, writes the copy the readers are not using, and makes it even again, which
+ * publishes that copy: the current copy of a row is (sequence / 2) % 2. A reader takes the sequence, reads the
+ * current copy in place and checks that the sequence did not move on by two or more while it read (only then
+ * could the writer have reached its copy). Readers never wait for the writer, nor copy, nor make a syscall.
+ *
+ * There must be one writer per row at a time; the CXP controller writes the rows of the relays' reports and
+ * an agent writes the row of its own node.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_SHM_H
+#define CXP_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHM_MAGIC               0x4358504d      /* "CXPM" */
+#define SHM_VERSION             1
+#define SHM_DEFAULT_NAME        "/cxp-delays"
+
+typedef struct shm_edge {
+    float median;               /* ms, forward delay */
+    float p90;                  /* ms */
+    float min;                  /* ms */
+    float jitter;               /* ms */
+    float loss;                 /* 0..1 */
+    float reorder;              /* 0..1 */
+    uint32_t samples;           /* 0 if the edge was never measured */
+    uint32_t updated;           /* unix time of the last report */
+} shm_edge;
+
+typedef struct shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n;
+    uint32_t row_size;          /* bytes from one row to the next */
+    uint32_t edge_size;
+    uint32_t pad;
+    uint64_t generation;        /* rows published since creation */
+    uint8_t reserved[32];
+} shm_header;
+
+typedef struct shm_matrix {
+    shm_header *header;
+    uint8_t *rows;
+    size_t size;
+    int n;
+    int writable;
+} shm_matrix;
+
+shm_matrix *shm_matrix_open(const char *name, int n, int writable);
+void shm_matrix_close(shm_matrix *m);
+int shm_matrix_size(const shm_matrix *m);
+int shm_matrix_unlink(const char *name);
+
+shm_edge *shm_row_write_begin(shm_matrix *m, int row);
+void shm_row_write_end(shm_matrix *m, int row);
+int shm_update_row(shm_matrix *m, int row, const int32_t *cols, const shm_edge *edges, int count);
+
+const shm_edge *shm_row_read_begin(const shm_matrix *m, int row, uint32_t *ticket);
+int shm_row_read_valid(const shm_matrix *m, int row, uint32_t ticket);
+int shm_read_row(const shm_matrix *m, int row, shm_edge *out);
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * [Title]: shm_dump.c -- print the shared memory delay matrix
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Maps the delay matrix of shm.h read only and prints one field of every measured edge, row by row, like a
+ * dashboard would read it. With -i it prints the matrix again every interval ms once the generation moved.
+ *
+ * Usage: ./shm_dump [-n name] [-f median|p90|min|jitter|loss|reorder|samples|age] [-i interval_ms]
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+static const char *fields[] = { "median", "p90", "min", "jitter", "loss", "reorder", "samples", "age", NULL };
+
+static double edge_field(const shm_edge *e, int field, time_t now)
+{
+    switch (field) {
+    case 0: return e->median;
+    case 1: return e->p90;
+    case 2: return e->min;
+    case 3: return e->jitter;
+    case 4: return e->loss * 100;
+    case 5: return e->reorder * 100;
+    case 6: return e->samples;
+    default: return now - (time_t) e->updated;
+    }
+}
+
+static void dump(const shm_matrix *m, int field)
+{
+    int n = shm_matrix_size(m), i, j;
+    double *values = (double *) malloc(n * sizeof(double));
+    char *measured = (char *) malloc(n);
+    const shm_edge *row;
+    uint32_t ticket;
+    time_t now = time(NULL);
+
+    printf("generation %llu, %d relays, %s%s\n", (unsigned long long) m->header->generation, n, fields[field],
+           field <= 3 ? " (ms)" : field <= 5 ? " (%)" : field == 7 ? " (s)" : "");
+    for ( i = 0; i < n; i++ ) {
+        /* read the row in place and only keep it if no writer got to it meanwhile */
+        do {
+            row = shm_row_read_begin(m, i, &ticket);
+            for ( j = 0; j < n; j++ ) {
+                measured[j] = row[j].samples > 0;
+                values[j] = edge_field(&row[j], field, now);
+            }
+        } while ( !shm_row_read_valid(m, i, ticket) );
+
+        for ( j = 0; j < n; j++ )
+            if ( measured[j] )
+                break;
+        if ( j == n )
+            continue;
+        printf("%4d:", i);
+        for ( j = 0; j < n; j++ )
+            if ( measured[j] )
+                printf(" %d=%.3f", j, values[j]);
+            else if ( j != i )
+                printf(" %d=-", j);
+        printf("\n");
+    }
+    free(values);
+    free(measured);
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = SHM_DEFAULT_NAME;
+    shm_matrix *m;
+    uint64_t seen = 0;
+    int c, field = 0, interval = 0;
+
+    while ( ( c = getopt(argc, argv, "n:f:i:") ) != -1 ) {
+        switch (c) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'f':
+            for ( field = 0; fields[field] && strcmp(fields[field], optarg) != 0; field++ )
+                ;
+            if ( !fields[field] ) {
+                fprintf(stderr, "unknown field %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'i':
+            interval = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n name] [-f median|p90|min|jitter|loss|reorder|samples|age] [-i interval_ms]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ( ( m = shm_matrix_open(name, 0, 0) ) == NULL )
+        exit(EXIT_FAILURE);
+
+    do {
+        if ( !interval || __atomic_load_n(&m->header->generation, __ATOMIC_ACQUIRE) != seen ) {
+            seen = __atomic_load_n(&m->header->generation, __ATOMIC_ACQUIRE);
+            dump(m, field);
+            fflush(stdout);
+        }
+        if ( interval )
+            usleep(interval * 1000);
+    } while ( interval );
+
+    shm_matrix_close(m);
+    return 0;
+}
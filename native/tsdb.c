@@ -0,0 +1,512 @@
+/**
+ * [Title]: tsdb.c -- append-only store of the delay history
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * See tsdb.h. A writer that opens a directory carries on with its newest segment if it is not full; the files
+ * are created at their full size, which stays sparse until the records get there.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tsdb.h"
+
+#define TSDB_ALIGN(x)       ( ( (x) + 63 ) & ~(size_t) 63 )
+
+typedef struct tsdb_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t block;
+    uint32_t count;             /* published records */
+    uint32_t pad;
+    int64_t first;              /* earliest time of any record */
+    int64_t last;               /* latest time of any record */
+    uint8_t reserved[88];
+} tsdb_header;
+
+typedef struct tsdb_span {
+    int64_t min;
+    int64_t max;
+} tsdb_span;
+
+/* a mapped segment and its columns */
+typedef struct segment {
+    tsdb_header *header;
+    size_t size;
+    int64_t *time;
+    uint16_t *src;
+    uint16_t *dst;
+    float *metric[TSDB_METRICS];
+    tsdb_span *index;
+} segment;
+
+struct tsdb {
+    char *dir;
+    segment seg;                /* the segment we append to, header NULL before the first append */
+    uint32_t records;
+    int64_t span;
+};
+
+/* bytes of a segment of capacity records */
+static size_t segment_size(uint32_t capacity)
+{
+    return TSDB_ALIGN(sizeof(tsdb_header)) + TSDB_ALIGN( (size_t) capacity * sizeof(int64_t) ) +
+           2 * TSDB_ALIGN( (size_t) capacity * sizeof(uint16_t) ) +
+           TSDB_METRICS * TSDB_ALIGN( (size_t) capacity * sizeof(float) ) +
+           TSDB_ALIGN( (size_t) ( capacity + TSDB_BLOCK - 1 ) / TSDB_BLOCK * sizeof(tsdb_span) );
+}
+
+static void segment_layout(segment *s, uint8_t *base, uint32_t capacity)
+{
+    size_t off = TSDB_ALIGN(sizeof(tsdb_header));
+    int m;
+
+    s->header = (tsdb_header *) base;
+    s->time = (int64_t *) ( base + off );
+    off += TSDB_ALIGN( (size_t) capacity * sizeof(int64_t) );
+    s->src = (uint16_t *) ( base + off );
+    off += TSDB_ALIGN( (size_t) capacity * sizeof(uint16_t) );
+    s->dst = (uint16_t *) ( base + off );
+    off += TSDB_ALIGN( (size_t) capacity * sizeof(uint16_t) );
+    for ( m = 0; m < TSDB_METRICS; m++ ) {
+        s->metric[m] = (float *) ( base + off );
+        off += TSDB_ALIGN( (size_t) capacity * sizeof(float) );
+    }
+    s->index = (tsdb_span *) ( base + off );
+}
+
+static void segment_unmap(segment *s)
+{
+    if ( s->header )
+        munmap(s->header, s->size);
+    memset(s, 0, sizeof(segment));
+}
+
+/* map an existing segment, 0 on success */
+static int segment_map(segment *s, const char *path, int writable)
+{
+    struct stat st;
+    tsdb_header h;
+    void *base;
+    int fd;
+
+    memset(s, 0, sizeof(segment));
+    if ( ( fd = open( path, writable ? O_RDWR : O_RDONLY ) ) < 0 )
+        return -1;
+    if ( fstat( fd, &st ) < 0 || st.st_size < (off_t) sizeof(tsdb_header) ||
+         pread( fd, &h, sizeof(h), 0 ) != sizeof(h) || h.magic != TSDB_MAGIC || h.version != TSDB_VERSION ||
+         h.block != TSDB_BLOCK || h.capacity == 0 || segment_size(h.capacity) > (size_t) st.st_size ) {
+        close(fd);
+        return -1;
+    }
+
+    base = mmap( NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+    close(fd);
+    if ( base == MAP_FAILED )
+        return -1;
+    segment_layout(s, (uint8_t *) base, h.capacity);
+    s->size = st.st_size;
+    return 0;
+}
+
+static int segment_create(tsdb *db, int64_t first)
+{
+    char path[PATH_MAX];
+    size_t size = segment_size(db->records);
+    void *base;
+    int fd;
+
+    for ( ;; first++ ) {
+        snprintf(path, sizeof(path), "%s/%016llx.seg", db->dir, (unsigned long long) first);
+        if ( ( fd = open( path, O_RDWR | O_CREAT | O_EXCL, 0644 ) ) >= 0 )
+            break;
+        if ( errno != EEXIST ) {
+            perror("tsdb segment open");
+            return -1;
+        }
+    }
+    if ( ftruncate( fd, size ) < 0 ) {
+        perror("tsdb segment ftruncate");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    base = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close(fd);
+    if ( base == MAP_FAILED ) {
+        perror("tsdb segment mmap");
+        unlink(path);
+        return -1;
+    }
+
+    segment_layout(&db->seg, (uint8_t *) base, db->records);
+    db->seg.size = size;
+    db->seg.header->version = TSDB_VERSION;
+    db->seg.header->capacity = db->records;
+    db->seg.header->block = TSDB_BLOCK;
+    db->seg.header->first = first;
+    db->seg.header->last = first;
+    __atomic_store_n(&db->seg.header->magic, TSDB_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int segment_filter(const struct dirent *d)
+{
+    size_t len = strlen(d->d_name);
+
+    return len == 20 && strcmp(d->d_name + 16, ".seg") == 0;
+}
+
+/* the segment files of dir in time order; returns how many, or -1 */
+static int segment_list(const char *dir, struct dirent ***names)
+{
+    return scandir(dir, names, segment_filter, alphasort);
+}
+
+static void segment_list_free(struct dirent **names, int n)
+{
+    while ( n-- > 0 )
+        free(names[n]);
+    free(names);
+}
+
+/* Open dir (created if needed) for appending. */
+tsdb *tsdb_open(const char *dir)
+{
+    struct dirent **names;
+    char path[PATH_MAX];
+    tsdb *db;
+    int n;
+
+    if ( mkdir( dir, 0755 ) < 0 && errno != EEXIST ) {
+        perror("tsdb_open mkdir");
+        return NULL;
+    }
+
+    db = (tsdb *) calloc(1, sizeof(tsdb));
+    db->dir = strdup(dir);
+    db->records = TSDB_SEGMENT_RECORDS;
+    db->span = TSDB_SEGMENT_SPAN;
+
+    if ( ( n = segment_list(dir, &names) ) > 0 ) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[n - 1]->d_name);
+        if ( segment_map(&db->seg, path, 1) == 0 && db->seg.header->count >= db->seg.header->capacity )
+            segment_unmap(&db->seg);
+    }
+    if ( n >= 0 )
+        segment_list_free(names, n);
+    return db;
+}
+
+void tsdb_close(tsdb *db)
+{
+    if ( !db )
+        return;
+    segment_unmap(&db->seg);
+    free(db->dir);
+    free(db);
+}
+
+/* Size of the segments created from now on: records per segment and the time (ns) one may span. */
+void tsdb_rotation(tsdb *db, uint32_t records, int64_t span)
+{
+    if ( records > 0 )
+        db->records = records;
+    if ( span > 0 )
+        db->span = span;
+}
+
+int tsdb_append(tsdb *db, int64_t time, int src, int dst, float rtt, float fwd, float rev, float loss)
+{
+    segment *s = &db->seg;
+    tsdb_span *block;
+    uint32_t i;
+
+    if ( s->header && ( s->header->count >= s->header->capacity || time - s->header->first > db->span ) )
+        segment_unmap(s);
+    if ( !s->header && segment_create(db, time) < 0 )
+        return -1;
+
+    i = s->header->count;
+    s->time[i] = time;
+    s->src[i] = src;
+    s->dst[i] = dst;
+    s->metric[TSDB_RTT][i] = rtt;
+    s->metric[TSDB_FWD][i] = fwd;
+    s->metric[TSDB_REV][i] = rev;
+    s->metric[TSDB_LOSS][i] = loss;
+
+    block = &s->index[i / TSDB_BLOCK];
+    if ( i % TSDB_BLOCK == 0 || time < block->min )
+        block->min = time;
+    if ( i % TSDB_BLOCK == 0 || time > block->max )
+        block->max = time;
+    if ( time < s->header->first )
+        s->header->first = time;
+    if ( time > s->header->last )
+        s->header->last = time;
+
+    __atomic_store_n(&s->header->count, i + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * Call visit for every record of dir with from <= time < until and the given src and dst (or TSDB_ANY), in
+ * the order they were appended. Returns the number of records visited, or -1 if dir cannot be read.
+ */
+int64_t tsdb_scan(const char *dir, int64_t from, int64_t until, int src, int dst, tsdb_visit visit, void *arg)
+{
+    struct dirent **names;
+    char path[PATH_MAX];
+    segment s;
+    tsdb_record r;
+    int64_t visited = 0;
+    uint32_t count, b, i, end;
+    int n, k, stop = 0;
+
+    if ( ( n = segment_list(dir, &names) ) < 0 )
+        return -1;
+
+    for ( k = 0; k < n && !stop; k++ ) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[k]->d_name);
+        if ( segment_map(&s, path, 0) < 0 )
+            continue;
+        count = __atomic_load_n(&s.header->count, __ATOMIC_ACQUIRE);
+        if ( s.header->last < from || s.header->first >= until ) {
+            segment_unmap(&s);
+            continue;
+        }
+
+        for ( b = 0; b * TSDB_BLOCK < count && !stop; b++ ) {
+            if ( s.index[b].max < from || s.index[b].min >= until )
+                continue;
+            end = ( b + 1 ) * TSDB_BLOCK < count ? ( b + 1 ) * TSDB_BLOCK : count;
+            for ( i = b * TSDB_BLOCK; i < end; i++ ) {
+                if ( ( src >= 0 && s.src[i] != src ) || ( dst >= 0 && s.dst[i] != dst ) ||
+                     s.time[i] < from || s.time[i] >= until )
+                    continue;
+                r.time = s.time[i];
+                r.src = s.src[i];
+                r.dst = s.dst[i];
+                r.rtt = s.metric[TSDB_RTT][i];
+                r.fwd = s.metric[TSDB_FWD][i];
+                r.rev = s.metric[TSDB_REV][i];
+                r.loss = s.metric[TSDB_LOSS][i];
+                visited++;
+                if ( visit && visit(&r, arg) ) {
+                    stop = 1;
+                    break;
+                }
+            }
+        }
+        segment_unmap(&s);
+    }
+    segment_list_free(names, n);
+    return visited;
+}
+
+typedef struct downsample_arg {
+    int64_t from;
+    int64_t step;
+    int metric;
+    const uint32_t *edges;
+    int nedges;
+    tsdb_bucket *buckets;
+    int nbuckets;
+    double *sum;
+    double *loss;
+} downsample_arg;
+
+static int downsample_visit(const tsdb_record *r, void *arg)
+{
+    downsample_arg *d = (downsample_arg *) arg;
+    int64_t k = ( r->time - d->from ) / d->step;
+    uint32_t edge = (uint32_t) r->src << 16 | r->dst;
+    int lo = 0, hi = d->nedges - 1, mid;
+    tsdb_bucket *b;
+    float value;
+
+    while ( lo < hi ) {
+        mid = ( lo + hi ) / 2;
+        if ( d->edges[mid] < edge )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if ( d->edges[lo] != edge || k < 0 || k >= d->nbuckets )
+        return 0;
+
+    k += (int64_t) lo * d->nbuckets;
+    b = &d->buckets[k];
+    value = d->metric == TSDB_RTT ? r->rtt : d->metric == TSDB_FWD ? r->fwd : d->metric == TSDB_REV ? r->rev : r->loss;
+    if ( !isnan(r->loss) )
+        d->loss[k] += r->loss;
+    if ( isnan(value) ) {
+        b->lost++;
+        return 0;
+    }
+    if ( b->count == 0 || value < b->min )
+        b->min = value;
+    if ( b->count == 0 || value > b->max )
+        b->max = value;
+    b->count++;
+    d->sum[k] += value;
+    return 0;
+}
+
+/*
+ * Downsample metric (TSDB_RTT, TSDB_FWD, TSDB_REV or TSDB_LOSS) of the records in [from, until) of every edge
+ * (src << 16 | dst, ascending, as tsdb_edges returns them) in a single scan, into nbuckets buckets of step ns
+ * per edge: buckets[e * nbuckets + k] has the count, min, mean and max of the metric and the mean loss of edge
+ * e from from + k * step on. Returns the number of buckets per edge that cover the range, or -1.
+ */
+int tsdb_downsample(const char *dir, int64_t from, int64_t until, const uint32_t *edges, int nedges, int metric,
+                    int64_t step, tsdb_bucket *buckets, int nbuckets)
+{
+    downsample_arg d;
+    int64_t total, k, cells, end;
+
+    if ( step <= 0 || until <= from || metric < 0 || metric >= TSDB_METRICS || nedges <= 0 )
+        return -1;
+    total = ( until - from + step - 1 ) / step;
+    if ( total < nbuckets )
+        nbuckets = total;
+    cells = (int64_t) nedges * nbuckets;
+    end = from + nbuckets * step < until ? from + nbuckets * step : until;
+
+    d.from = from;
+    d.step = step;
+    d.metric = metric;
+    d.edges = edges;
+    d.nedges = nedges;
+    d.buckets = buckets;
+    d.nbuckets = nbuckets;
+    d.sum = (double *) calloc(cells, sizeof(double));
+    d.loss = (double *) calloc(cells, sizeof(double));
+    memset(buckets, 0, cells * sizeof(tsdb_bucket));
+
+    if ( tsdb_scan(dir, from, end, nedges == 1 ? (int) ( edges[0] >> 16 ) : TSDB_ANY,
+                   nedges == 1 ? (int) ( edges[0] & 0xffff ) : TSDB_ANY, downsample_visit, &d) < 0 ) {
+        free(d.sum);
+        free(d.loss);
+        return -1;
+    }
+
+    for ( k = 0; k < cells; k++ ) {
+        buckets[k].start = from + k % nbuckets * step;
+        buckets[k].mean = buckets[k].count ? d.sum[k] / buckets[k].count : NAN;
+        buckets[k].loss = buckets[k].count + buckets[k].lost ? d.loss[k] / ( buckets[k].count + buckets[k].lost ) : NAN;
+        if ( !buckets[k].count )
+            buckets[k].min = buckets[k].max = NAN;
+    }
+    free(d.sum);
+    free(d.loss);
+    return nbuckets;
+}
+
+typedef struct edges_arg {
+    uint32_t *set;              /* open addressing, 0 is empty so the keys are edge + 1 */
+    uint32_t mask;
+    uint32_t count;
+} edges_arg;
+
+static int edges_visit(const tsdb_record *r, void *arg)
+{
+    edges_arg *e = (edges_arg *) arg;
+    uint32_t key = ( (uint32_t) r->src << 16 | r->dst ) + 1, h, i, *grown, mask;
+
+    for ( h = key * 2654435761u & e->mask; e->set[h] && e->set[h] != key; h = ( h + 1 ) & e->mask )
+        ;
+    if ( e->set[h] )
+        return 0;
+    e->set[h] = key;
+
+    if ( ++e->count * 2 > e->mask ) {
+        mask = e->mask * 2 + 1;
+        grown = (uint32_t *) calloc(mask + 1, sizeof(uint32_t));
+        for ( i = 0; i <= e->mask; i++ )
+            if ( e->set[i] ) {
+                for ( h = e->set[i] * 2654435761u & mask; grown[h]; h = ( h + 1 ) & mask )
+                    ;
+                grown[h] = e->set[i];
+            }
+        free(e->set);
+        e->set = grown;
+        e->mask = mask;
+    }
+    return 0;
+}
+
+static int compare_edges(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * The distinct edges with records in [from, until), as src << 16 | dst in ascending order. Returns how many
+ * there are (only the first max are written), or -1.
+ */
+int tsdb_edges(const char *dir, int64_t from, int64_t until, uint32_t *edges, int max)
+{
+    edges_arg e;
+    uint32_t i, n = 0;
+
+    e.mask = 255;
+    e.count = 0;
+    e.set = (uint32_t *) calloc(e.mask + 1, sizeof(uint32_t));
+    if ( tsdb_scan(dir, from, until, TSDB_ANY, TSDB_ANY, edges_visit, &e) < 0 ) {
+        free(e.set);
+        return -1;
+    }
+    for ( i = 0; i <= e.mask; i++ )
+        if ( e.set[i] )
+            e.set[n++] = e.set[i] - 1;
+    qsort(e.set, n, sizeof(uint32_t), compare_edges);
+    memcpy(edges, e.set, ( n < (uint32_t) max ? n : (uint32_t) max ) * sizeof(uint32_t));
+    free(e.set);
+    return n;
+}
+
+/* Remove the segments whose records are all older than before, except the newest. Returns how many. */
+int tsdb_prune(const char *dir, int64_t before)
+{
+    struct dirent **names;
+    char path[PATH_MAX];
+    segment s;
+    int n, k, removed = 0, old;
+
+    if ( ( n = segment_list(dir, &names) ) < 0 )
+        return -1;
+    for ( k = 0; k < n - 1; k++ ) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[k]->d_name);
+        if ( segment_map(&s, path, 0) < 0 )
+            continue;
+        old = s.header->last < before;
+        segment_unmap(&s);
+        if ( old && unlink(path) == 0 )
+            removed++;
+    }
+    segment_list_free(names, n);
+    return removed;
+}
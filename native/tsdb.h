@@ -0,0 +1,79 @@
+/**
+ * [Title]: tsdb.h -- append-only store of the delay history
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Fixed size records (time, src, dst, rtt, fwd, rev, loss) in a directory of memory mapped segment files,
+ * named after the time of their first record (<ns in hex>.seg) so that they list in time order:
+ *
+ *     header (128 bytes): magic "CXPT", version, capacity, block, count, earliest and latest time
+ *     columns: time int64[capacity] | src uint16[] | dst uint16[] | rtt float[] | fwd float[] | rev float[] |
+ *              loss float[] | index: min and max time of every block of TSDB_BLOCK records
+ *
+ * Every column is 64 byte aligned. An append writes one slot of every column and the index, then publishes it
+ * by storing the count, so it costs a handful of stores into the page cache and no syscall; readers map the
+ * segments read only and see every record below the count. A segment is full after capacity records or once
+ * it spans more than the rotation span, and the next append starts a new one. Scans skip the segments and then
+ * the blocks whose time range misses the query, and test the src and dst columns before touching the rest.
+ *
+ * The delays are in ms. A record of a single probe has loss 0, or 1 with NaN delays if the probe was lost; a
+ * record of a report has the loss fraction of the edge. There must be one writer per directory.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_TSDB_H
+#define CXP_TSDB_H
+
+#include <stdint.h>
+
+#define TSDB_MAGIC              0x43585054      /* "CXPT" */
+#define TSDB_VERSION            1
+#define TSDB_BLOCK              1024            /* records per index entry */
+#define TSDB_SEGMENT_RECORDS    (1 << 20)       /* 28 MB per segment */
+#define TSDB_SEGMENT_SPAN       (24 * 3600 * 1000000000LL)
+#define TSDB_ANY                -1              /* src or dst of a query */
+
+enum { TSDB_RTT, TSDB_FWD, TSDB_REV, TSDB_LOSS, TSDB_METRICS };
+
+typedef struct tsdb_record {
+    int64_t time;               /* unix time, ns */
+    uint16_t src;
+    uint16_t dst;
+    float rtt;
+    float fwd;
+    float rev;
+    float loss;
+} tsdb_record;
+
+typedef struct tsdb_bucket {
+    int64_t start;              /* ns */
+    uint32_t count;             /* records with a delay */
+    uint32_t lost;              /* records of lost probes */
+    float min;
+    float mean;
+    float max;
+    float loss;                 /* mean loss of all the records */
+} tsdb_bucket;
+
+typedef struct tsdb tsdb;
+typedef int (*tsdb_visit)(const tsdb_record *r, void *arg);    /* nonzero stops the scan */
+
+tsdb *tsdb_open(const char *dir);
+void tsdb_close(tsdb *db);
+void tsdb_rotation(tsdb *db, uint32_t records, int64_t span);
+int tsdb_append(tsdb *db, int64_t time, int src, int dst, float rtt, float fwd, float rev, float loss);
+
+int64_t tsdb_scan(const char *dir, int64_t from, int64_t until, int src, int dst, tsdb_visit visit, void *arg);
+int tsdb_downsample(const char *dir, int64_t from, int64_t until, const uint32_t *edges, int nedges, int metric,
+                    int64_t step, tsdb_bucket *buckets, int nbuckets);
+int tsdb_edges(const char *dir, int64_t from, int64_t until, uint32_t *edges, int max);
+int tsdb_prune(const char *dir, int64_t before);
+
+#endif
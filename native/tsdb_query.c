@@ -0,0 +1,167 @@
+/**
+ * [Title]: tsdb_query.c -- range scans and downsampling of the delay history
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Prints the records of a store of tsdb.h (the ./cxp/tsdb directory of the controller or ./logs/tsdb of an
+ * agent) between two times, for one edge or all of them. With -b the records of every edge are downsampled
+ * into buckets of that many seconds instead (count, lost, min, mean, max of the -m metric and mean loss).
+ * Times are unix seconds, or seconds before now when negative. -p removes the segments older than -f.
+ *
+ * Usage: ./tsdb_query -d dir [-s src] [-t dst] [-f from] [-u until] [-b bucket_s [-m rtt|fwd|rev|loss]] [-c] [-p]
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tsdb.h"
+
+#define MAX_EDGES           65536
+#define MAX_CELLS           ( 1 << 20 )    /* buckets of all the edges */
+
+static const char *metrics[] = { "rtt", "fwd", "rev", "loss", NULL };
+
+static int64_t parse_time(const char *arg, int64_t now)
+{
+    double t = atof(arg);
+
+    return t < 0 ? now + (int64_t) ( t * 1e9 ) : (int64_t) ( t * 1e9 );
+}
+
+static int print_record(const tsdb_record *r, void *arg)
+{
+    (void) arg;
+    printf("%.6f %u %u %f %f %f %f\n", r->time / 1e9, r->src, r->dst, r->rtt, r->fwd, r->rev, r->loss);
+    return 0;
+}
+
+static int first_record(const tsdb_record *r, void *arg)
+{
+    *(int64_t *) arg = r->time;
+    return 1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s -d dir [-s src] [-t dst] [-f from] [-u until] [-b bucket_s [-m rtt|fwd|rev|loss]] [-c] [-p]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = NULL;
+    struct timespec ts;
+    tsdb_bucket *buckets, *b;
+    uint32_t *edges;
+    int64_t now, from = 0, until, count;
+    double bucket = 0;
+    int c, src = TSDB_ANY, dst = TSDB_ANY, metric = TSDB_FWD, count_only = 0, prune = 0, until_set = 0, nedges, nbuckets, e, n, k;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    until = now + 1;
+
+    while ( ( c = getopt(argc, argv, "d:s:t:f:u:b:m:cp") ) != -1 ) {
+        switch (c) {
+        case 'd':
+            dir = optarg;
+            break;
+        case 's':
+            src = atoi(optarg);
+            break;
+        case 't':
+            dst = atoi(optarg);
+            break;
+        case 'f':
+            from = parse_time(optarg, now);
+            break;
+        case 'u':
+            until = parse_time(optarg, now);
+            until_set = 1;
+            break;
+        case 'b':
+            bucket = atof(optarg);
+            break;
+        case 'm':
+            for ( metric = 0; metrics[metric] && strcmp(metrics[metric], optarg) != 0; metric++ )
+                ;
+            if ( !metrics[metric] )
+                usage(argv[0]);
+            break;
+        case 'c':
+            count_only = 1;
+            break;
+        case 'p':
+            prune = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if ( !dir )
+        usage(argv[0]);
+
+    if ( prune ) {
+        if ( ( n = tsdb_prune(dir, from) ) < 0 ) {
+            perror(dir);
+            exit(EXIT_FAILURE);
+        }
+        printf("removed %d segment(s)\n", n);
+        return 0;
+    }
+
+    if ( bucket <= 0 ) {
+        if ( ( count = tsdb_scan(dir, from, until, src, dst, count_only ? NULL : print_record, NULL) ) < 0 ) {
+            perror(dir);
+            exit(EXIT_FAILURE);
+        }
+        if ( count_only )
+            printf("%lld\n", (long long) count);
+        return 0;
+    }
+
+    edges = (uint32_t *) malloc(MAX_EDGES * sizeof(uint32_t));
+    if ( ( nedges = tsdb_edges(dir, from, until, edges, MAX_EDGES) ) < 0 ) {
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+    for ( e = 0, n = 0; e < nedges && e < MAX_EDGES; e++ )
+        if ( ( src < 0 || (int) ( edges[e] >> 16 ) == src ) && ( dst < 0 || (int) ( edges[e] & 0xffff ) == dst ) )
+            edges[n++] = edges[e];
+    nedges = n;
+
+    /* from defaults to the bucket of the first record */
+    if ( from == 0 && nedges > 0 ) {
+        tsdb_scan(dir, 0, until, TSDB_ANY, TSDB_ANY, first_record, &from);
+        from -= from % (int64_t) ( bucket * 1e9 );
+    }
+
+    printf("# start src dst count lost min mean max loss (%s)\n", metrics[metric]);
+    nbuckets = nedges > 0 ? MAX_CELLS / nedges : 0;
+    buckets = (tsdb_bucket *) malloc(( nedges > 0 ? MAX_CELLS : 1 ) * sizeof(tsdb_bucket));
+    n = nedges > 0 ? tsdb_downsample(dir, from, until, edges, nedges, metric, (int64_t) ( bucket * 1e9 ), buckets,
+                                     nbuckets) : 0;
+    if ( until_set && nedges > 0 && from + (int64_t) n * (int64_t) ( bucket * 1e9 ) < until )
+        fprintf(stderr, "only the first %d bucket(s) of every edge fit, narrow the range\n", n);
+    for ( e = 0; e < nedges; e++ )
+        for ( k = 0; k < n; k++ ) {
+            b = &buckets[(int64_t) e * n + k];
+            if ( b->count || b->lost )
+                printf("%.3f %u %u %u %u %f %f %f %f\n", b->start / 1e9, edges[e] >> 16, edges[e] & 0xffff,
+                       b->count, b->lost, b->min, b->mean, b->max, b->loss);
+        }
+    free(edges);
+    free(buckets);
+    return 0;
+}
@@ -0,0 +1,299 @@
+/**
+ * [Title]: batch.c -- statistics kernels over the samples of all the peers at once
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Scalar, SSE2 and AVX2 versions of the kernels of batch.h; the vector ones are compiled with the target
+ * attribute, so the file needs no -m flags and the binary still runs on a CPU without AVX2. The vectors have
+ * no 64 bit integer to double conversion, so the timestamp differences go through the 2^52 + 2^51 trick,
+ * exact while they are under 2^51 ns (26 days) in magnitude, which base must keep.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86
+#endif
+
+#include "batch.h"
+
+#define NETWORK_SIZE        60
+#define MAGIC_BITS          0x4338000000000000ULL       /* 2^52 + 2^51 as a double */
+#define MAGIC               6755399441055744.0
+
+typedef struct kernel {
+    const char *name;
+    void (*sort)(batch *b);
+    void (*delays)(const batch_times *t, int from, int n, float *forward, float *reverse);
+} kernel;
+
+/* Green's 16 input network, 10 layers */
+static const uint8_t network[NETWORK_SIZE][2] = {
+    { 0, 13 }, { 1, 12 }, { 2, 15 }, { 3, 14 }, { 4, 8 }, { 5, 6 }, { 7, 11 }, { 9, 10 },
+    { 0, 5 }, { 1, 7 }, { 2, 9 }, { 3, 4 }, { 6, 13 }, { 8, 14 }, { 10, 15 }, { 11, 12 },
+    { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 8 }, { 7, 9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
+    { 0, 2 }, { 1, 3 }, { 4, 10 }, { 5, 11 }, { 6, 7 }, { 8, 9 }, { 12, 14 }, { 13, 15 },
+    { 1, 2 }, { 3, 12 }, { 4, 6 }, { 5, 7 }, { 8, 10 }, { 9, 11 }, { 13, 14 },
+    { 1, 4 }, { 2, 6 }, { 5, 8 }, { 7, 10 }, { 9, 13 }, { 11, 14 },
+    { 2, 4 }, { 3, 6 }, { 9, 12 }, { 11, 13 },
+    { 3, 5 }, { 6, 8 }, { 7, 9 }, { 10, 12 },
+    { 3, 4 }, { 5, 6 }, { 7, 8 }, { 9, 10 }, { 11, 12 },
+    { 6, 7 }, { 8, 9 },
+};
+
+int batch_init(batch *b, int lanes)
+{
+    memset(b, 0, sizeof(*b));
+    b->lanes = lanes;
+    b->stride = ( lanes + BATCH_LANES - 1 ) / BATCH_LANES * BATCH_LANES;
+    if ( b->stride == 0 )
+        b->stride = BATCH_LANES;
+    if ( posix_memalign( (void **) &b->row, 32, sizeof(float) * BATCH_SAMPLES * b->stride ) != 0 ) {
+        b->row = NULL;
+        return -1;
+    }
+    if ( ( b->count = (uint8_t *) malloc(b->stride) ) == NULL ) {
+        free(b->row);
+        b->row = NULL;
+        return -1;
+    }
+    batch_clear(b);
+    return 0;
+}
+
+void batch_free(batch *b)
+{
+    free(b->row);
+    free(b->count);
+    b->row = NULL;
+    b->count = NULL;
+}
+
+void batch_clear(batch *b)
+{
+    int i;
+
+    for ( i = 0; i < BATCH_SAMPLES * b->stride; i++ )
+        b->row[i] = INFINITY;
+    memset(b->count, 0, b->stride);
+}
+
+static void sort_scalar(batch *b)
+{
+    float v[BATCH_SAMPLES], lo;
+    int i, k, c;
+
+    for ( i = 0; i < b->stride; i++ ) {
+        for ( k = 0; k < BATCH_SAMPLES; k++ )
+            v[k] = b->row[k * b->stride + i];
+        for ( c = 0; c < NETWORK_SIZE; c++ ) {
+            lo = v[network[c][0]] < v[network[c][1]] ? v[network[c][0]] : v[network[c][1]];
+            v[network[c][1]] = v[network[c][0]] < v[network[c][1]] ? v[network[c][1]] : v[network[c][0]];
+            v[network[c][0]] = lo;
+        }
+        for ( k = 0; k < BATCH_SAMPLES; k++ )
+            b->row[k * b->stride + i] = v[k];
+    }
+}
+
+/* clock_add() for lane i */
+static void delay_scalar(const batch_times *t, int i, float *forward, float *reverse)
+{
+    double offset, delay, fwd;
+
+    offset = t->offset[i] + t->skew[i] * ( (double) (int64_t) (t->t1[i] - t->base[i]) / 1e9 );
+    delay = (double) (int64_t) (t->t4[i] - t->t1[i]) - (double) (int64_t) (t->t3[i] - t->t2[i]);
+    if ( delay < 0 )
+        delay = 0;
+    fwd = (double) (int64_t) (t->t2[i] - t->t1[i]) - offset;
+    if ( fwd < 0 )
+        fwd = 0;
+    if ( fwd > delay )
+        fwd = delay;
+    forward[i] = fwd / 1e6;
+    reverse[i] = ( delay - fwd ) / 1e6;
+}
+
+static void delays_scalar(const batch_times *t, int from, int n, float *forward, float *reverse)
+{
+    int i;
+
+    for ( i = from; i < n; i++ )
+        delay_scalar(t, i, forward, reverse);
+}
+
+#ifdef BATCH_X86
+__attribute__((target("sse2")))
+static void sort_sse2(batch *b)
+{
+    __m128 v[BATCH_SAMPLES], lo;
+    int i, k, c;
+
+    for ( i = 0; i < b->stride; i += 4 ) {
+        for ( k = 0; k < BATCH_SAMPLES; k++ )
+            v[k] = _mm_load_ps(&b->row[k * b->stride + i]);
+        for ( c = 0; c < NETWORK_SIZE; c++ ) {
+            lo = _mm_min_ps(v[network[c][0]], v[network[c][1]]);
+            v[network[c][1]] = _mm_max_ps(v[network[c][0]], v[network[c][1]]);
+            v[network[c][0]] = lo;
+        }
+        for ( k = 0; k < BATCH_SAMPLES; k++ )
+            _mm_store_ps(&b->row[k * b->stride + i], v[k]);
+    }
+}
+
+__attribute__((target("sse2")))
+static inline __m128d diff_sse2(const uint64_t *a, const uint64_t *b, int i)
+{
+    __m128i d = _mm_sub_epi64(_mm_loadu_si128((const __m128i *) &a[i]), _mm_loadu_si128((const __m128i *) &b[i]));
+
+    d = _mm_add_epi64(d, _mm_set1_epi64x(MAGIC_BITS));
+    return _mm_sub_pd(_mm_castsi128_pd(d), _mm_set1_pd(MAGIC));
+}
+
+__attribute__((target("sse2")))
+static void delays_sse2(const batch_times *t, int from, int n, float *forward, float *reverse)
+{
+    __m128d offset, delay, fwd, zero = _mm_setzero_pd(), ms = _mm_set1_pd(1e-6), s = _mm_set1_pd(1e-9);
+    int i;
+
+    for ( i = from; i + 2 <= n; i += 2 ) {
+        offset = _mm_add_pd(_mm_loadu_pd(&t->offset[i]),
+                            _mm_mul_pd(_mm_loadu_pd(&t->skew[i]), _mm_mul_pd(diff_sse2(t->t1, t->base, i), s)));
+        delay = _mm_max_pd(_mm_sub_pd(diff_sse2(t->t4, t->t1, i), diff_sse2(t->t3, t->t2, i)), zero);
+        fwd = _mm_min_pd(_mm_max_pd(_mm_sub_pd(diff_sse2(t->t2, t->t1, i), offset), zero), delay);
+        _mm_storel_pi((__m64 *) &forward[i], _mm_cvtpd_ps(_mm_mul_pd(fwd, ms)));
+        _mm_storel_pi((__m64 *) &reverse[i], _mm_cvtpd_ps(_mm_mul_pd(_mm_sub_pd(delay, fwd), ms)));
+    }
+    delays_scalar(t, i, n, forward, reverse);
+}
+
+__attribute__((target("avx2")))
+static void sort_avx2(batch *b)
+{
+    __m256 v[BATCH_SAMPLES], lo;
+    int i, k, c;
+
+    for ( i = 0; i < b->stride; i += 8 ) {
+        for ( k = 0; k < BATCH_SAMPLES; k++ )
+            v[k] = _mm256_load_ps(&b->row[k * b->stride + i]);
+        for ( c = 0; c < NETWORK_SIZE; c++ ) {
+            lo = _mm256_min_ps(v[network[c][0]], v[network[c][1]]);
+            v[network[c][1]] = _mm256_max_ps(v[network[c][0]], v[network[c][1]]);
+            v[network[c][0]] = lo;
+        }
+        for ( k = 0; k < BATCH_SAMPLES; k++ )
+            _mm256_store_ps(&b->row[k * b->stride + i], v[k]);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256d diff_avx2(const uint64_t *a, const uint64_t *b, int i)
+{
+    __m256i d = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *) &a[i]),
+                                 _mm256_loadu_si256((const __m256i *) &b[i]));
+
+    d = _mm256_add_epi64(d, _mm256_set1_epi64x(MAGIC_BITS));
+    return _mm256_sub_pd(_mm256_castsi256_pd(d), _mm256_set1_pd(MAGIC));
+}
+
+__attribute__((target("avx2")))
+static void delays_avx2(const batch_times *t, int from, int n, float *forward, float *reverse)
+{
+    __m256d offset, delay, fwd, zero = _mm256_setzero_pd(), ms = _mm256_set1_pd(1e-6), s = _mm256_set1_pd(1e-9);
+    int i;
+
+    for ( i = from; i + 4 <= n; i += 4 ) {
+        offset = _mm256_add_pd(_mm256_loadu_pd(&t->offset[i]),
+                               _mm256_mul_pd(_mm256_loadu_pd(&t->skew[i]),
+                                             _mm256_mul_pd(diff_avx2(t->t1, t->base, i), s)));
+        delay = _mm256_max_pd(_mm256_sub_pd(diff_avx2(t->t4, t->t1, i), diff_avx2(t->t3, t->t2, i)), zero);
+        fwd = _mm256_min_pd(_mm256_max_pd(_mm256_sub_pd(diff_avx2(t->t2, t->t1, i), offset), zero), delay);
+        _mm_storeu_ps(&forward[i], _mm256_cvtpd_ps(_mm256_mul_pd(fwd, ms)));
+        _mm_storeu_ps(&reverse[i], _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_sub_pd(delay, fwd), ms)));
+    }
+    delays_scalar(t, i, n, forward, reverse);
+}
+#endif
+
+static const kernel kernels[] = {
+#ifdef BATCH_X86
+    { "avx2", sort_avx2, delays_avx2 },
+    { "sse2", sort_sse2, delays_sse2 },
+#endif
+    { "scalar", sort_scalar, delays_scalar },
+};
+
+#define KERNELS             ( sizeof(kernels) / sizeof(kernels[0]) )
+
+static const kernel *current;
+
+static const kernel *pick(void)
+{
+    const kernel *k = &kernels[KERNELS - 1];
+
+    if ( current )
+        return current;
+#ifdef BATCH_X86
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") )
+        k = &kernels[0];
+    else if ( __builtin_cpu_supports("sse2") )
+        k = &kernels[1];
+#endif
+    __atomic_store_n(&current, k, __ATOMIC_RELAXED);
+    return k;
+}
+
+const char *batch_kernel(void)
+{
+    return pick()->name;
+}
+
+/* Force a kernel by name; -1 if there is none or the CPU cannot run it. */
+int batch_use(const char *name)
+{
+    unsigned int i;
+
+    for ( i = 0; i < KERNELS; i++ ) {
+        if ( strcmp(kernels[i].name, name) != 0 )
+            continue;
+#ifdef BATCH_X86
+        __builtin_cpu_init();
+        if ( i == 0 && !__builtin_cpu_supports("avx2") )
+            return -1;
+        if ( i == 1 && !__builtin_cpu_supports("sse2") )
+            return -1;
+#endif
+        __atomic_store_n(&current, &kernels[i], __ATOMIC_RELAXED);
+        return 0;
+    }
+    return -1;
+}
+
+/* Sorts the rows of every lane in place and puts the median of lane i in median[i], NAN for an empty lane. */
+void batch_medians(batch *b, float *median)
+{
+    int i;
+
+    pick()->sort(b);
+    for ( i = 0; i < b->lanes; i++ )
+        median[i] = b->count[i] ? b->row[( b->count[i] - 1 ) / 2 * b->stride + i] : NAN;
+}
+
+/* forward[i] and reverse[i] (ms) of the n lanes of t. */
+void batch_delays(const batch_times *t, int n, float *forward, float *reverse)
+{
+    pick()->delays(t, 0, n, forward, reverse);
+}
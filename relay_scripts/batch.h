@@ -0,0 +1,63 @@
+/**
+ * [Title]: batch.h -- statistics kernels over the samples of all the peers at once
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * A batch is a structure of arrays: row k holds the k-th sample of every lane (a peer, or a peer and metric),
+ * so one vector instruction works on 4 (SSE2) or 8 (AVX2) lanes. A lane has up to BATCH_SAMPLES samples and
+ * its empty slots hold +inf, which sort last. batch_medians() runs the 60 comparators of a 16 input sorting
+ * network down the rows, as vector min/max with no branches, and then takes the median of every lane (the
+ * lower one for an even count, as quick_select_median() and the stats histogram do). batch_delays() does the
+ * arithmetic of clock_add() for a row of four-timestamp samples: the differences in 64 bit integers, the
+ * offset and skew of each lane's clock, the forward/reverse split and its clamping.
+ *
+ * The kernel is picked once, by what the CPU supports (AVX2, then SSE2, then scalar C); batch_use() forces
+ * one, for batch_bench.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_BATCH_H
+#define CXP_BATCH_H
+
+#include <stdint.h>
+
+#define BATCH_SAMPLES           16
+#define BATCH_LANES             8               /* widest vector, in floats; the stride is a multiple of it */
+
+typedef struct batch {
+    int lanes, stride;
+    float *row;                 /* BATCH_SAMPLES rows of stride floats, row k of lane i at row[k * stride + i] */
+    uint8_t *count;
+} batch;
+
+/* One row of samples, lane i from t1[i] .. t4[i] (local and peer ns) and the lane's clock: offset[i] ns at
+ * base[i] (local ns) plus skew[i] ns/s after it. */
+typedef struct batch_times {
+    const uint64_t *t1, *t2, *t3, *t4;
+    const uint64_t *base;
+    const double *offset, *skew;
+} batch_times;
+
+int batch_init(batch *b, int lanes);
+void batch_free(batch *b);
+void batch_clear(batch *b);
+void batch_medians(batch *b, float *median);
+void batch_delays(const batch_times *t, int n, float *forward, float *reverse);
+const char *batch_kernel(void);
+int batch_use(const char *name);
+
+/* A sample past BATCH_SAMPLES is dropped; the caller checks the lane's count. */
+static inline void batch_put(batch *b, int lane, float value)
+{
+    if ( b->count[lane] < BATCH_SAMPLES )
+        b->row[b->count[lane]++ * b->stride + lane] = value;
+}
+
+#endif
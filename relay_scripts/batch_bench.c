@@ -0,0 +1,287 @@
+/**
+ * [Title]: batch_bench.c -- the batch kernels against the per peer statistics of server.c
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Makes up PROBES_PER_ROUND replies for each of -p peers, with a clock offset and skew per peer, and times
+ * the statistics of a round both ways: one peer at a time with timeval_diff() and quick_select_median() as
+ * server.c and poll_server.c have them, and all the peers at once with batch_delays() and batch_medians() for
+ * every kernel this CPU runs. The batch figures include filling the rows. It checks that the kernels agree
+ * with the scalar one and that the medians are the ones quick_select_median() picks, and prints ns per peer.
+ *
+ * Usage: ./batch_bench.out [-p peers] [-n iterations] [-s seed]
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "batch.h"
+
+#define PROBES_PER_ROUND    10
+
+typedef double elem_type;
+
+#define ELEM_SWAP(a,b) { register elem_type t=(a);(a)=(b);(b)=t; }
+
+/* server.c, unchanged */
+double quick_select_median(double arr[], uint16_t n)
+{
+    uint16_t low, high ;
+    uint16_t median;
+    uint16_t middle, ll, hh;
+    low = 0 ; high = n - 1 ; median = (low + high) / 2;
+    for (;;) {
+        if (high <= low) /* One element only */
+            return arr[median] ;
+        if (high == low + 1) { /* Two elements only */
+            if (arr[low] > arr[high])
+                ELEM_SWAP(arr[low], arr[high]) ;
+            return arr[median] ;
+        }
+        /* Find median of low, middle and high items; swap into position low */
+        middle = (low + high) / 2;
+        if (arr[middle] > arr[high])
+            ELEM_SWAP(arr[middle], arr[high]) ;
+        if (arr[low] > arr[high])
+            ELEM_SWAP(arr[low], arr[high]) ;
+        if (arr[middle] > arr[low])
+            ELEM_SWAP(arr[middle], arr[low]) ;
+        /* Swap low item (now in position middle) into position (low+1) */
+        ELEM_SWAP(arr[middle], arr[low + 1]) ;
+        /* Nibble from each end towards middle, swapping items when stuck */
+        ll = low + 1;
+        hh = high;
+        for (;;) {
+            do ll++; while (arr[low] > arr[ll]) ;
+            do hh--; while (arr[hh] > arr[low]) ;
+            if (hh < ll)
+                break;
+            ELEM_SWAP(arr[ll], arr[hh]) ;
+        }
+        /* Swap middle item (in position low) back into correct position */
+        ELEM_SWAP(arr[low], arr[hh]) ;
+        /* Re-set active partition */
+        if (hh <= median)
+            low = ll;
+        if (hh >= median)
+            high = hh - 1;
+    }
+    return arr[median] ;
+}
+
+/* server.c, unchanged */
+double timeval_diff(struct timeval * tv0, struct timeval * tv1)
+{
+    double time1, time2;
+
+    time1 = tv0->tv_sec + (tv0->tv_usec / 1000000.0);
+    time2 = tv1->tv_sec + (tv1->tv_usec / 1000000.0);
+
+    time1 = time1 - time2;
+    if (time1 < 0)
+        time1 = -time1;
+    return time1;
+}
+
+typedef struct round_data {
+    int n;
+    uint64_t *t[4];                 /* SoA: t[j][k * n + i] is timestamp j of sample k of peer i, ns */
+    struct timeval *tv[4];          /* the same, as server.c has them */
+    uint64_t *base;
+    double *offset, *skew;          /* per peer: ns at base, ns/s */
+} round_data;
+
+static double uniform(void)
+{
+    return rand() / ( RAND_MAX + 1.0 );
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_round(round_data *r, int n)
+{
+    uint64_t start = 1700000000ULL * 1000000000ULL, t1, fwd, rev;
+    double offset, skew;
+    int i, j, k;
+
+    r->n = n;
+    for ( j = 0; j < 4; j++ ) {
+        r->t[j] = (uint64_t *) malloc(sizeof(uint64_t) * n * PROBES_PER_ROUND);
+        r->tv[j] = (struct timeval *) malloc(sizeof(struct timeval) * n * PROBES_PER_ROUND);
+    }
+    r->base = (uint64_t *) malloc(sizeof(uint64_t) * n);
+    r->offset = (double *) malloc(sizeof(double) * n);
+    r->skew = (double *) malloc(sizeof(double) * n);
+
+    for ( i = 0; i < n; i++ ) {
+        offset = ( uniform() - 0.5 ) * 2e7;             /* +- 10 ms */
+        skew = ( uniform() - 0.5 ) * 1e5;               /* +- 50 ppm */
+        r->base[i] = start;
+        r->offset[i] = offset;
+        r->skew[i] = skew;
+        fwd = (uint64_t) ( 5e6 + uniform() * 1e8 );
+        rev = (uint64_t) ( 5e6 + uniform() * 1e8 );
+        for ( k = 0; k < PROBES_PER_ROUND; k++ ) {
+            t1 = start + (uint64_t) k * 100000000ULL + i * 1000ULL;
+            r->t[0][k * n + i] = t1;
+            r->t[1][k * n + i] = t1 + fwd + (uint64_t) ( uniform() * 2e6 ) +
+                                 (int64_t) ( offset + skew * ( t1 - start ) / 1e9 );
+            r->t[2][k * n + i] = r->t[1][k * n + i] + 20000;
+            r->t[3][k * n + i] = r->t[2][k * n + i] + rev + (uint64_t) ( uniform() * 2e6 ) -
+                                 (int64_t) ( offset + skew * ( t1 - start ) / 1e9 );
+            for ( j = 0; j < 4; j++ ) {
+                r->tv[j][k * n + i].tv_sec = r->t[j][k * n + i] / 1000000000ULL;
+                r->tv[j][k * n + i].tv_usec = r->t[j][k * n + i] % 1000000000ULL / 1000;
+            }
+        }
+    }
+}
+
+/* what server.c does per peer at the end of a round: three differences per reply, then the median */
+static double round_scalar(round_data *r, double *median)
+{
+    double forward[PROBES_PER_ROUND], ping, second_trip, sink = 0;
+    int i, k, n = r->n;
+
+    for ( i = 0; i < n; i++ ) {
+        for ( k = 0; k < PROBES_PER_ROUND; k++ ) {
+            forward[k] = 1000. * timeval_diff(&r->tv[1][k * n + i], &r->tv[0][k * n + i]);
+            ping = 1000. * timeval_diff(&r->tv[3][k * n + i], &r->tv[0][k * n + i]);
+            second_trip = 1000. * timeval_diff(&r->tv[3][k * n + i], &r->tv[2][k * n + i]);
+            sink += ping + second_trip;
+        }
+        median[i] = quick_select_median(forward, PROBES_PER_ROUND);
+    }
+    return sink;
+}
+
+/* the same round through the kernels: the clock split of every row of peers, then all the medians */
+static void round_batch(round_data *r, batch *b, float *forward, float *reverse, float *median)
+{
+    batch_times t;
+    int i, k, n = r->n;
+
+    batch_clear(b);
+    t.base = r->base;
+    t.offset = r->offset;
+    t.skew = r->skew;
+    for ( k = 0; k < PROBES_PER_ROUND; k++ ) {
+        t.t1 = &r->t[0][k * n];
+        t.t2 = &r->t[1][k * n];
+        t.t3 = &r->t[2][k * n];
+        t.t4 = &r->t[3][k * n];
+        batch_delays(&t, n, &forward[k * n], &reverse[k * n]);
+        for ( i = 0; i < n; i++ )
+            batch_put(b, i, forward[k * n + i]);
+    }
+    batch_medians(b, median);
+}
+
+int main(int argc, char **argv)
+{
+    const char *names[] = { "scalar", "sse2", "avx2" };
+    round_data r;
+    batch b;
+    double *median, *scaled, start, base_ns = 0, ns, worst, sink = 0, diff[PROBES_PER_ROUND];
+    float *forward, *reverse, *bmedian, *ref_forward, *ref_reverse;
+    int n = 1000, iterations = 200, seed = 1, opt, it, i, k, q, mismatch;
+
+    while ( ( opt = getopt(argc, argv, "p:n:s:") ) != -1 ) {
+        switch (opt) {
+        case 'p':
+            n = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p peers] [-n iterations] [-s seed]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ( n < 1 || iterations < 1 ) {
+        fprintf(stderr, "need at least 1 peer and 1 iteration\n");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(seed);
+    make_round(&r, n);
+    median = (double *) malloc(sizeof(double) * n);
+    scaled = (double *) malloc(sizeof(double) * n);
+    bmedian = (float *) malloc(sizeof(float) * n);
+    forward = (float *) malloc(sizeof(float) * n * PROBES_PER_ROUND);
+    reverse = (float *) malloc(sizeof(float) * n * PROBES_PER_ROUND);
+    ref_forward = (float *) malloc(sizeof(float) * n * PROBES_PER_ROUND);
+    ref_reverse = (float *) malloc(sizeof(float) * n * PROBES_PER_ROUND);
+    if ( batch_init(&b, n) < 0 ) {
+        perror("batch_init");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("# %d peers, %d samples each, %d iterations, default kernel %s\n", n, PROBES_PER_ROUND, iterations,
+           batch_kernel());
+
+    start = now_s();
+    for ( it = 0; it < iterations; it++ )
+        sink += round_scalar(&r, median);
+    base_ns = ( now_s() - start ) * 1e9 / iterations / n;
+    printf("%-28s %8.1f ns/peer\n", "timeval_diff + quick_select", base_ns);
+
+    for ( q = 0; q < 3; q++ ) {
+        if ( batch_use(names[q]) < 0 ) {
+            printf("%-28s not supported\n", names[q]);
+            continue;
+        }
+        start = now_s();
+        for ( it = 0; it < iterations; it++ )
+            round_batch(&r, &b, forward, reverse, bmedian);
+        ns = ( now_s() - start ) * 1e9 / iterations / n;
+
+        if ( q == 0 ) {
+            memcpy(ref_forward, forward, sizeof(float) * n * PROBES_PER_ROUND);
+            memcpy(ref_reverse, reverse, sizeof(float) * n * PROBES_PER_ROUND);
+            /* the medians quick_select_median() picks from the same split */
+            for ( i = 0; i < n; i++ ) {
+                for ( k = 0; k < PROBES_PER_ROUND; k++ )
+                    diff[k] = forward[k * n + i];
+                scaled[i] = quick_select_median(diff, PROBES_PER_ROUND);
+            }
+        }
+        for ( i = 0, worst = 0; i < n * PROBES_PER_ROUND; i++ ) {
+            worst = fmax(worst, fabs(forward[i] - ref_forward[i]));
+            worst = fmax(worst, fabs(reverse[i] - ref_reverse[i]));
+        }
+        for ( i = 0, mismatch = 0; i < n; i++ )
+            if ( (float) scaled[i] != bmedian[i] )
+                mismatch++;
+        printf("%-28s %8.1f ns/peer  x%.1f  max |delta| %.2g ms, %d median mismatches\n", names[q], ns,
+               base_ns / ns, worst, mismatch);
+    }
+
+    if ( sink == 42 )
+        printf("\n");
+    batch_free(&b);
+    return 0;
+}
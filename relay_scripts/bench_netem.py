@@ -0,0 +1,359 @@
+#!/usr/bin/python
+
+###############################################################################################################
+## [Title]: bench_netem.py -- the agent on an emulated overlay of network namespaces
+## [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+##-------------------------------------------------------------------------------------------------------------
+## [Details]:
+## Builds server.out and starts n relays, each a daemon in a network namespace of its own (cxpb0, cxpb1, ...),
+## every pair of them joined by a veth pair. tc netem gives every direction of every link a known one way
+## delay (random between --min and --max ms, so the two directions differ), jitter and loss. The relays get
+## their peer lists with the controller's ids, the script plays the controller: it takes their binary
+## reports on port 32032 over a management veth of every namespace, and after --duration seconds prints what
+## they measured against what was configured.
+##
+## The JSON on stdout (or -o file) has one entry per directed edge (configured, forward and reverse medians,
+## their errors, loss, samples and when the edge first came within --tolerance ms) and a summary:
+##
+##     accuracy     median/p90/max absolute error of the forward and reverse delays, in ms
+##     convergence  seconds from the d command to the first report within tolerance, median and max
+##     reflector    probes answered per second, all relays and per relay (cxp_reflector_replies_total)
+##     cpu          CPU of an agent in % of a core, per relay and per peer (/proc/pid/stat)
+##
+## so two runs of the same --seed can be diffed for regressions. A human readable table goes to stderr. Needs
+## root, iproute2 and the sch_netem module; --no-netem runs the same topology without delays (everything
+## configured at 0 ms), e.g. on a kernel without netem.
+##
+##     sudo python bench_netem.py [-n 4] [-C 100] [-R 1000] [-d 30] [--jitter 1] [--loss 0.5] [-a "-k -w 2"]
+##-------------------------------------------------------------------------------------------------------------
+## [Warning]:
+## This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+## secured. Feel free to change or improve it any way you see fit.
+##-------------------------------------------------------------------------------------------------------------
+## [Modification, Distribution, and Attribution]:
+## You are free to modify and/or distribute this script as you wish.  I only ask that you maintain original
+## author attribution.
+###############################################################################################################
+
+from __future__ import print_function
+
+import os
+import sys
+import json
+import time
+import random
+import select
+import socket
+import struct
+import shutil
+import tempfile
+import optparse
+import subprocess
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+CONTROLLER_PORT = 32032
+CONTROL_PORT = 32034
+METRICS_PORT = 9464
+NAMESPACE = 'cxpb%d'
+
+# relay_scripts/report.h, as CXP.py decodes it
+REPORT_MAGIC = 0x43585052
+REPORT_KIND_DELAY = 1
+REPORT_KIND_STATS = 2
+REPORT_HEADER = struct.Struct('!IBBBBHHIHH')
+REPORT_DELAY = struct.Struct('!HHHHII')
+REPORT_STATS = struct.Struct('!HBBIIIIIII')
+STATS_REVERSE = 1
+
+def run(*args):
+    subprocess.check_call(list(args))
+
+def netns(i, *args):
+    run('ip', 'netns', 'exec', NAMESPACE % i, *args)
+
+def address(net, k, host):
+    '''
+        Host 1 or 2 of the k-th /30 of 10.net.0.0/16.
+    '''
+    a = 4 * k + host
+    return '10.%d.%d.%d' % (net, a >> 8, a & 0xff)
+
+def in_netns(i, code):
+    '''
+        Run a python snippet inside relay i's namespace, where the agent's control and metrics ports are.
+    '''
+    return subprocess.check_output(['ip', 'netns', 'exec', NAMESPACE % i, sys.executable, '-c', code])
+
+def send_command(i, command):
+    in_netns(i, "import socket; socket.socket(socket.AF_INET, socket.SOCK_DGRAM).sendto(%r, ('127.0.0.1', %d))" %
+             (command.encode(), CONTROL_PORT))
+
+def reflector_replies(i):
+    '''
+        Probes relay i's reflector answered so far, from its metrics.
+    '''
+    try:
+        text = in_netns(i, "import sys\ntry:\n from urllib2 import urlopen\nexcept ImportError:\n"
+                           " from urllib.request import urlopen\n"
+                           "sys.stdout.write(urlopen('http://127.0.0.1:%d/metrics', timeout=2).read().decode())"
+                           % METRICS_PORT).decode()
+    except subprocess.CalledProcessError:
+        return 0
+    return sum(float(line.split()[-1]) for line in text.splitlines()
+               if line.startswith('cxp_reflector_replies_total{'))
+
+def cpu_seconds(pid):
+    with open('/proc/%d/stat' % pid) as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / float(os.sysconf('SC_CLK_TCK'))
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+class Overlay(object):
+    '''
+        The namespaces, links and agents of one run. link[i][j] is the address relay i probes relay j at and
+        delay[i][j] the one way delay configured from i to j, in ms.
+    '''
+    def __init__(self, opts):
+        self.opts = opts
+        self.n = opts.relays
+        self.delay = [[0.] * self.n for i in range(self.n)]
+        self.link = [[None] * self.n for i in range(self.n)]
+        self.controller = [None] * self.n
+        self.agents = []
+        self.workdir = tempfile.mkdtemp(prefix='cxpb')
+
+    def create(self):
+        opts = self.opts
+        rnd = random.Random(opts.seed)
+        self.destroy()
+        for i in range(self.n):
+            run('ip', 'netns', 'add', NAMESPACE % i)
+            netns(i, 'ip', 'link', 'set', 'lo', 'up')
+            # management link to the root namespace, where the reports go, without netem
+            run('ip', 'link', 'add', 'cxpbm%d' % i, 'type', 'veth', 'peer', 'name', 'mgmt', 'netns', NAMESPACE % i)
+            run('ip', 'addr', 'add', address(200, i, 1) + '/30', 'dev', 'cxpbm%d' % i)
+            run('ip', 'link', 'set', 'cxpbm%d' % i, 'up')
+            netns(i, 'ip', 'addr', 'add', address(200, i, 2) + '/30', 'dev', 'mgmt')
+            netns(i, 'ip', 'link', 'set', 'mgmt', 'up')
+            self.controller[i] = address(200, i, 1)
+
+        k = 0
+        for i in range(self.n):
+            for j in range(i + 1, self.n):
+                a, b = 'cxp%d-%d' % (i, j), 'cxp%d-%d' % (j, i)
+                run('ip', 'link', 'add', a, 'netns', NAMESPACE % i, 'type', 'veth', 'peer', 'name', b,
+                    'netns', NAMESPACE % j)
+                netns(i, 'ip', 'addr', 'add', address(201, k, 1) + '/30', 'dev', a)
+                netns(j, 'ip', 'addr', 'add', address(201, k, 2) + '/30', 'dev', b)
+                netns(i, 'ip', 'link', 'set', a, 'up')
+                netns(j, 'ip', 'link', 'set', b, 'up')
+                self.link[i][j] = address(201, k, 2)
+                self.link[j][i] = address(201, k, 1)
+                for src, dst, dev in ((i, j, a), (j, i, b)):
+                    if opts.netem:
+                        self.delay[src][dst] = round(rnd.uniform(opts.min_delay, opts.max_delay), 1)
+                        netem = ['delay', '%gms' % self.delay[src][dst]]
+                        if opts.jitter > 0:
+                            netem += ['%gms' % opts.jitter]
+                        if opts.loss > 0:
+                            netem += ['loss', '%g%%' % opts.loss]
+                        netns(src, 'tc', 'qdisc', 'add', 'dev', dev, 'root', 'netem', *netem)
+                k += 1
+
+    def start(self, binary):
+        for i in range(self.n):
+            args = ['ip', 'netns', 'exec', NAMESPACE % i, binary, '-D', '-c', str(CONTROL_PORT), '-m',
+                    str(METRICS_PORT), '-C', str(self.opts.interval), '-R', str(self.opts.report), '-H', '']
+            args += self.opts.agent_args.split()
+            log = open(os.path.join(self.workdir, 'relay%d.log' % i), 'w')
+            self.agents.append(subprocess.Popen(args, stdout=log, stderr=subprocess.STDOUT, cwd=self.workdir))
+        time.sleep(0.5)
+        for i, agent in enumerate(self.agents):
+            if agent.poll() is not None:
+                raise RuntimeError("relay %d exited, see %s" % (i, os.path.join(self.workdir, 'relay%d.log' % i)))
+
+    def configure(self, i):
+        peers = '|'.join('r%d:%s:%d' % (j, self.link[i][j], j) for j in range(self.n) if j != i)
+        send_command(i, 'd %d r%d %s %s %d' % (self.n - 1, i, peers, self.controller[i], i))
+
+    def destroy(self):
+        for agent in self.agents:
+            if agent.poll() is None:
+                agent.terminate()
+                agent.wait()
+        self.agents = []
+        for i in range(self.n):
+            # the veths go with their namespace
+            subprocess.call(['ip', 'netns', 'del', NAMESPACE % i], stderr=open(os.devnull, 'w'))
+
+def measure(overlay, opts):
+    n = overlay.n
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('0.0.0.0', CONTROLLER_PORT))
+
+    forward = {}        # (src, dst): (median ms, samples, loss)
+    reverse = {}        # (src, dst): median ms of the replies of dst to src
+    converged = {}      # (src, dst): seconds from src's d command
+    reports = 0
+
+    replies = [reflector_replies(i) for i in range(n)]
+    cpu = [cpu_seconds(agent.pid) for agent in overlay.agents]
+    configured = [None] * n
+    for i in range(n):
+        overlay.configure(i)
+        configured[i] = time.time()
+    start = time.time()
+
+    while time.time() < start + opts.duration:
+        ready, _, _ = select.select([sock], [], [], 0.2)
+        if not ready:
+            continue
+        data, address = sock.recvfrom(4096)
+        if len(data) < REPORT_HEADER.size:
+            continue
+        magic, version, kind, flags, pad, node, count, seq, fragment, fragments = REPORT_HEADER.unpack_from(data)
+        if magic != REPORT_MAGIC or node >= n:
+            continue
+        now = time.time()
+        if kind == REPORT_KIND_DELAY:
+            reports += 1
+            for k in range(min(count, (len(data) - REPORT_HEADER.size) // REPORT_DELAY.size)):
+                peer, samples, loss, reorder, median, p90 = REPORT_DELAY.unpack_from(data, REPORT_HEADER.size +
+                                                                                    k * REPORT_DELAY.size)
+                if peer >= n or samples == 0:
+                    continue
+                edge = (node, peer)
+                forward[edge] = (median / 1e6, samples, loss / 65535.)
+                if edge not in converged and abs(median / 1e6 - overlay.delay[node][peer]) <= opts.tolerance:
+                    converged[edge] = now - configured[node]
+        elif kind == REPORT_KIND_STATS:
+            for k in range(min(count, (len(data) - REPORT_HEADER.size) // REPORT_STATS.size)):
+                fields = REPORT_STATS.unpack_from(data, REPORT_HEADER.size + k * REPORT_STATS.size)
+                if fields[0] < n and fields[1] == STATS_REVERSE and fields[3] > 0:
+                    reverse[(node, fields[0])] = fields[5] / 1e6
+    elapsed = time.time() - start
+    replies = [reflector_replies(i) - replies[i] for i in range(n)]
+    cpu = [cpu_seconds(agent.pid) - cpu[i] for i, agent in enumerate(overlay.agents)]
+    sock.close()
+
+    edges = []
+    for src in range(n):
+        for dst in range(n):
+            if src == dst:
+                continue
+            edge = {'src': src, 'dst': dst, 'configured_ms': overlay.delay[src][dst],
+                    'configured_reverse_ms': overlay.delay[dst][src], 'forward_ms': None, 'reverse_ms': None,
+                    'forward_error_ms': None, 'reverse_error_ms': None, 'loss': None, 'samples': 0,
+                    'converged_s': converged.get((src, dst))}
+            if (src, dst) in forward:
+                edge['forward_ms'], edge['samples'], edge['loss'] = forward[(src, dst)]
+                edge['forward_error_ms'] = edge['forward_ms'] - overlay.delay[src][dst]
+            if (src, dst) in reverse:
+                edge['reverse_ms'] = reverse[(src, dst)]
+                edge['reverse_error_ms'] = edge['reverse_ms'] - overlay.delay[dst][src]
+            edges.append(edge)
+
+    def spread(values):
+        return {'median': percentile(values, 0.5), 'p90': percentile(values, 0.9),
+                'max': max(values) if values else None}
+
+    times = [e['converged_s'] for e in edges if e['converged_s'] is not None]
+    summary = {
+        'reports': reports,
+        'edges': len(edges),
+        'measured': len(forward),
+        'forward_error_ms': spread([abs(e['forward_error_ms']) for e in edges if e['forward_error_ms'] is not None]),
+        'reverse_error_ms': spread([abs(e['reverse_error_ms']) for e in edges if e['reverse_error_ms'] is not None]),
+        'converged': len(times),
+        'convergence_s': {'median': percentile(times, 0.5), 'max': max(times) if len(times) == len(edges) else None},
+        'reflector_pps': sum(replies) / elapsed,
+        'reflector_pps_per_relay': sum(replies) / elapsed / n,
+        'cpu_percent_per_relay': sum(cpu) / elapsed / n * 100,
+        'cpu_percent_per_peer': sum(cpu) / elapsed / n / max(n - 1, 1) * 100,
+    }
+    return edges, summary
+
+def print_table(edges, summary, out):
+    fmt = lambda v, f='%.3f': '-' if v is None else f % v
+    print("%4s %4s %10s %10s %10s %10s %10s %8s %10s" % ("src", "dst", "conf ms", "fwd ms", "fwd err", "rev ms",
+                                                         "rev err", "loss", "conv s"), file=out)
+    for e in edges:
+        print("%4d %4d %10.2f %10s %10s %10s %10s %8s %10s" % (e['src'], e['dst'], e['configured_ms'],
+              fmt(e['forward_ms']), fmt(e['forward_error_ms']), fmt(e['reverse_ms']), fmt(e['reverse_error_ms']),
+              fmt(e['loss'], '%.3f'), fmt(e['converged_s'], '%.1f')), file=out)
+    print("%d/%d edge(s) measured, %d converged (median %s s, max %s s); |error| forward median %s p90 %s ms, "
+          "reverse median %s p90 %s ms" % (summary['measured'], summary['edges'], summary['converged'],
+          fmt(summary['convergence_s']['median'], '%.1f'), fmt(summary['convergence_s']['max'], '%.1f'),
+          fmt(summary['forward_error_ms']['median']), fmt(summary['forward_error_ms']['p90']),
+          fmt(summary['reverse_error_ms']['median']), fmt(summary['reverse_error_ms']['p90'])), file=out)
+    print("reflectors %.0f probe(s)/s (%.1f per relay), agent CPU %.2f%% per relay, %.3f%% per peer" % (
+          summary['reflector_pps'], summary['reflector_pps_per_relay'], summary['cpu_percent_per_relay'],
+          summary['cpu_percent_per_peer']), file=out)
+
+def main():
+    parser = optparse.OptionParser()
+    parser.add_option('-n', '--relays', type='int', default=4)
+    parser.add_option('-C', '--interval', type='int', default=100, help='ms between the probes of a peer (-C)')
+    parser.add_option('-R', '--report', type='int', default=1000, help='ms between the reports (-R)')
+    parser.add_option('-d', '--duration', type='float', default=30, help='seconds of measurement')
+    parser.add_option('--min', dest='min_delay', type='float', default=5, help='lowest one way delay, ms')
+    parser.add_option('--max', dest='max_delay', type='float', default=50, help='highest one way delay, ms')
+    parser.add_option('--jitter', type='float', default=1, help='netem jitter, ms')
+    parser.add_option('--loss', type='float', default=0.5, help='netem loss, %')
+    parser.add_option('--tolerance', type='float', default=1, help='ms from the configured delay to converge')
+    parser.add_option('--seed', type='int', default=1)
+    parser.add_option('--no-netem', dest='netem', action='store_false', default=True)
+    parser.add_option('--no-build', dest='build', action='store_false', default=True)
+    parser.add_option('-b', '--binary', default=os.path.join(HERE, 'server.out'))
+    parser.add_option('-a', '--agent-args', default='', help='more options of server.out')
+    parser.add_option('-o', '--output', help='JSON file, stdout by default')
+    parser.add_option('-k', '--keep', action='store_true', help='leave the namespaces up')
+    opts, args = parser.parse_args()
+
+    if os.geteuid() != 0:
+        print("needs root for the namespaces and netem", file=sys.stderr)
+        return 1
+    if opts.relays < 2:
+        print("needs at least 2 relays", file=sys.stderr)
+        return 1
+    if opts.build:
+        run('make', '-s', '-C', HERE, 'epoll')
+
+    overlay = Overlay(opts)
+    done = False
+    try:
+        overlay.create()
+        overlay.start(os.path.abspath(opts.binary))
+        edges, summary = measure(overlay, opts)
+        done = True
+    except subprocess.CalledProcessError as e:
+        print("%s failed%s" % (' '.join(e.cmd), ", is sch_netem there? --no-netem runs without it"
+                                if 'netem' in e.cmd else ''), file=sys.stderr)
+        return 1
+    finally:
+        if not opts.keep:
+            overlay.destroy()
+        # the logs of the agents stay for a run that failed
+        if done and not opts.keep:
+            shutil.rmtree(overlay.workdir, True)
+
+    print_table(edges, summary, sys.stderr)
+    result = {'config': {'relays': opts.relays, 'interval_ms': opts.interval, 'report_ms': opts.report,
+                         'duration_s': opts.duration, 'jitter_ms': opts.jitter if opts.netem else 0,
+                         'loss_percent': opts.loss if opts.netem else 0, 'seed': opts.seed, 'netem': opts.netem,
+                         'tolerance_ms': opts.tolerance, 'agent_args': opts.agent_args},
+              'edges': edges, 'summary': summary}
+    out = open(opts.output, 'w') if opts.output else sys.stdout
+    json.dump(result, out, indent=1, sort_keys=True)
+    out.write('\n')
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,122 @@
+/**
+ * [Title]: clock.c -- clock offset and skew of a peer from the four probe timestamps
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * See clock.h. The fit is redone when an epoch closes, which is at most once per CLOCK_EPOCH_MS per peer;
+ * until the first epoch closes the best sample so far stands in for it.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <string.h>
+#include <math.h>
+
+#include "clock.h"
+
+void clock_init(peer_clock *c)
+{
+    memset(c, 0, sizeof(*c));
+}
+
+static void clock_fit(peer_clock *c)
+{
+    double sum_t = 0, sum_o = 0, stt = 0, sto = 0, dt, residual, max_residual = 0, min_delay = INFINITY;
+    int i;
+
+    for ( i = 0; i < c->npoints; i++ ) {
+        sum_t += c->points[i].t;
+        sum_o += c->points[i].offset;
+        if ( c->points[i].delay < min_delay )
+            min_delay = c->points[i].delay;
+    }
+    c->t_mean = sum_t / c->npoints;
+    c->offset = sum_o / c->npoints;
+
+    for ( i = 0; i < c->npoints; i++ ) {
+        dt = c->points[i].t - c->t_mean;
+        stt += dt * dt;
+        sto += dt * (c->points[i].offset - c->offset);
+    }
+    /* points closer than a second apart say nothing about the skew */
+    c->skew = stt > 1 ? sto / stt : 0;
+
+    for ( i = 0; i < c->npoints; i++ ) {
+        residual = fabs(c->points[i].offset - c->offset - c->skew * (c->points[i].t - c->t_mean));
+        if ( residual > max_residual )
+            max_residual = residual;
+    }
+    c->min_delay = min_delay;
+    c->error = min_delay / 2 + max_residual;
+}
+
+static double clock_offset_at(const peer_clock *c, double t)
+{
+    if ( c->npoints == 0 )
+        return c->candidate.offset;
+    return c->offset + c->skew * (t - c->t_mean);
+}
+
+/*
+ * Feed one exchange (t1..t4 in ns, t2 and t3 on the peer's clock) and split its round trip into the forward
+ * and reverse delays in ms with the fitted offset.
+ */
+void clock_add(peer_clock *c, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4, double *forward, double *reverse)
+{
+    clock_point p;
+    double offset, fwd;
+
+    if ( c->base == 0 ) {
+        c->base = t1;
+        c->epoch_end = t1 + CLOCK_EPOCH_MS * 1000000ULL;
+    }
+
+    p.t = ( (int64_t) (t1 - c->base) ) / 1e9;
+    p.offset = ( (double) (int64_t) (t2 - t1) + (double) (int64_t) (t3 - t4) ) / 2;
+    p.delay = (double) (int64_t) (t4 - t1) - (double) (int64_t) (t3 - t2);
+    if ( p.delay < 0 )
+        p.delay = 0;
+
+    if ( t1 >= c->epoch_end && c->has_candidate ) {
+        c->points[c->next] = c->candidate;
+        c->next = (c->next + 1) % CLOCK_POINTS;
+        if ( c->npoints < CLOCK_POINTS )
+            c->npoints++;
+        c->has_candidate = 0;
+        c->epoch_end = t1 + CLOCK_EPOCH_MS * 1000000ULL;
+        clock_fit(c);
+    }
+    if ( !c->has_candidate || p.delay < c->candidate.delay ) {
+        c->candidate = p;
+        c->has_candidate = 1;
+    }
+
+    offset = clock_offset_at(c, p.t);
+    fwd = (double) (int64_t) (t2 - t1) - offset;
+    if ( fwd < 0 )
+        fwd = 0;
+    if ( fwd > p.delay )
+        fwd = p.delay;
+
+    *forward = fwd / 1e6;
+    *reverse = (p.delay - fwd) / 1e6;
+}
+
+void clock_estimate_at(const peer_clock *c, uint64_t now, clock_estimate *out)
+{
+    memset(out, 0, sizeof(*out));
+    if ( !c->has_candidate && c->npoints == 0 )
+        return;
+
+    out->points = c->npoints;
+    out->offset = clock_offset_at(c, ( (int64_t) (now - c->base) ) / 1e9) / 1e6;
+    out->skew = c->npoints ? c->skew / 1e3 : 0;
+    out->error = ( c->npoints ? c->error : c->candidate.delay / 2 ) / 1e6;
+    out->min_delay = ( c->npoints ? c->min_delay : c->candidate.delay ) / 1e6;
+}
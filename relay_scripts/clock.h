@@ -0,0 +1,61 @@
+/**
+ * [Title]: clock.h -- clock offset and skew of a peer from the four probe timestamps
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Every reply gives the NTP pair offset = ((t2 - t1) + (t3 - t4)) / 2 and delay = (t4 - t1) - (t3 - t2), and
+ * the true offset is within offset +- delay / 2. The samples of each CLOCK_EPOCH_MS are reduced to the one with
+ * the smallest delay (queueing only ever adds to it), and a least squares line through the last CLOCK_POINTS
+ * of those minima gives the offset and skew of the peer's clock at any time. The forward and reverse delays of
+ * a sample are then split with the fitted offset instead of the sample's own, with an error bound of half the
+ * smallest delay of the fit plus its residual.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_CLOCK_H
+#define CXP_CLOCK_H
+
+#include <stdint.h>
+
+#define CLOCK_POINTS            32
+#define CLOCK_EPOCH_MS          1000
+
+typedef struct clock_point {
+    double t;                   /* s since base */
+    double offset;              /* ns */
+    double delay;               /* ns */
+} clock_point;
+
+typedef struct peer_clock {
+    uint64_t base;              /* local ns of the first sample */
+    uint64_t epoch_end;         /* local ns */
+    clock_point candidate;      /* smallest delay of the current epoch */
+    int has_candidate;
+    clock_point points[CLOCK_POINTS];
+    int npoints, next;
+    double offset, skew;        /* fit: offset (ns) at t_mean (s) + skew (ns/s) * (t - t_mean) */
+    double t_mean;
+    double error;               /* ns */
+    double min_delay;           /* ns, smallest delay of the fit */
+} peer_clock;
+
+typedef struct clock_estimate {
+    int points;
+    double offset;              /* ms, peer clock - local clock, now */
+    double skew;                /* ppm */
+    double error;               /* ms */
+    double min_delay;           /* ms */
+} clock_estimate;
+
+void clock_init(peer_clock *c);
+void clock_add(peer_clock *c, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4, double *forward, double *reverse);
+void clock_estimate_at(const peer_clock *c, uint64_t now, clock_estimate *out);
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * [Title]: coord.c -- Vivaldi network coordinates of the relays
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * The update of coord.h with the height vectors of the Vivaldi paper: the direction from the remote to us is
+ * (v - remote.v, height + remote.height), so a round trip longer than the distance pushes the point away and
+ * raises the height, a shorter one pulls it in and lowers it. Two relays at the same point are split in a
+ * random direction.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "coord.h"
+
+static coord local = { { 0 }, COORD_MIN_HEIGHT, 1.0, 0 };
+static pthread_mutex_t local_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int seed = 1;
+
+void coord_init(coord *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->height = COORD_MIN_HEIGHT;
+    c->error = 1.0;
+}
+
+static double vector_length(const coord *a, const coord *b, double *diff)
+{
+    double sum = 0;
+    int i;
+
+    for ( i = 0; i < COORD_DIMS; i++ ) {
+        diff[i] = a->v[i] - b->v[i];
+        sum += diff[i] * diff[i];
+    }
+    return sqrt(sum);
+}
+
+double coord_distance(const coord *a, const coord *b)
+{
+    double diff[COORD_DIMS];
+
+    return vector_length(a, b, diff) + a->height + b->height;
+}
+
+void coord_update(coord *c, const coord *remote, double rtt)
+{
+    double diff[COORD_DIMS], length, distance, weight, sample, force;
+    int i;
+
+    if ( rtt <= 0 || !isfinite(rtt) )
+        return;
+
+    length = vector_length(c, remote, diff);
+    distance = length + c->height + remote->height;
+    if ( length < 1e-6 ) {
+        for ( i = 0, length = 0; i < COORD_DIMS; i++ ) {
+            diff[i] = (double) rand_r(&seed) / RAND_MAX - 0.5;
+            length += diff[i] * diff[i];
+        }
+        for ( i = 0, length = sqrt(length); i < COORD_DIMS; i++ )
+            diff[i] /= length;
+        length = 1;
+    }
+
+    weight = c->error + remote->error > 0 ? c->error / ( c->error + remote->error ) : 0.5;
+    sample = fabs(distance - rtt) / rtt;
+    c->error = sample * COORD_CE * weight + c->error * ( 1 - COORD_CE * weight );
+    if ( c->error > COORD_MAX_ERROR )
+        c->error = COORD_MAX_ERROR;
+
+    /* along the unit vector of (diff, height sum), whose norm is length + the heights */
+    force = COORD_CC * weight * ( rtt - distance ) / ( length + c->height + remote->height );
+    for ( i = 0; i < COORD_DIMS; i++ )
+        c->v[i] += force * diff[i];
+    c->height += force * ( c->height + remote->height );
+    if ( c->height < COORD_MIN_HEIGHT )
+        c->height = COORD_MIN_HEIGHT;
+    c->updates++;
+}
+
+static void put32(uint8_t *b, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(b, &v, 4);
+}
+
+static uint32_t get32(const uint8_t *b)
+{
+    uint32_t v;
+
+    memcpy(&v, b, 4);
+    return ntohl(v);
+}
+
+/* ms to signed us, saturated */
+static uint32_t ms_to_us(double ms)
+{
+    double us = ms * 1000;
+
+    return (uint32_t) (int32_t) ( us > INT32_MAX ? INT32_MAX : us < -INT32_MAX ? -INT32_MAX : lround(us) );
+}
+
+size_t coord_encode(void *buf, const coord *c)
+{
+    uint8_t *b = (uint8_t *) buf;
+    int i;
+
+    for ( i = 0; i < COORD_DIMS; i++ )
+        put32(b + 4 * i, ms_to_us(c->v[i]));
+    put32(b + 12, ms_to_us(c->height));
+    put32(b + 16, (uint32_t) lround(c->error * 1e6));
+    put32(b + 20, c->updates);
+    return COORD_WIRE_SIZE;
+}
+
+void coord_decode(const void *buf, coord *c)
+{
+    const uint8_t *b = (const uint8_t *) buf;
+    int i;
+
+    for ( i = 0; i < COORD_DIMS; i++ )
+        c->v[i] = (int32_t) get32(b + 4 * i) / 1000.0;
+    c->height = (int32_t) get32(b + 12) / 1000.0;
+    c->error = get32(b + 16) / 1e6;
+    c->updates = get32(b + 20);
+}
+
+void coord_local(coord *c)
+{
+    pthread_mutex_lock(&local_lock);
+    *c = local;
+    pthread_mutex_unlock(&local_lock);
+}
+
+/* A round trip (ms) to a peer at remote. A peer that never measured anything is not worth moving for. */
+void coord_observe(const coord *remote, double rtt)
+{
+    pthread_mutex_lock(&local_lock);
+    if ( remote->updates > 0 || local.updates == 0 )
+        coord_update(&local, remote, rtt);
+    pthread_mutex_unlock(&local_lock);
+}
@@ -0,0 +1,62 @@
+/**
+ * [Title]: coord.h -- Vivaldi network coordinates of the relays
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Every relay keeps a point in COORD_DIMS dimensions plus a height (the delay of its access link), such that
+ * the round trip between two relays is close to
+ *
+ *     distance(a, b) = |a.v - b.v| + a.height + b.height
+ *
+ * Each measured round trip to a peer whose coordinate is known moves ours along the line between the two by
+ * COORD_CC of the error, weighted by how sure we are compared to the peer; the relative error is tracked the
+ * same way (COORD_CE) and starts at 1, so a new relay moves a lot and a settled one little.
+ *
+ * The reflector appends its coordinate to every probe reply that asks for it (PROBE_F_COORD), so the agent
+ * learns the coordinates of its peers without any more traffic, and reports its own to the controller, which
+ * predicts the edges nobody probed from them.
+ *
+ * Wire format (COORD_WIRE_SIZE bytes, network byte order): v[0..2] (us, signed 32 bit), height (us), error
+ * (x 1e-6), updates.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_COORD_H
+#define CXP_COORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define COORD_DIMS              3
+#define COORD_WIRE_SIZE         24
+#define COORD_CC                0.25            /* step, of the error */
+#define COORD_CE                0.25            /* weight of a new sample in the error */
+#define COORD_MIN_HEIGHT        0.01            /* ms */
+#define COORD_MAX_ERROR         1.5
+
+typedef struct coord {
+    double v[COORD_DIMS];           /* ms */
+    double height;                  /* ms */
+    double error;                   /* relative */
+    uint32_t updates;
+} coord;
+
+void coord_init(coord *c);
+double coord_distance(const coord *a, const coord *b);
+void coord_update(coord *c, const coord *remote, double rtt);
+
+size_t coord_encode(void *buf, const coord *c);
+void coord_decode(const void *buf, coord *c);
+
+/* the coordinate of this relay, shared by the agent's workers and the reflector */
+void coord_local(coord *c);
+void coord_observe(const coord *remote, double rtt);
+
+#endif
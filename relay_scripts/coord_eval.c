@@ -0,0 +1,245 @@
+/**
+ * [Title]: coord_eval.c -- accuracy of the Vivaldi coordinates against a full mesh
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Runs the coordinates of coord.h the way the agents do with -V sample: every round each relay probes the
+ * sample peers after round * sample in the order of relay distances, PROBES_PER_ROUND probes each, and moves
+ * its coordinate with every reply. The ground truth is the full mesh of round trips, read from -f (n lines of
+ * n round trips in ms, "-" or nan for an edge that was not measured) or made up for -n relays: cities on a
+ * sphere at fiber speed, an access delay per relay, a detour factor per edge and jitter per probe.
+ *
+ * Every -e rounds it prints the probes sent so far against what the full mesh sends in as many rounds, and
+ * the relative error |predicted - measured| / measured over all the edges and over the ones never probed,
+ * with the share of edges the controller would flag (see COORD_DISAGREE in CXP.py).
+ *
+ * Usage: ./coord_eval [-f rtt_matrix | -n relays] [-k sample] [-r rounds] [-e every] [-j jitter] [-s seed]
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "coord.h"
+
+#define PROBES_PER_ROUND    10
+#define CITIES              40
+#define EARTH_RTT_MS        200.0           /* round trip to the antipode over fiber, roughly */
+#define DISAGREE_RATIO      0.5             /* CXP.py COORD_DISAGREE_RATIO */
+#define DISAGREE_MS         5.0             /* CXP.py COORD_DISAGREE_MS */
+
+static unsigned int seed = 1;
+
+static double uniform()
+{
+    return (double) rand_r(&seed) / RAND_MAX;
+}
+
+static double *synthetic_mesh(int n)
+{
+    double city[CITIES][3], *rtt = (double *) malloc((size_t) n * n * sizeof(double)), *access;
+    double z, phi, dot;
+    int *home = (int *) malloc(n * sizeof(int)), i, j;
+
+    access = (double *) malloc(n * sizeof(double));
+    for ( i = 0; i < CITIES; i++ ) {
+        z = 2 * uniform() - 1;
+        phi = 2 * M_PI * uniform();
+        city[i][0] = sqrt(1 - z * z) * cos(phi);
+        city[i][1] = sqrt(1 - z * z) * sin(phi);
+        city[i][2] = z;
+    }
+    for ( i = 0; i < n; i++ ) {
+        home[i] = rand_r(&seed) % CITIES;
+        access[i] = 0.2 + 4 * uniform() * uniform();
+    }
+    for ( i = 0; i < n; i++ )
+        for ( j = 0; j <= i; j++ ) {
+            dot = city[home[i]][0] * city[home[j]][0] + city[home[i]][1] * city[home[j]][1] +
+                  city[home[i]][2] * city[home[j]][2];
+            dot = dot > 1 ? 1 : dot < -1 ? -1 : dot;
+            rtt[(size_t) i * n + j] = rtt[(size_t) j * n + i] = i == j ? 0 :
+                EARTH_RTT_MS * acos(dot) / M_PI * ( 1 + 0.6 * uniform() * uniform() ) + access[i] + access[j] + 0.1;
+        }
+    free(home);
+    free(access);
+    return rtt;
+}
+
+static double *read_mesh(const char *path, int *n)
+{
+    FILE *f = fopen(path, "r");
+    double *rtt = NULL;
+    char word[64];
+    int count = 0, size = 0, i;
+
+    if ( !f ) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    while ( fscanf(f, "%63s", word) == 1 ) {
+        if ( count == size ) {
+            size = size ? size * 2 : 1024;
+            rtt = (double *) realloc(rtt, size * sizeof(double));
+        }
+        rtt[count++] = strcmp(word, "-") == 0 ? NAN : atof(word);
+    }
+    fclose(f);
+    for ( i = 1; i * i < count; i++ )
+        ;
+    if ( i * i != count ) {
+        fprintf(stderr, "%s: %d values is not a square matrix\n", path, count);
+        exit(EXIT_FAILURE);
+    }
+    *n = i;
+    return rtt;
+}
+
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* the slot of peer j of relay i in a round, as in peer_slot() of epoll_server.c */
+static int slot(int i, int j, int n, int sample, int round)
+{
+    int d = ( ( j - i ) % n + n ) % n, span = n - 1, k;
+
+    if ( d == 0 )
+        return -1;
+    if ( sample <= 0 || sample >= span )
+        return ( d - 1 + round ) % span;
+    k = (int) ( ( d - 1 - (long long) round * sample ) % span );
+    k = k < 0 ? k + span : k;
+    return k < sample ? k : -1;
+}
+
+static void report(int round, int n, const double *rtt, const coord *c, const char *probed, long long probes,
+                   double *errors, double *unprobed)
+{
+    long long full = (long long) round * n * ( n - 1 ) * PROBES_PER_ROUND;
+    int i, j, ne = 0, nu = 0, flagged = 0;
+    double truth, predicted, e;
+
+    for ( i = 0; i < n; i++ )
+        for ( j = 0; j < n; j++ ) {
+            truth = rtt[(size_t) i * n + j];
+            if ( i == j || !isfinite(truth) || truth <= 0 )
+                continue;
+            predicted = coord_distance(&c[i], &c[j]);
+            errors[ne++] = e = fabs(predicted - truth) / truth;
+            if ( !probed[(size_t) i * n + j] )
+                unprobed[nu++] = e;
+            if ( e > DISAGREE_RATIO && fabs(predicted - truth) > DISAGREE_MS )
+                flagged++;
+        }
+    qsort(errors, ne, sizeof(double), compare);
+    qsort(unprobed, nu, sizeof(double), compare);
+
+    printf("%5d %12lld %6.1fx %7.3f %7.3f %7.3f ", round, probes, probes ? (double) full / probes : 0,
+           ne ? errors[ne / 2] : 0, ne ? errors[ne * 9 / 10] : 0, ne ? errors[ne * 99 / 100] : 0);
+    if ( nu )
+        printf("%7.3f %7.3f ", unprobed[nu / 2], unprobed[nu * 9 / 10]);
+    else
+        printf("%7s %7s ", "-", "-");
+    printf("%6.2f%%\n", ne ? 100.0 * flagged / ne : 0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    double *rtt, *errors, *unprobed, jitter = 0.05, truth;
+    long long probes = 0;
+    coord *c;
+    char *probed;
+    int n = 500, sample = 0, rounds = 60, every = 5, opt, round, i, j, p;
+
+    while ( ( opt = getopt(argc, argv, "f:n:k:r:e:j:s:") ) != -1 ) {
+        switch (opt) {
+        case 'f':
+            path = optarg;
+            break;
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'k':
+            sample = atoi(optarg);
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            break;
+        case 'e':
+            every = atoi(optarg);
+            break;
+        case 'j':
+            jitter = atof(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-f rtt_matrix | -n relays] [-k sample] [-r rounds] [-e every] [-j jitter] [-s seed]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    rtt = path ? read_mesh(path, &n) : synthetic_mesh(n);
+    if ( n < 2 ) {
+        fprintf(stderr, "need at least 2 relays\n");
+        exit(EXIT_FAILURE);
+    }
+    if ( every < 1 )
+        every = 1;
+
+    c = (coord *) malloc(n * sizeof(coord));
+    probed = (char *) calloc((size_t) n * n, 1);
+    errors = (double *) malloc((size_t) n * n * sizeof(double));
+    unprobed = (double *) malloc((size_t) n * n * sizeof(double));
+    for ( i = 0; i < n; i++ )
+        coord_init(&c[i]);
+
+    if ( sample <= 0 || sample >= n - 1 )
+        sample = n - 1;
+    printf("# %d relays, %d peers per round, %d probes per peer, jitter %.0f%%\n", n, sample, PROBES_PER_ROUND,
+           jitter * 100);
+    printf("# round       probes saving  median     p90     p99   unprobed median/p90  flagged\n");
+
+    for ( round = 1; round <= rounds; round++ ) {
+        /* the replies of a round come back interleaved: probe p of every relay and peer before p + 1 */
+        for ( p = 0; p < PROBES_PER_ROUND; p++ )
+            for ( i = 0; i < n; i++ )
+                for ( j = 0; j < n; j++ ) {
+                    if ( slot(i, j, n, sample, round) < 0 )
+                        continue;
+                    truth = rtt[(size_t) i * n + j];
+                    probes++;
+                    probed[(size_t) i * n + j] = 1;
+                    if ( !isfinite(truth) || truth <= 0 )
+                        continue;
+                    /* as coord_observe() */
+                    if ( c[j].updates > 0 || c[i].updates == 0 )
+                        coord_update(&c[i], &c[j], truth * ( 1 + jitter * uniform() ));
+                }
+        if ( round % every == 0 || round == rounds )
+            report(round, n, rtt, c, probed, probes, errors, unprobed);
+    }
+
+    free(rtt);
+    free(c);
+    free(probed);
+    free(errors);
+    free(unprobed);
+    return 0;
+}
@@ -0,0 +1,2477 @@
+/**
+ * [Title]: epoll_server.c -- calculate the one way delays of the other VMs
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * A C program that connects to other VMs and requests for timestamps in order to calculate the one way delay.
+ * The results are then send to the CXP Controller which is going to save them and use them in order to path
+ * stich the lowest latency path when needed.
+ *
+ * Instead of one thread per remote VM this version keeps the state of every peer in a single array and runs
+ * all the probe state machines from an epoll/timerfd event loop. With -t N the peers are split between N
+ * worker threads, each one owning a contiguous slice of the array.
+ *
+ * The probes use the wide format of probe.h: each one carries a sequence number and the peer id, up to
+ * PROBE_WINDOW of them are in flight per peer, and the 10 probes of a round leave PROBE_SPACING_MS apart
+ * instead of one RTT apart. A probe that is not answered within PROBE_TIMEOUT_MS is lost; replies that come
+ * after that, twice, or for a probe of another peer are dropped. Loss, late and duplicate replies and
+ * reordering are counted per peer. The reflector still answers the old 2 x uint32 probes of server.c.
+ *
+ * The four timestamps of every reply also feed the clock estimator of clock.h, which tracks the offset and skew
+ * of each peer's clock; the round trip is split into the forward and reverse delays with that estimate, and
+ * the binary report carries it with its error bound.
+ *
+ * With -k every timestamp is a kernel software timestamp (client TX/RX, reflector RX) at nanosecond
+ * resolution, so the scheduling and syscall latency of a busy VM stays out of the samples.
+ *
+ * With -w N the reflector drains and answers the probes in batches from N pinned SO_REUSEPORT workers
+ * (see reflector.c) instead of a single one_way_server thread. With -X ifname they take the probes from
+ * PACKET_MMAP rings of that interface (ring.h), below the IP/UDP stack, or from the sockets if that fails.
+ *
+ * With -D the program does not exit after one round. It keeps its sockets, threads and peer state, and
+ * listens on the control port (127.0.0.1:32034, -c to change the port) for commands from server.py:
+ *
+ *     d <total_servers> <name> <name:ip|name:ip|...> <controller_ip>
+ *
+ * which start a measurement round right away. The threads sleep on epoll/timerfd/eventfd between rounds.
+ * A d command with another list than the previous one only adds and removes the peers that differ, by name.
+ * The peer set also changes on its own, while rounds run, with
+ *
+ *     a <name:ip[:id]|...>     add these peers, or move the known ones to the address and id given; a new
+ *                              peer without an id gets the next one above all the ids in use
+ *     u <name:ip[:id]|...>     move known peers only
+ *     r <name|...>             remove these peers
+ *
+ * The other peers keep their socket, delay window, clock estimate and schedule; the workers are only locked
+ * while the array is swapped (install_peers()), and a peer that joins starts probing right away.
+ *
+ * A round that comes with a node_id (the controller's numbering of the relays, given as name:ip:id in the peer
+ * list and as the trailing node_id) is reported with the binary report of report.h (median, p90, loss and
+ * sample count per peer) instead of the text one; -b forces it for all rounds. With -u ms only the peers whose median moved by more than ms
+ * since they were last reported are sent, with a full report every REPORT_FULL_EVERY rounds. The binary report
+ * is followed by a stats report (min, median, p90, p99, EWMA and jitter of the forward, reverse and RTT delays)
+ * and a clock report (offset, skew and error bound of every peer's clock).
+ * A peer that loses LINK_DOWN_LOSSES probes in a row is reported down at once, in a link report of its own,
+ * and up again with its first reply, so the controller can fail the flows over within about a second (with
+ * -C 100, the probe timeout and two more probes) instead of at the next round.
+ *
+ * With -S slot_ms (or a schedule in the d command) the rounds of all the agents are staggered so that no two
+ * senders probe the same reflector at once, see plan_round(). How long the probes waited in the reflectors
+ * is a fourth metric of the stats report (turnaround, t3 - t2), left out for the reflectors that do not stamp
+ * t2 in the kernel (-k or a ring), and the batched reflector prints the deepest queue it drained, to check that
+ * it works.
+ *
+ * The samples of every peer go to the streaming estimator of stats.h, which keeps the last -W ms (60 s by
+ * default, in a ring sized for what -W holds at -C) instead of the 10 samples of a round. With -C ms a daemon
+ * probes every peer continuously, one probe every ms, and a d command reports what is in the window right away
+ * instead of starting a 10 probe burst.
+ * A window of BATCH_SAMPLES samples or fewer, e.g. a round's, reports its exact median, which the kernels of
+ * batch.h work out for all the peers at once, instead of the histogram's.
+ * With -A max_ms as well the interval of every peer adapts between the two (see sched.h): a stable link is
+ * probed every max_ms, one whose delay jitters or moves every -C ms, and -R ms makes the daemon send a report
+ * on its own every ms so the controller sees the change within seconds. -B pps[:bytes_per_s] caps what the
+ * agent sends in all: every worker gets the share of its peers, stretches their intervals alike when they ask
+ * for more and holds back what a token bucket does not allow.
+ *
+ * Every probe is appended to the delay history of native/tsdb.h in ./logs/tsdb (-H to change, -H "" for
+ * none): time, our id, the peer's id and the rtt/forward/reverse delays, or loss 1 for a probe that timed out.
+ * native/tsdb_query scans and downsamples it. The workers do not append themselves: each one stages its records
+ * in a ring of its own, which a history thread drains into the tsdb every HISTORY_FLUSH_MS.
+ *
+ * An i command (i <ip,ip,...> <ip,ip,...>, "-" for none) pings the first list and traces the paths to the second
+ * from one raw socket in a thread of its own (icmp.h), instead of a ping or traceroute process per target. The
+ * results go to the same history: every ping as a sample from us to the target, and every probe of a trace as
+ * a record from the hop to the target with its TTL in the forward delay column (src ADDRESS_NONE and loss 1
+ * if nobody answered). Relays keep their ids, other addresses get one from ADDRESS_ID_BASE up, listed in the
+ * addresses file of the history directory.
+ *
+ * Every probe asks the reflector for its Vivaldi coordinate (coord.h) and moves ours with the round trip, and
+ * the binary report ends with our coordinate, from which the controller predicts the edges nobody measured.
+ * With -V sample (or a sample in the d command) only that many peers are probed per round, the next ones in
+ * the following round, so a large overlay costs sample instead of n - 1 probe streams per relay; in
+ * continuous mode the sample moves on with every -R report.
+ *
+ * With -T packets[:bytes[:budget]] every round also sends TRAINS_PER_PEER packet trains (train.h) to every
+ * peer in the sample, of that many probes of that many bytes (16 of 1200 by default), TRAIN_GAP_MS apart: the
+ * first back to back, the others paced at the capacity it found (train_pace()) by a thread of their own
+ * (train_pacer()), and never more than budget bytes of trains per round in all (1 MB by default, split among the
+ * workers like -B); a continuous daemon sends a round of them every -R ms (10 s without). The binary report
+ * carries the capacity and available bandwidth of every edge the trains reached. The dispersion needs the reflectors' kernel receive timestamps (-k, or a ring
+ * with -X): the batched reflector stamps a whole batch at once without them.
+ *
+ * With -M name every report also goes to our row of the shared memory delay matrix of native/shm.h (e.g.
+ * -M /cxp-delays), where local readers such as native/shm_dump see it without a report or a file.
+ *
+ * With -m port a daemon serves its own metrics (metrics.h) in the Prometheus text format on
+ * http://127.0.0.1:port/metrics: the probes sent, received, lost and late of every peer, the turnaround of our
+ * reflector, how long the send and receive syscalls take, how late the workers' timers fire and the CPU time of
+ * every thread, so a bad number can be told apart from a busy agent.
+ *
+ * Usage: ./server.out [-B pps[:bytes_per_s]] [-b [-u ms]] [-H history_dir] [-k] [-M shm_name] [-S slot_ms] [-T packets[:bytes[:budget]]] [-t threads] [-V sample] [-w reflector_workers] [-W window_ms] [-X ifname] <total_servers> <name> <name:ip[:id]|...> <controller_ip> [node_id]
+ *        ./server.out -D [-c control_port] [-m metrics_port] [-C interval_ms [-A max_ms[:sensitivity]] [-R report_ms]] [-B pps[:bytes_per_s]] [-b [-u ms]] [-H history_dir] [-k] [-M shm_name] [-S slot_ms] [-T packets[:bytes[:budget]]] [-t threads] [-V sample] [-w reflector_workers] [-W window_ms] [-X ifname]
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <math.h>
+
+#include "probe.h"
+#include "reflector.h"
+#include "report.h"
+#include "stats.h"
+#include "batch.h"
+#include "train.h"
+#include "clock.h"
+#include "sched.h"
+#include "coord.h"
+#include "icmp.h"
+#include "metrics.h"
+#include "shm.h"
+#include "tsdb.h"
+
+#define CONTROLLER_PORT     32032
+#define CONTROL_PORT        32034
+#define PROBES_PER_ROUND    10
+#define PROBE_WINDOW        8               /* probes in flight per peer */
+#define PROBE_SPACING_MS    1
+#define PROBE_TIMEOUT_MS    1000
+#define ROUND_DEADLINE_MS   20000
+#define MAX_WORKERS         64
+#define MAX_EVENTS          64
+#define TIMER_TOKEN         UINT32_MAX
+#define START_TOKEN         (UINT32_MAX - 1)
+#define PACED_TOKEN         (UINT32_MAX - 2)
+#define REPORT_FULL_EVERY   10
+#define STATS_WINDOW_MS     60000
+#define HISTORY_DIR         "./logs/tsdb"
+#define STAGGER_GUARD_MS    200                     /* between a d command and the slots it derives */
+#define SCHED_MIN_MS        100                     /* -C of -A without one */
+#define PROBE_BYTES         (PROBE_COORD_SIZE + 28) /* on the wire, with the IP and UDP headers */
+#define ADDRESS_ID_BASE     0x8000                  /* history ids of the ICMP targets and hops */
+#define ADDRESS_NONE        0xffff                  /* history src of a TTL nobody answered */
+#define HISTORY_RING        4096                    /* records a worker stages, a power of two */
+#define HISTORY_FLUSH_MS    100
+#define ADDRESSES_FILE      "addresses"
+#define MAX_PEER_ID         65536                   /* ids are 16 bit in the probes */
+#define METRICS_PAGE        ( 256 * 1024 )          /* first guess of a scrape's size */
+#define LINK_DOWN_LOSSES    3                       /* probes lost in a row that take a peer down */
+#define TRAIN_PACKETS       16                      /* -T defaults */
+#define TRAIN_SIZE          1200
+#define TRAIN_BUDGET        ( 1 << 20 )             /* bytes per round */
+#define TRAINS_PER_PEER     3                       /* per round */
+#define TRAIN_GAP_MS        10                      /* between the trains of a worker */
+#define TRAIN_PERIOD_MS     10000                   /* a round of trains in continuous mode without -R */
+#define TRAIN_PACE_MS       20                      /* longest paced train, else it goes back to back */
+#define PACE_SPIN_NS        50000                   /* the pacer sleeps until this close to a packet, then spins */
+
+enum { PEER_ACTIVE, PEER_DONE };
+enum { PEERS_REPLACE, PEERS_ADD, PEERS_UPDATE, PEERS_REMOVE };
+enum { COUNT_SENT, COUNT_RECEIVED, COUNT_LOST, COUNT_LATE, PEER_COUNTERS };
+enum { SLOT_FREE, SLOT_WAIT, SLOT_ANSWERED, SLOT_LOST };
+enum { JOB_QUEUED, JOB_DONE, JOB_ABANDONED };
+
+/* A probe in flight, at window[seq % PROBE_WINDOW] of its peer. */
+typedef struct probe_slot {
+    int state;
+    uint32_t seq;
+    uint32_t tx_id;                 /* SOF_TIMESTAMPING_OPT_ID of its datagram */
+    uint64_t t1;                    /* send time, ns */
+    uint64_t deadline;              /* monotonic ms of the reply timeout */
+} probe_slot;
+
+/*
+ * A paced train, built by the worker and sent by the pacer thread, which stamps t1. Whoever of the two comes
+ * last frees it: the worker once it is JOB_DONE, the pacer if the peer went away meanwhile (JOB_ABANDONED).
+ * The worker reserves the OPT_IDs of the train when it queues it, so its own probes in the meantime get theirs
+ * right; the pacer gives back the ones of the sends that failed.
+ */
+typedef struct train_job {
+    struct train_job *next;
+    int sockfd;                     /* a dup() of the peer's, closed by the pacer */
+    uint32_t id;                    /* of the train */
+    int packets;
+    int size;
+    uint64_t gap;                   /* ns between two packets */
+    uint8_t headers[TRAIN_MAX_PACKETS][PROBE_WIRE_SIZE];
+    uint64_t t1[TRAIN_MAX_PACKETS];
+    int failed;                     /* sends that failed, they took no OPT_ID */
+    int wakefd;                     /* pacedfd of the peer's worker, written once the train is out */
+    int state;                      /* JOB_*, changed atomically */
+} train_job;
+
+/*
+ * The history records of a worker, waiting for the history thread to append them. Only the worker advances head
+ * and only the history thread tail, so neither takes a lock; a record that finds the ring full is dropped.
+ */
+typedef struct history_ring {
+    tsdb_record records[HISTORY_RING];
+    uint32_t head;                  /* records staged */
+    uint32_t tail;                  /* records appended */
+    uint32_t dropped;
+} history_ring;
+
+/* Everything one_way_client used to keep on its stack, one entry per remote VM. */
+typedef struct peer {
+    int sockfd;
+    int id;                         /* sent in the probes and the key of its epoll events, see peer_new_id() */
+    int node_id;                    /* the controller's id of the relay */
+    int state;
+    int received;
+    int sent;
+    int lost;                       /* timed out */
+    int late;                       /* replies after the timeout, or too old to match */
+    int duplicates;
+    int reordered;                  /* replies that overtook an earlier probe */
+    int outstanding;                /* slots in SLOT_WAIT */
+    int sampled;                    /* probed in this round, see plan_round() */
+    int joined;                     /* added while the agent runs, not started yet */
+    int epfd;                       /* epoll set of the worker its socket is registered with, -1 for none */
+    int lost_in_row;                /* timed out since the last reply */
+    int down;                       /* reported down to the controller, see peer_link() */
+    int kernel_rx;                  /* the last reply had a kernel t2, else its turnaround is unknown */
+    uint64_t last_reply;            /* monotonic ms */
+    uint64_t total[PEER_COUNTERS];  /* since the peer was configured, for the metrics */
+    double reported;                /* median of the last binary report, < 0 if never reported */
+    uint64_t first_send;            /* monotonic ms of the first probe of a round, its slot when staggered */
+    uint64_t next_send;             /* monotonic ms */
+    uint32_t seq;                   /* of the last probe sent */
+    uint32_t max_seq;               /* highest answered */
+    uint32_t tx_count;              /* datagrams sent on sockfd, matches SOF_TIMESTAMPING_OPT_ID */
+    probe_slot window[PROBE_WINDOW];
+    peer_stats *stats;
+    peer_clock clock;
+    sched_peer sched;
+    peer_train train;
+    train_job *pacing;              /* its paced train, until the worker collected it */
+    struct sockaddr_in servaddr;
+    char *name;
+    char *ip;
+} peer;
+
+/* What a report needs of a peer, copied with the workers locked. */
+typedef struct peer_summary {
+    stats_summary metric[STATS_METRICS];
+    clock_estimate clock;
+    train_estimate train;
+} peer_summary;
+
+typedef struct worker {
+    pthread_t thread;
+    pthread_mutex_t lock;           /* held while the slice is used, so main can swap it between rounds */
+    int epfd;
+    int timerfd;
+    int eventfd;                    /* main -> worker: start a round */
+    int pacedfd;                    /* pacer -> worker: a paced train of the slice is out */
+    history_ring *history;          /* NULL without a history */
+    peer *peers;
+    int npeers;
+    int active;
+    int finished;
+    token_bucket packets;           /* the slice's share of the -B budget */
+    token_bucket bytes;
+    double demand;                  /* probes per second the intervals of the slice ask for */
+    uint32_t deferred;              /* sends the budget held back */
+    uint64_t armed;                 /* monotonic ms the timer is set for, 0 when disarmed */
+    int trains_left;                /* to send in this round of trains */
+    int train_cursor;               /* the slice's peer the next train goes to */
+    double train_bytes;             /* left of the slice's share of the -T budget */
+    uint64_t train_at;              /* monotonic ms of the next train */
+    uint64_t train_round_at;        /* continuous mode: monotonic ms of the next round of trains */
+    uint32_t trains_skipped;        /* trains the budget did not allow, since the last report */
+    metrics_thread *metrics;
+} worker;
+
+char *serverName, *serverIp, *peerList;
+peer *peers;
+peer **peer_by_id;                  /* MAX_PEER_ID entries, NULL for the ids nobody has */
+int next_peer_id;
+worker *workers;
+int nworkers = 1;
+int total_servers;
+int kernel_ts = 0;
+int binary_report = 0;
+double delta_threshold = -1;
+int node_id;
+uint32_t stats_window = STATS_WINDOW_MS;
+uint32_t stats_samples;             /* a window holds at most, at -C */
+int probe_interval = 0;             /* ms between the probes of a peer in continuous mode, 0 for rounds */
+int adaptive;                       /* -A: per peer intervals from probe_interval up to sched_cfg.max_ms */
+sched_config sched_cfg;
+double budget_pps, budget_bps;      /* -B: cap of the whole agent, 0 for none */
+int report_interval;                /* -R: ms between the reports a continuous daemon sends on its own */
+int slot_ms;                        /* -S or the d command: staggered rounds, 0 for none */
+uint64_t stagger_start;             /* unix ms of the round's first slot from the d command, 0 to derive it */
+uint32_t stagger_round;
+int sample_size;                    /* -V or the d command: peers probed per round, 0 for all of them */
+uint32_t local_round;               /* rotates the sample when nobody gives a round number */
+uint32_t report_seq;
+char *shm_name;                     /* -M: publish our row of the delay matrix there */
+shm_matrix *shm;
+char *history_dir = HISTORY_DIR;    /* -H: delay history of every probe, "" for none */
+tsdb *history;
+pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;  /* of the tsdb: the history thread and the ICMP one */
+int metrics_port;                   /* -m: Prometheus text on 127.0.0.1:port, 0 for none */
+int done_fd;                        /* worker -> main: slice finished its round */
+int pending;                        /* workers that still run the current round */
+uint64_t round_end;
+icmp_engine *icmp;                  /* the raw socket of the i commands, opened by the first one */
+int icmp_busy;
+struct in_addr *addresses;          /* of ADDRESS_ID_BASE + i, see address_id() */
+int naddresses;
+int link_fd = -1;                   /* the link reports of the workers */
+uint32_t controller_addr;           /* serverIp, for the workers */
+uint32_t link_seq;
+int train_packets;                  /* -T: packets per train, 0 for no trains */
+int train_size = TRAIN_SIZE;        /* UDP payload */
+double train_budget = TRAIN_BUDGET; /* bytes of trains per round, for the whole agent */
+pthread_mutex_t pacer_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pacer_cond = PTHREAD_COND_INITIALIZER;
+train_job *pacer_head, *pacer_tail; /* the paced trains waiting for the pacer thread */
+
+uint64_t monotonic_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* one more of counter c of p, written only by the worker that owns p and read by the metrics */
+void peer_count(peer *p, int c)
+{
+    __atomic_store_n(&p->total[c], p->total[c] + 1, __ATOMIC_RELAXED);
+}
+
+/* our relay in the shared matrix and the history: the node id, or after the peers when the round has none */
+int self_id()
+{
+    return node_id >= 0 ? node_id : total_servers;
+}
+
+/*
+ * Stage a sample (rtt/forward/reverse in ms) of p for the delay history, or a lost probe if sample is NULL, in
+ * the ring of the worker.
+ */
+void history_add(history_ring *ring, peer *p, uint64_t time, double *sample)
+{
+    tsdb_record *r;
+
+    if ( !ring )
+        return;
+    if ( ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= HISTORY_RING ) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    r = &ring->records[ring->head % HISTORY_RING];
+    r->time = time;
+    r->src = self_id();
+    r->dst = p->node_id;
+    r->rtt = sample ? sample[STATS_RTT] : NAN;
+    r->fwd = sample ? sample[STATS_FORWARD] : NAN;
+    r->rev = sample ? sample[STATS_REVERSE] : NAN;
+    r->loss = sample ? 0 : 1;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/* Append what the workers staged to the delay history. */
+void history_flush()
+{
+    history_ring *ring;
+    tsdb_record *r;
+    uint32_t head, dropped;
+    int i;
+
+    pthread_mutex_lock(&history_lock);
+    for ( i = 0; i < nworkers; i++ ) {
+        if ( ( ring = workers[i].history ) == NULL )
+            continue;
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for ( ; ring->tail != head; ring->tail++ ) {
+            r = &ring->records[ring->tail % HISTORY_RING];
+            tsdb_append(history, r->time, r->src, r->dst, r->rtt, r->fwd, r->rev, r->loss);
+        }
+        __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+        if ( ( dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED) ) != 0 )
+            fprintf(stderr, "history: worker%d dropped %u record(s)\n", i, dropped);
+    }
+    pthread_mutex_unlock(&history_lock);
+}
+
+void * history_thread(void * ptr)
+{
+    struct timespec ts = { HISTORY_FLUSH_MS / 1000, ( HISTORY_FLUSH_MS % 1000 ) * 1000000 };
+
+    (void) ptr;
+    for (;;) {
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+        history_flush();
+    }
+    return NULL;
+}
+
+/*
+ * Tell the controller right away that p stopped answering (LINK_DOWN_LOSSES probes lost in a row) or answers
+ * again, instead of waiting for the next report, so it can move the flows off the edge. Only the binary
+ * report has the ids for it.
+ */
+void peer_link(peer *p, int up, uint64_t now)
+{
+    struct sockaddr_in to;
+    report_link r;
+
+    if ( p->down == !up )
+        return;
+    p->down = !up;
+    printf("%s is %s after %d probe(s) lost in a row\n", p->name, up ? "up" : "down", p->lost_in_row);
+    if ( link_fd < 0 || p->node_id < 0 || !( binary_report || node_id >= 0 ) )
+        return;
+
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = __atomic_load_n(&controller_addr, __ATOMIC_RELAXED);
+    to.sin_port = htons(CONTROLLER_PORT);
+    r.peer = p->node_id;
+    r.state = up ? REPORT_LINK_UP : REPORT_LINK_DOWN;
+    r.losses = p->lost_in_row;
+    r.silent = now > p->last_reply ? now - p->last_reply : 0;
+    report_send_links(link_fd, &to, node_id >= 0 ? node_id : 0, __atomic_fetch_add(&link_seq, 1, __ATOMIC_RELAXED),
+                      0, &r, 1);
+}
+
+int peer_open(peer *p)
+{
+    if ( ( p->sockfd = socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP ) ) < 0 ) {
+        perror("peer_open socket");
+        return -1;
+    }
+
+    memset(&p->servaddr, 0, sizeof(struct sockaddr_in));
+    p->servaddr.sin_family = AF_INET;
+    p->servaddr.sin_addr.s_addr = inet_addr(p->ip);
+    p->servaddr.sin_port = htons(PROBE_PORT);
+
+    if ( connect( p->sockfd, (struct sockaddr *) &p->servaddr, sizeof(struct sockaddr_in) ) < 0 ) {
+        perror("peer_open connect");
+        return -1;
+    }
+
+    if ( kernel_ts && probe_enable_timestamps( p->sockfd, 1 ) < 0 )
+        fprintf(stderr, "%s: no kernel timestamps, using user space ones\n", p->name);
+
+    if ( ( p->stats = stats_create(stats_window, stats_samples) ) == NULL ) {
+        perror("peer_open stats_create");
+        close(p->sockfd);
+        return -1;
+    }
+    clock_init(&p->clock);
+    sched_init(&p->sched, &sched_cfg);
+    train_init(&p->train);
+
+    p->state = PEER_DONE;
+    p->seq = 0;
+    p->max_seq = 0;
+    p->tx_count = 0;
+    p->reported = -1;
+    p->lost_in_row = 0;
+    p->down = 0;
+    p->last_reply = monotonic_ms();
+    memset(p->window, 0, sizeof(p->window));
+    return 0;
+}
+
+/* Forget the paced train of p: the pacer frees it if it is still sending it. */
+void peer_abandon_train(peer *p)
+{
+    int queued = JOB_QUEUED;
+
+    if ( !p->pacing )
+        return;
+    if ( !__atomic_compare_exchange_n(&p->pacing->state, &queued, JOB_ABANDONED, 0, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE) )
+        free(p->pacing);
+    p->pacing = NULL;
+}
+
+/* The peer moved to the worker of pacedfd: the pacer wakes that one up for its paced train, if it is not out yet. */
+void peer_move_train(peer *p, int pacedfd)
+{
+    uint64_t one = 1;
+
+    if ( !p->pacing )
+        return;
+    __atomic_store_n(&p->pacing->wakefd, pacedfd, __ATOMIC_SEQ_CST);
+    if ( __atomic_load_n(&p->pacing->state, __ATOMIC_SEQ_CST) == JOB_DONE && write( pacedfd, &one, sizeof(one) ) < 0 )
+        perror("peer_move_train eventfd write");
+}
+
+void peer_close(peer *p)
+{
+    peer_abandon_train(p);
+    close(p->sockfd);
+    free(p->stats);
+    free(p->name);
+    free(p->ip);
+}
+
+void peer_round_start(peer *p)
+{
+    p->state = PEER_ACTIVE;
+    p->received = 0;
+    p->sent = 0;
+    p->lost = 0;
+    p->late = 0;
+    p->duplicates = 0;
+    p->reordered = 0;
+    p->next_send = p->first_send;
+}
+
+/* A round stops sending once the answered and outstanding probes make PROBES_PER_ROUND. */
+int peer_can_send(peer *p)
+{
+    if ( p->state != PEER_ACTIVE || !p->sampled || p->window[(p->seq + 1) % PROBE_WINDOW].state == SLOT_WAIT )
+        return 0;
+    return probe_interval || p->received + p->outstanding < PROBES_PER_ROUND;
+}
+
+/* ms between the probes of p if the slice has the budget for it */
+uint32_t peer_interval(peer *p)
+{
+    if ( !probe_interval )
+        return PROBE_SPACING_MS;
+    return adaptive ? p->sched.interval : (uint32_t) probe_interval;
+}
+
+/* probes per second the budget of the slice allows, 0 for no limit */
+double worker_capacity(worker *w)
+{
+    double pps = w->packets.rate * 1000, bps = w->bytes.rate * 1000 / PROBE_BYTES;
+
+    if ( pps > 0 && bps > 0 )
+        return pps < bps ? pps : bps;
+    return pps > 0 ? pps : bps;
+}
+
+/* The interval of p, stretched like the ones of every other peer of the slice when they ask for too much. */
+uint32_t peer_gap(worker *w, peer *p)
+{
+    double capacity = worker_capacity(w);
+
+    if ( probe_interval && capacity > 0 && w->demand > capacity )
+        return peer_interval(p) * w->demand / capacity;
+    return peer_interval(p);
+}
+
+/* 1 if the budget of the slice has room for one more probe now, which it then spends */
+int worker_take_budget(worker *w, uint64_t now)
+{
+    if ( bucket_ready(&w->packets, now, 1) > now || bucket_ready(&w->bytes, now, PROBE_BYTES) > now ) {
+        w->deferred++;
+        return 0;
+    }
+    bucket_take(&w->packets, now, 1);
+    bucket_take(&w->bytes, now, PROBE_BYTES);
+    return 1;
+}
+
+uint64_t worker_budget_ready(worker *w, uint64_t now)
+{
+    uint64_t packets = bucket_ready(&w->packets, now, 1), bytes = bucket_ready(&w->bytes, now, PROBE_BYTES);
+
+    return packets > bytes ? packets : bytes;
+}
+
+void peer_send(peer *p, uint64_t now, uint32_t gap, metrics_thread *metrics)
+{
+    uint8_t buf[PROBE_MAX_SIZE];
+    probe_slot *slot;
+    probe_msg m;
+    size_t len;
+    uint64_t before;
+
+    slot = &p->window[++p->seq % PROBE_WINDOW];
+    slot->seq = p->seq;
+    slot->t1 = probe_now_ns();
+    slot->tx_id = p->tx_count;
+    slot->deadline = now + PROBE_TIMEOUT_MS;
+    slot->state = SLOT_WAIT;
+
+    memset(&m, 0, sizeof(m));
+    m.flags = PROBE_F_COORD;
+    m.peer = p->id;
+    m.seq = slot->seq;
+    m.t1 = slot->t1;
+    len = probe_encode(buf, &m);
+    memset(buf + len, 0, PROBE_COORD_SIZE - len);
+    len = PROBE_COORD_SIZE;
+
+    /* a failed send is left to time out and counts as lost */
+    before = monotonic_ns();
+    if ( send( p->sockfd, buf, len, 0 ) < 0 )
+        perror("one_way_client send");
+    else {
+        metrics_observe(metrics, METRIC_SEND, monotonic_ns() - before);
+        p->tx_count++;
+    }
+    p->sent++;
+    peer_count(p, COUNT_SENT);
+    p->outstanding++;
+    p->next_send = now + gap;
+}
+
+/*
+ * The next train of the round to p: train_packets probes of train_size bytes, each with a header of its own and
+ * the same padding. Back to back they go in one sendmmsg; paced at pace bit/s they go to the pacer thread, and
+ * the worker collects their send times once it is done (worker_trains()).
+ */
+void peer_send_train(peer *p, double pace, uint64_t now, int wakefd, metrics_thread *metrics)
+{
+    static const uint8_t padding[TRAIN_MAX_SIZE];
+    uint8_t headers[TRAIN_MAX_PACKETS][PROBE_WIRE_SIZE];
+    struct iovec iovs[TRAIN_MAX_PACKETS][2];
+    struct mmsghdr msgs[TRAIN_MAX_PACKETS];
+    train_job *job = NULL;
+    probe_msg m;
+    uint64_t before;
+    uint32_t id;
+    int i, n, sent = 0;
+
+    if ( pace > 0 && ( job = (train_job *) calloc(1, sizeof(train_job)) ) != NULL &&
+         ( job->sockfd = dup(p->sockfd) ) < 0 ) {
+        perror("peer_send_train dup");
+        free(job);
+        job = NULL;
+    }
+    id = train_start(&p->train, train_packets, train_size, job ? pace : 0, now);
+    n = p->train.packets;
+
+    memset(&m, 0, sizeof(m));
+    m.flags = PROBE_F_TRAIN;
+    m.peer = p->id;
+    m.t1 = probe_now_ns();
+    for ( i = 0; i < n; i++ ) {
+        m.seq = TRAIN_SEQ(id, i);
+        probe_encode(job ? job->headers[i] : headers[i], &m);
+    }
+
+    if ( job ) {
+        job->id = id;
+        job->packets = n;
+        job->size = train_size;
+        job->gap = (uint64_t) ( ( train_size + TRAIN_OVERHEAD ) * 8e9 / pace );
+        job->wakefd = wakefd;
+        p->pacing = job;
+        p->tx_count += n;
+        pthread_mutex_lock(&pacer_lock);
+        if ( pacer_tail )
+            pacer_tail->next = job;
+        else
+            pacer_head = job;
+        pacer_tail = job;
+        pthread_cond_signal(&pacer_cond);
+        pthread_mutex_unlock(&pacer_lock);
+        return;
+    }
+
+    memset(msgs, 0, sizeof(msgs));
+    for ( i = 0; i < n; i++ ) {
+        iovs[i][0].iov_base = headers[i];
+        iovs[i][0].iov_len = PROBE_WIRE_SIZE;
+        iovs[i][1].iov_base = (void *) padding;
+        iovs[i][1].iov_len = train_size - PROBE_WIRE_SIZE;
+        msgs[i].msg_hdr.msg_iov = iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    /* what did not go out is missing from the train, like a lost packet */
+    before = monotonic_ns();
+    while ( sent < n ) {
+        if ( ( i = sendmmsg( p->sockfd, msgs + sent, n - sent, 0 ) ) <= 0 ) {
+            perror("one_way_client sendmmsg");
+            break;
+        }
+        sent += i;
+    }
+    for ( i = 0; i < n; i++ )
+        p->train.t1[i] = before;
+    metrics_observe(metrics, METRIC_SEND, monotonic_ns() - before);
+    p->tx_count += sent;
+}
+
+/* The send times of the paced train of p, once the pacer is done with it. */
+void peer_collect_train(peer *p)
+{
+    train_job *job = p->pacing;
+
+    if ( !job || __atomic_load_n(&job->state, __ATOMIC_ACQUIRE) != JOB_DONE )
+        return;
+    if ( job->id == p->train.id )
+        memcpy(p->train.t1, job->t1, sizeof(job->t1));
+    p->tx_count -= job->failed;
+    free(job);
+    p->pacing = NULL;
+}
+
+/*
+ * The pacer: sends the paced trains one after the other, each packet gap ns after the previous one, sleeping in
+ * between but for the last PACE_SPIN_NS, which it spins. It has a thread of its own so that the workers never
+ * wait for a train, and takes no worker lock: it tells the worker through its pacedfd once a train is out.
+ */
+void * train_pacer(void * ptr)
+{
+    static const uint8_t padding[TRAIN_MAX_SIZE];
+    struct iovec iov[2];
+    struct msghdr msg;
+    struct timespec ts;
+    metrics_thread *metrics = metrics_register("pacer");
+    train_job *job;
+    uint64_t at, one = 1;
+    int i, queued, wakefd;
+
+    (void) ptr;
+    for (;;) {
+        pthread_mutex_lock(&pacer_lock);
+        while ( !pacer_head )
+            pthread_cond_wait(&pacer_cond, &pacer_lock);
+        job = pacer_head;
+        if ( ( pacer_head = job->next ) == NULL )
+            pacer_tail = NULL;
+        pthread_mutex_unlock(&pacer_lock);
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        iov[1].iov_base = (void *) padding;
+        iov[1].iov_len = job->size - PROBE_WIRE_SIZE;
+        at = monotonic_ns();
+        for ( i = 0; i < job->packets; i++, at += job->gap ) {
+            if ( at > monotonic_ns() + PACE_SPIN_NS ) {
+                ts.tv_sec = ( at - PACE_SPIN_NS ) / 1000000000ULL;
+                ts.tv_nsec = ( at - PACE_SPIN_NS ) % 1000000000ULL;
+                while ( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR )
+                    ;
+            }
+            while ( ( job->t1[i] = monotonic_ns() ) < at )
+                ;
+            iov[0].iov_base = job->headers[i];
+            iov[0].iov_len = PROBE_WIRE_SIZE;
+            if ( sendmsg( job->sockfd, &msg, 0 ) < 0 ) {
+                perror("train_pacer sendmsg");
+                job->failed++;
+            }
+        }
+        metrics_observe(metrics, METRIC_SEND, monotonic_ns() - job->t1[0]);
+        close(job->sockfd);
+
+        /* the worker may free the job as soon as it is JOB_DONE */
+        wakefd = __atomic_load_n(&job->wakefd, __ATOMIC_ACQUIRE);
+        queued = JOB_QUEUED;
+        if ( !__atomic_compare_exchange_n(&job->state, &queued, JOB_DONE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) )
+            free(job);
+        else if ( write( wakefd, &one, sizeof(one) ) < 0 )
+            perror("train_pacer eventfd write");
+    }
+    return NULL;
+}
+
+void peer_expire(peer *p, uint64_t now, history_ring *ring)
+{
+    int i;
+
+    for ( i = 0; i < PROBE_WINDOW; i++ )
+        if ( p->window[i].state == SLOT_WAIT && p->window[i].deadline <= now ) {
+            p->window[i].state = SLOT_LOST;
+            p->outstanding--;
+            p->lost++;
+            peer_count(p, COUNT_LOST);
+            history_add(ring, p, probe_now_ns(), NULL);
+            if ( adaptive )
+                sched_loss(&p->sched, &sched_cfg);
+            if ( ++p->lost_in_row >= LINK_DOWN_LOSSES && now != UINT64_MAX )
+                peer_link(p, 0, now);
+        }
+}
+
+/* monotonic ms of the next send or timeout of the peer, UINT64_MAX if there is nothing to wait for */
+uint64_t peer_next_deadline(peer *p)
+{
+    uint64_t next = peer_can_send(p) ? p->next_send : UINT64_MAX;
+    int i;
+
+    for ( i = 0; i < PROBE_WINDOW; i++ )
+        if ( p->window[i].state == SLOT_WAIT && p->window[i].deadline < next )
+            next = p->window[i].deadline;
+    return next;
+}
+
+/* Replace the user space send time of an outstanding probe with the kernel one once it is available. */
+void peer_tx_timestamps(peer *p)
+{
+    uint64_t ts;
+    uint32_t id = UINT32_MAX;
+    int i;
+
+    while ( probe_tx_timestamp( p->sockfd, &ts, &id ) > 0 )
+        for ( i = 0; i < PROBE_WINDOW; i++ )
+            if ( p->window[i].state == SLOT_WAIT && p->window[i].tx_id == id )
+                p->window[i].t1 = ts;
+}
+
+/* Same computation as one_way_client, for one reply waiting on the socket. Returns 1 when it ends the peer's round. */
+int peer_recv(peer *p, uint64_t now, history_ring *ring, metrics_thread *metrics)
+{
+    uint8_t buf[PROBE_MAX_SIZE];
+    char control[256];
+    struct iovec iov;
+    struct msghdr msg;
+    probe_msg m;
+    probe_slot *slot;
+    uint64_t t4, before;
+    ssize_t len;
+    double sample[STATS_METRICS];
+    coord remote;
+
+    if ( kernel_ts )
+        peer_tx_timestamps(p);
+
+    iov.iov_base = buf;
+    iov.iov_len = sizeof(buf);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    before = monotonic_ns();
+    if ( ( len = recvmsg( p->sockfd, &msg, 0 ) ) < 0 )
+        return 0;
+    metrics_observe(metrics, METRIC_RECV, monotonic_ns() - before);
+
+    if ( !kernel_ts || ( t4 = probe_rx_timestamp(&msg) ) == 0 )
+        t4 = probe_now_ns();
+
+    if ( probe_decode(buf, len, &m) != PROBE_VERSION || !(m.flags & PROBE_F_REPLY) || m.peer != (uint16_t) p->id )
+        return 0;
+
+    if ( m.flags & PROBE_F_TRAIN ) {
+        train_reply(&p->train, m.seq, m.t2, now);
+        return 0;
+    }
+
+    slot = &p->window[m.seq % PROBE_WINDOW];
+    if ( slot->seq != m.seq || slot->state == SLOT_LOST || slot->state == SLOT_FREE ) {
+        p->late++;
+        peer_count(p, COUNT_LATE);
+        return 0;
+    }
+    if ( slot->state == SLOT_ANSWERED ) {
+        p->duplicates++;
+        return 0;
+    }
+    slot->state = SLOT_ANSWERED;
+    p->outstanding--;
+    peer_count(p, COUNT_RECEIVED);
+    if ( p->down )
+        peer_link(p, 1, now);
+    p->lost_in_row = 0;
+    p->last_reply = now;
+
+    if ( (int32_t) (m.seq - p->max_seq) < 0 )
+        p->reordered++;
+    else
+        p->max_seq = m.seq;
+
+    /* The reflector turnaround (t3 - t2) is not part of the round trip. Without a kernel t2 the reflector
+     * stamps a whole batch with the time it sends it, so t3 - t2 is 0 and says nothing. */
+    clock_add(&p->clock, slot->t1, m.t2, m.t3, t4, &sample[STATS_FORWARD], &sample[STATS_REVERSE]);
+    sample[STATS_RTT] = sample[STATS_FORWARD] + sample[STATS_REVERSE];
+    p->kernel_rx = ( m.flags & PROBE_F_KERNEL_RX ) != 0;
+    sample[STATS_TURNAROUND] = p->kernel_rx && m.t3 > m.t2 ? ( m.t3 - m.t2 ) / 1e6 : 0;
+    stats_add(p->stats, now, sample);
+    if ( len == PROBE_COORD_SIZE && ( m.flags & PROBE_F_COORD ) ) {
+        coord_decode(buf + PROBE_WIRE_SIZE, &remote);
+        coord_observe(&remote, sample[STATS_RTT]);
+    }
+    if ( adaptive )
+        sched_sample(&p->sched, &sched_cfg, sample[STATS_FORWARD]);
+
+    history_add(ring, p, t4, sample);
+
+    if ( ++p->received == PROBES_PER_ROUND && !probe_interval && p->state == PEER_ACTIVE ) {
+        printf("%s finished\n", p->name);
+        p->state = PEER_DONE;
+        return 1;
+    }
+    return 0;
+}
+
+/* A round of trains: TRAINS_PER_PEER to every peer of the slice in the sample, while its share of the -T budget
+ * lasts. A train that would not fit is not sent at all. */
+void worker_plan_trains(worker *w, uint64_t now)
+{
+    int i, sampled = 0;
+
+    if ( !train_packets )
+        return;
+    for ( i = 0; i < w->npeers; i++ )
+        sampled += w->peers[i].sampled != 0;
+    w->trains_left = TRAINS_PER_PEER * sampled;
+    w->train_bytes = total_servers ? train_budget * w->npeers / total_servers : 0;
+    w->train_at = now;
+}
+
+/* 1 while a train of the round is still to be sent or answered */
+int worker_trains_busy(worker *w)
+{
+    int i;
+
+    for ( i = 0; i < w->npeers; i++ )
+        if ( w->peers[i].train.id )
+            return 1;
+    return w->trains_left > 0;
+}
+
+/*
+ * The first of every TRAINS_PER_PEER trains to p goes back to back for the capacity, the others paced at the
+ * capacity it found for the available bandwidth (0 for back to back).
+ */
+double train_pace(peer *p, uint64_t now)
+{
+    train_estimate e;
+
+    if ( p->train.last_id % TRAINS_PER_PEER == 0 )
+        return 0;
+    train_estimate_at(&p->train, now, stats_window, &e);
+    if ( e.capacity <= 0 || train_packets * ( train_size + TRAIN_OVERHEAD ) * 8e-3 / e.capacity > TRAIN_PACE_MS )
+        return 0;
+    return e.capacity * 1e6;
+}
+
+/* The next peer of the slice in the sample, from the cursor on; NULL if there is none. */
+peer * worker_train_peer(worker *w)
+{
+    peer *p;
+    int i;
+
+    for ( i = 0; i < w->npeers; i++ ) {
+        p = &w->peers[w->train_cursor % w->npeers];
+        w->train_cursor = ( w->train_cursor + 1 ) % w->npeers;
+        if ( p->sampled )
+            return p;
+    }
+    return NULL;
+}
+
+/*
+ * Expire the trains in flight and send the next one of the round when it is due, TRAIN_GAP_MS after the
+ * previous one so the trains of the slice do not queue behind each other. Returns next, or the deadline of a
+ * train if that comes first.
+ */
+uint64_t worker_trains(worker *w, uint64_t now, uint64_t next)
+{
+    double cost = (double) train_packets * ( train_size + TRAIN_OVERHEAD );
+    peer *p;
+    int i;
+
+    if ( !train_packets || !w->npeers )
+        return next;
+    if ( probe_interval && now >= w->train_round_at ) {
+        worker_plan_trains(w, now);
+        w->train_round_at = now + ( report_interval ? report_interval : TRAIN_PERIOD_MS );
+    }
+
+    if ( w->trains_left > 0 && w->train_at <= now ) {
+        if ( w->train_bytes < cost ) {
+            __atomic_store_n(&w->trains_skipped, w->trains_skipped + w->trains_left, __ATOMIC_RELAXED);
+            w->trains_left = 0;
+        } else if ( ( p = worker_train_peer(w) ) == NULL ) {
+            w->trains_left = 0;
+        } else {
+            peer_collect_train(p);
+            if ( p->pacing ) {
+                /* its last train is still going out: try the next peer once the pacer wakes us up */
+                w->train_at = UINT64_MAX;
+            } else {
+                peer_send_train(p, train_pace(p, now), now, w->pacedfd, w->metrics);
+                w->train_bytes -= cost;
+                w->trains_left--;
+                w->train_at = now + TRAIN_GAP_MS;
+            }
+        }
+    }
+
+    for ( i = 0; i < w->npeers; i++ ) {
+        p = &w->peers[i];
+        peer_collect_train(p);
+        /* the pacer is at it and wakes us up when done, the deadline is only there if it could not */
+        if ( !p->pacing )
+            train_expire(&p->train, now);
+        if ( p->train.id && p->train.deadline < next )
+            next = p->train.deadline;
+    }
+    if ( w->trains_left > 0 && w->train_at < next )
+        next = w->train_at;
+    if ( probe_interval && w->train_round_at < next )
+        next = w->train_round_at;
+    return next;
+}
+
+void worker_start_round(worker *w)
+{
+    int i;
+
+    /* in continuous mode only the peers that were just configured need to start; a round is over for the
+     * peers outside the sample from the start */
+    w->finished = 0;
+    for ( i = 0; i < w->npeers; i++ )
+        if ( !probe_interval && !w->peers[i].sampled )
+            w->finished++;
+        else if ( !probe_interval || w->peers[i].state == PEER_DONE )
+            peer_round_start(&w->peers[i]);
+    if ( !probe_interval )
+        worker_plan_trains(w, monotonic_ms());
+    w->active = 1;
+}
+
+void worker_end_round(worker *w)
+{
+    uint64_t one = 1, now = monotonic_ms();
+    peer *p;
+    int i;
+
+    for ( i = 0; i < w->npeers; i++ ) {
+        p = &w->peers[i];
+        peer_expire(p, UINT64_MAX, w->history);
+        train_end(&p->train, now);
+        p->state = PEER_DONE;
+    }
+    if ( w->trains_left > 0 )
+        __atomic_store_n(&w->trains_skipped, w->trains_skipped + w->trains_left, __ATOMIC_RELAXED);
+    w->trains_left = 0;
+
+    w->active = 0;
+    if ( write( done_fd, &one, sizeof(one) ) < 0 )
+        perror("one_way_client eventfd write");
+}
+
+void * one_way_client(void * ptr)
+{
+    worker *w = (worker *) ptr;
+    struct epoll_event ev, events[MAX_EVENTS];
+    struct itimerspec its;
+    uint64_t now, next, due, value;
+    double demand;
+    char name[32];
+    int i, n;
+    peer *p;
+
+    snprintf(name, sizeof(name), "worker%d", (int) ( w - workers ));
+    w->metrics = metrics_register(name);
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = TIMER_TOKEN;
+    if ( epoll_ctl( w->epfd, EPOLL_CTL_ADD, w->timerfd, &ev ) < 0 )
+        perror("one_way_client epoll_ctl");
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = START_TOKEN;
+    if ( epoll_ctl( w->epfd, EPOLL_CTL_ADD, w->eventfd, &ev ) < 0 )
+        perror("one_way_client epoll_ctl");
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = PACED_TOKEN;
+    if ( epoll_ctl( w->epfd, EPOLL_CTL_ADD, w->pacedfd, &ev ) < 0 )
+        perror("one_way_client epoll_ctl");
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        now = monotonic_ms();
+        if ( w->active && !probe_interval &&
+             ( ( w->finished >= w->npeers && !worker_trains_busy(w) ) || now >= round_end ) )
+            worker_end_round(w);
+
+        /* Walk the array: expire what timed out, send what is due, and find the next deadline. */
+        memset(&its, 0, sizeof(its));
+        w->armed = 0;
+        if ( w->active ) {
+            next = probe_interval ? now + PROBE_TIMEOUT_MS : round_end;
+            demand = 0;
+            for ( i = 0; i < w->npeers; i++ ) {
+                p = &w->peers[i];
+                if ( p->state == PEER_DONE )
+                    continue;
+                peer_expire(p, now, w->history);
+                if ( peer_can_send(p) && p->next_send <= now ) {
+                    if ( worker_take_budget(w, now) )
+                        peer_send(p, now, peer_gap(w, p), w->metrics);
+                    else
+                        p->next_send = worker_budget_ready(w, now);
+                }
+                if ( ( due = peer_next_deadline(p) ) < next )
+                    next = due;
+                if ( p->sampled )
+                    demand += 1000.0 / peer_interval(p);
+            }
+            w->demand = demand;
+            next = worker_trains(w, now, next);
+            /* the last train of the round just ended: end the round now instead of at its deadline */
+            if ( !probe_interval && w->finished >= w->npeers && !worker_trains_busy(w) )
+                next = now;
+            its.it_value.tv_sec = next / 1000;
+            its.it_value.tv_nsec = (next % 1000) * 1000000;
+            w->armed = next;
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        /* disarmed between rounds, so an idle worker sleeps until the next eventfd write */
+        if ( timerfd_settime( w->timerfd, TFD_TIMER_ABSTIME, &its, NULL ) < 0 )
+            perror("one_way_client timerfd_settime");
+
+        if ( ( n = epoll_wait( w->epfd, events, MAX_EVENTS, -1 ) ) < 0 ) {
+            perror("one_way_client epoll_wait");
+            continue;
+        }
+
+        pthread_mutex_lock(&w->lock);
+        now = monotonic_ms();
+        for ( i = 0; i < n; i++ ) {
+            if ( events[i].data.u32 == TIMER_TOKEN ) {
+                if ( read( w->timerfd, &value, sizeof(value) ) < 0 )
+                    perror("one_way_client timerfd read");
+                else if ( w->armed && ( due = monotonic_ns() ) > w->armed * 1000000 )
+                    metrics_observe(w->metrics, METRIC_WAKEUP, due - w->armed * 1000000);
+                continue;
+            }
+            if ( events[i].data.u32 == START_TOKEN ) {
+                if ( read( w->eventfd, &value, sizeof(value) ) < 0 )
+                    perror("one_way_client eventfd read");
+                worker_start_round(w);
+                continue;
+            }
+            if ( events[i].data.u32 == PACED_TOKEN ) {
+                if ( read( w->pacedfd, &value, sizeof(value) ) < 0 )
+                    perror("one_way_client eventfd read");
+                /* the walk collects the trains; the next one goes out now if it waited for the pacer */
+                if ( w->train_at == UINT64_MAX )
+                    w->train_at = now;
+                continue;
+            }
+            /* the peer may have moved to another worker or left since epoll_wait returned */
+            if ( events[i].data.u32 >= MAX_PEER_ID || ( p = peer_by_id[events[i].data.u32] ) == NULL ||
+                 p < w->peers || p >= w->peers + w->npeers )
+                continue;
+            if ( ( events[i].events & EPOLLERR ) && kernel_ts )
+                peer_tx_timestamps(p);
+            if ( !( events[i].events & EPOLLIN ) )
+                continue;
+            if ( peer_recv(p, now, w->history, w->metrics) )
+                w->finished++;
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    return NULL;
+}
+
+/*
+ * The histogram median is up to 6% off. Windows of at most BATCH_SAMPLES samples (a round's 10 when the daemon
+ * is not continuous) get the exact one instead, every peer and metric in one pass of the batch kernels.
+ */
+void exact_medians(peer_summary *summary)
+{
+    float value[BATCH_SAMPLES], *median;
+    batch b;
+    int i, m, k, n, lane;
+
+    if ( batch_init(&b, total_servers * STATS_METRICS) < 0 )
+        return;
+    if ( ( median = (float *) malloc(sizeof(float) * b.stride) ) == NULL ) {
+        batch_free(&b);
+        return;
+    }
+    for ( i = 0; i < total_servers; i++ )
+        for ( m = 0; m < STATS_METRICS; m++ ) {
+            n = stats_values(peers[i].stats, m, value, BATCH_SAMPLES);
+            for ( k = 0; k < n; k++ )
+                batch_put(&b, i * STATS_METRICS + m, value[k]);
+        }
+    batch_medians(&b, median);
+    for ( i = 0; i < total_servers; i++ )
+        for ( m = 0; m < STATS_METRICS; m++ ) {
+            lane = i * STATS_METRICS + m;
+            if ( b.count[lane] )
+                summary[i].metric[m].median = median[lane];
+        }
+    free(median);
+    batch_free(&b);
+}
+
+peer_summary * summarize_peers()
+{
+    peer_summary *summary;
+    uint64_t now = monotonic_ms(), wall = probe_now_ns();
+    int i, m;
+
+    summary = (peer_summary *) calloc (total_servers > 0 ? total_servers : 1, sizeof(peer_summary));
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_lock(&workers[i].lock);
+    for ( i = 0; i < total_servers; i++ ) {
+        for ( m = 0; m < STATS_METRICS; m++ )
+            stats_summarize(peers[i].stats, m, now, &summary[i].metric[m]);
+        clock_estimate_at(&peers[i].clock, wall, &summary[i].clock);
+        train_estimate_at(&peers[i].train, now, stats_window, &summary[i].train);
+    }
+    exact_medians(summary);
+    for ( i = 0; i < total_servers; i++ )
+        if ( !peers[i].kernel_rx )
+            memset(&summary[i].metric[STATS_TURNAROUND], 0, sizeof(stats_summary));
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_unlock(&workers[i].lock);
+    return summary;
+}
+
+void send_binary_report(int sockfd, struct sockaddr_in *servaddr, peer_summary *summary)
+{
+    report_delay *records;
+    report_stats *stats;
+    report_clock *clocks;
+    report_bandwidth *bandwidths;
+    report_coord self;
+    stats_summary *fwd, *s;
+    coord local;
+    peer *p;
+    int i, m, n = 0, ns = 0, nb, flags = 0;
+    uint32_t seq = report_seq++;
+
+    if ( delta_threshold >= 0 && seq % REPORT_FULL_EVERY != 0 )
+        flags |= REPORT_F_DELTA;
+
+    records = (report_delay *) calloc (total_servers > 0 ? total_servers : 1, sizeof(report_delay));
+    stats = (report_stats *) calloc ((total_servers > 0 ? total_servers : 1) * STATS_METRICS, sizeof(report_stats));
+    clocks = (report_clock *) calloc (total_servers > 0 ? total_servers : 1, sizeof(report_clock));
+    bandwidths = (report_bandwidth *) calloc (total_servers > 0 ? total_servers : 1, sizeof(report_bandwidth));
+    for ( i = 0; i < total_servers; i++ ) {
+        p = &peers[i];
+        fwd = &summary[i].metric[STATS_FORWARD];
+        if ( ( flags & REPORT_F_DELTA ) && p->reported >= 0 && fabs(fwd->median - p->reported) <= delta_threshold )
+            continue;
+        /* what the controller has of a peer outside the sample is still the best we know */
+        if ( !p->sampled && fwd->count == 0 )
+            continue;
+        records[n].peer = p->node_id;
+        records[n].samples = fwd->count > UINT16_MAX ? UINT16_MAX : fwd->count;
+        records[n].loss = p->received + p->lost ? (double) p->lost / (p->received + p->lost) : 0;
+        records[n].reorder = p->received ? (double) p->reordered / p->received : 0;
+        records[n].median = fwd->median;
+        records[n].p90 = fwd->p90;
+        p->reported = fwd->median;
+
+        clocks[n].peer = p->node_id;
+        clocks[n].points = summary[i].clock.points;
+        clocks[n].offset = summary[i].clock.offset;
+        clocks[n].skew = summary[i].clock.skew;
+        clocks[n].error = summary[i].clock.error;
+        clocks[n].min_delay = summary[i].clock.min_delay;
+        n++;
+
+        for ( m = 0; m < STATS_METRICS; m++ ) {
+            s = &summary[i].metric[m];
+            /* no turnaround without the reflector's kernel receive timestamps */
+            if ( m == STATS_TURNAROUND && !s->count )
+                continue;
+            stats[ns].peer = p->node_id;
+            stats[ns].metric = m;
+            stats[ns].count = s->count;
+            stats[ns].min = s->min;
+            stats[ns].median = s->median;
+            stats[ns].p90 = s->p90;
+            stats[ns].p99 = s->p99;
+            stats[ns].ewma = s->ewma;
+            stats[ns].jitter = s->jitter;
+            ns++;
+        }
+    }
+
+    printf("binary report %u: %d of %d peer(s)%s\n", seq, n, total_servers, flags & REPORT_F_DELTA ? " (delta)" : "");
+    report_send_delays(sockfd, servaddr, node_id >= 0 ? node_id : 0, seq, flags, records, n);
+    report_send_stats(sockfd, servaddr, node_id >= 0 ? node_id : 0, seq, flags, stats, ns);
+    report_send_clocks(sockfd, servaddr, node_id >= 0 ? node_id : 0, seq, flags, clocks, n);
+
+    if ( train_packets ) {
+        for ( i = 0, nb = 0; i < total_servers; i++ ) {
+            if ( !summary[i].train.trains )
+                continue;
+            bandwidths[nb].peer = peers[i].node_id;
+            bandwidths[nb].trains = summary[i].train.trains;
+            bandwidths[nb].paced = summary[i].train.paced;
+            bandwidths[nb].capacity = summary[i].train.capacity;
+            bandwidths[nb].available = summary[i].train.available;
+            bandwidths[nb].rate = summary[i].train.rate;
+            nb++;
+        }
+        report_send_bandwidths(sockfd, servaddr, node_id >= 0 ? node_id : 0, seq, flags, bandwidths, nb);
+    }
+
+    coord_local(&local);
+    memset(&self, 0, sizeof(self));
+    self.node = node_id >= 0 ? node_id : 0;
+    self.updates = local.updates > UINT16_MAX ? UINT16_MAX : local.updates;
+    for ( i = 0; i < REPORT_COORD_DIMS && i < COORD_DIMS; i++ )
+        self.v[i] = local.v[i];
+    self.height = local.height;
+    self.error = local.error;
+    report_send_coords(sockfd, servaddr, self.node, seq, flags, &self, 1);
+    free(records);
+    free(stats);
+    free(clocks);
+    free(bandwidths);
+}
+
+/*
+ * Write our own row of the shared memory delay matrix, indexed like the binary report (by node id, or by the
+ * position in the peer list with our row after them when the round has no ids).
+ */
+void publish_row(peer_summary *summary)
+{
+    shm_edge *row;
+    stats_summary *fwd;
+    peer *p;
+    int i, n, self = self_id();
+
+    for ( n = self + 1, i = 0; i < total_servers; i++ )
+        if ( peers[i].node_id >= n )
+            n = peers[i].node_id + 1;
+    if ( shm && shm_matrix_size(shm) < n ) {
+        shm_matrix_close(shm);
+        shm = NULL;
+    }
+    if ( !shm && ( shm = shm_matrix_open(shm_name, n, 1) ) == NULL )
+        return;
+
+    row = shm_row_write_begin(shm, self);
+    for ( i = 0; i < total_servers; i++ ) {
+        p = &peers[i];
+        if ( p->node_id < 0 )
+            continue;
+        fwd = &summary[i].metric[STATS_FORWARD];
+        row[p->node_id].median = fwd->median;
+        row[p->node_id].p90 = fwd->p90;
+        row[p->node_id].min = fwd->min;
+        row[p->node_id].jitter = fwd->jitter;
+        row[p->node_id].loss = p->received + p->lost ? (double) p->lost / (p->received + p->lost) : 0;
+        row[p->node_id].reorder = p->received ? (double) p->reordered / p->received : 0;
+        row[p->node_id].samples = fwd->count;
+        row[p->node_id].updated = time(NULL);
+    }
+    shm_row_write_end(shm, self);
+}
+
+/* what the scheduler did since the last report */
+void print_schedule()
+{
+    uint32_t low = UINT32_MAX, high = 0, interval, deferred = 0, sent = 0;
+    double demand = 0, sum = 0;
+    int i;
+
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_lock(&workers[i].lock);
+    for ( i = 0; i < total_servers; i++ ) {
+        interval = peer_interval(&peers[i]);
+        low = interval < low ? interval : low;
+        high = interval > high ? interval : high;
+        sum += interval;
+        sent += peers[i].sent;
+    }
+    for ( i = 0; i < nworkers; i++ ) {
+        demand += workers[i].demand;
+        deferred += workers[i].deferred;
+        workers[i].deferred = 0;
+    }
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_unlock(&workers[i].lock);
+
+    if ( total_servers > 0 )
+        printf("schedule: intervals %u/%.0f/%u ms (min/mean/max), %.1f probe(s)/s asked, %u sent, %u deferred by the budget\n",
+               low, sum / total_servers, high, demand, sent, deferred);
+}
+
+/* how long our probes waited in the reflectors: a deep queue there means the senders collide */
+void print_turnaround(peer_summary *summary)
+{
+    stats_summary *t;
+    double sum = 0;
+    int i, n = 0, worst = -1;
+
+    for ( i = 0; i < total_servers; i++ ) {
+        t = &summary[i].metric[STATS_TURNAROUND];
+        if ( !t->count )
+            continue;
+        sum += t->median;
+        n++;
+        if ( worst < 0 || t->p99 > summary[worst].metric[STATS_TURNAROUND].p99 )
+            worst = i;
+    }
+    if ( n > 0 )
+        printf("reflector turnaround: median %.1f us over %d peer(s), worst p99 %.1f us at %s\n", sum / n * 1000, n,
+               summary[worst].metric[STATS_TURNAROUND].p99 * 1000, peers[worst].name);
+}
+
+/* what the trains found, and how many of them the -T budget held back since the start */
+void print_bandwidth(peer_summary *summary)
+{
+    train_estimate *t;
+    uint32_t skipped = 0;
+    int i;
+
+    if ( !train_packets )
+        return;
+    for ( i = 0; i < total_servers; i++ ) {
+        t = &summary[i].train;
+        if ( t->trains )
+            printf("%s: capacity %.1f Mbit/s, available %.1f Mbit/s over %d train(s), %d paced\n", peers[i].name,
+                   t->capacity, t->available, t->trains, t->paced);
+    }
+    for ( i = 0; i < nworkers; i++ )
+        skipped += __atomic_load_n(&workers[i].trains_skipped, __ATOMIC_RELAXED);
+    if ( skipped )
+        printf("trains: %u over the budget of %.0f bytes per round\n", skipped, train_budget);
+}
+
+void send_report()
+{
+    int sockfd, i;
+    size_t len;
+    char *buffer, *pos;
+    struct sockaddr_in servaddr;
+    peer_summary *summary = summarize_peers();
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = inet_addr(serverIp);
+    servaddr.sin_port = htons(CONTROLLER_PORT);
+
+    if ( shm_name )
+        publish_row(summary);
+    if ( probe_interval )
+        print_schedule();
+    print_turnaround(summary);
+    print_bandwidth(summary);
+
+    if ( binary_report || node_id >= 0 ) {
+        send_binary_report(sockfd, &servaddr, summary);
+        close(sockfd);
+        free(summary);
+        return;
+    }
+
+    len = strlen(serverName) + sizeof(" end ");
+    for (i = 0; i < total_servers; i++)
+        len += strlen(peers[i].name) + 32;
+
+    buffer = (char *) malloc (len);
+    pos = buffer + sprintf(buffer, "%s ", serverName);
+    for (i = 0; i < total_servers; i++)
+        pos += sprintf(pos, "%s:%f ", peers[i].name, summary[i].metric[STATS_FORWARD].median);
+    sprintf(pos, "end ");
+    printf("buffer: %s\n", buffer);
+
+    if ( sendto(sockfd, buffer, strlen(buffer), 0, (struct sockaddr *)&servaddr, sizeof(servaddr)) < 0 )
+        perror("send_report sendto");
+
+    close(sockfd);
+    free(buffer);
+    free(summary);
+}
+
+void start_workers()
+{
+    int i;
+
+    if ( nworkers < 1 )
+        nworkers = 1;
+    if ( nworkers > MAX_WORKERS )
+        nworkers = MAX_WORKERS;
+
+    if ( ( done_fd = eventfd(0, 0) ) < 0 ) {
+        perror("start_workers eventfd");
+        exit(EXIT_FAILURE);
+    }
+
+    if ( ( link_fd = socket(AF_INET, SOCK_DGRAM, 0) ) < 0 )
+        perror("start_workers socket");
+
+    workers = (worker *) calloc (nworkers, sizeof(worker));
+    peer_by_id = (peer **) calloc (MAX_PEER_ID, sizeof(peer *));
+    for ( i = 0; i < nworkers; i++ ) {
+        pthread_mutex_init(&workers[i].lock, NULL);
+        workers[i].epfd = epoll_create1(0);
+        workers[i].timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        workers[i].eventfd = eventfd(0, EFD_NONBLOCK);
+        workers[i].pacedfd = eventfd(0, EFD_NONBLOCK);
+        if ( history )
+            workers[i].history = (history_ring *) calloc(1, sizeof(history_ring));
+        if ( workers[i].epfd < 0 || workers[i].timerfd < 0 || workers[i].eventfd < 0 || workers[i].pacedfd < 0 ) {
+            perror("worker create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_create( &workers[i].thread, NULL, one_way_client, (void *) &workers[i] );
+    }
+    printf("one_way_client started with %d worker(s)\n", nworkers);
+}
+
+/* A peer id nobody uses: it stays the peer's for as long as it is configured, in its probes and epoll events. */
+int peer_new_id()
+{
+    int i;
+
+    for ( i = 0; i < MAX_PEER_ID; i++, next_peer_id++ )
+        if ( !peer_by_id[next_peer_id % MAX_PEER_ID] )
+            return next_peer_id++ % MAX_PEER_ID;
+    return -1;
+}
+
+int find_peer(const char *name)
+{
+    int i;
+
+    for ( i = 0; i < total_servers; i++ )
+        if ( strcmp(peers[i].name, name) == 0 )
+            return i;
+    return -1;
+}
+
+/* A peer that moved to another address: the socket is connected there and its delay window starts over. */
+void peer_readdress(peer *p, const char *ip)
+{
+    free(p->ip);
+    p->ip = strdup(ip);
+    p->servaddr.sin_addr.s_addr = inet_addr(ip);
+    if ( connect( p->sockfd, (struct sockaddr *) &p->servaddr, sizeof(struct sockaddr_in) ) < 0 )
+        perror("peer_readdress connect");
+    stats_init(p->stats, stats_window);
+    peer_abandon_train(p);
+    train_init(&p->train);
+    printf("%s moved to %s\n", p->name, ip);
+}
+
+/*
+ * Swap in the array of n peers, recut the slices of the workers and move every socket to the epoll set of the
+ * worker that now owns it. The workers must be locked. A peer that just joined starts probing right away if its
+ * worker is in a round (continuous or not); a worker whose slice changed wakes up to take it into account.
+ */
+void install_peers(peer *next, int n)
+{
+    struct itimerspec now_its = { { 0, 0 }, { 0, 1 } };
+    struct epoll_event ev;
+    uint64_t now = monotonic_ms();
+    double share;
+    int i, j, k, chunk, sampled;
+    worker *w;
+    peer *p;
+
+    peers = next;
+    total_servers = n;
+    memset(peer_by_id, 0, MAX_PEER_ID * sizeof(peer *));
+    for ( i = 0; i < n; i++ )
+        peer_by_id[peers[i].id] = &peers[i];
+
+    chunk = (total_servers + nworkers - 1) / nworkers;
+    for ( i = 0, j = 0; i < nworkers; i++, j += chunk ) {
+        w = &workers[i];
+        w->peers = &peers[j < total_servers ? j : total_servers];
+        w->npeers = ( j + chunk <= total_servers ) ? chunk : total_servers - j;
+        if ( w->npeers < 0 )
+            w->npeers = 0;
+        share = total_servers ? (double) w->npeers / total_servers : 0;
+        bucket_init(&w->packets, budget_pps * share, 1, now);
+        bucket_init(&w->bytes, budget_bps * share, PROBE_BYTES, now);
+        w->demand = 0;
+
+        for ( k = 0, w->finished = 0, sampled = 0; k < w->npeers; k++ ) {
+            p = &w->peers[k];
+            sampled += p->sampled != 0;
+            if ( p->epfd != w->epfd ) {
+                if ( p->epfd >= 0 )
+                    epoll_ctl( p->epfd, EPOLL_CTL_DEL, p->sockfd, NULL );
+                ev.events = EPOLLIN;
+                ev.data.u32 = p->id;
+                if ( epoll_ctl( w->epfd, EPOLL_CTL_ADD, p->sockfd, &ev ) < 0 )
+                    perror("install_peers epoll_ctl");
+                p->epfd = w->epfd;
+                peer_move_train(p, w->pacedfd);
+            }
+            if ( p->joined && w->active && p->sampled ) {
+                p->first_send = now;
+                peer_round_start(p);
+            }
+            p->joined = 0;
+            if ( p->state == PEER_DONE )
+                w->finished++;
+        }
+        /* the trains left of the round were planned for the slice before */
+        if ( w->trains_left > TRAINS_PER_PEER * sampled )
+            w->trains_left = TRAINS_PER_PEER * sampled;
+        if ( w->train_cursor >= w->npeers )
+            w->train_cursor = 0;
+        /* the peer it waited for the pacer on may be gone from the slice */
+        if ( w->train_at == UINT64_MAX )
+            w->train_at = now;
+        if ( w->active && timerfd_settime( w->timerfd, 0, &now_its, NULL ) < 0 )
+            perror("install_peers timerfd_settime");
+    }
+}
+
+/*
+ * Bring the peers to a new set without stopping anybody: every name:ip[:id] of list is added, or takes the
+ * address and id given if a peer of that name exists; PEERS_REPLACE drops the peers list does not name,
+ * PEERS_UPDATE only changes the known ones and PEERS_REMOVE drops the named ones (list is then just names). The peers that stay keep their socket,
+ * windows, clock estimate and schedule, and the workers are locked only while the array is swapped. At most
+ * max peers are taken from the list.
+ */
+int update_peers(char *list, int mode, int max)
+{
+    char *ptr, *save, *pname, *ip, *id, *field;
+    char **ips;
+    int *keep, *ids, i, j, n, kept, fresh = 0, changed = 0, count, free_id;
+    peer *next, *old = peers, *added;
+
+    for ( ptr = list, count = 1; *ptr; ptr++ )
+        count += *ptr == '|';
+    if ( max > count )
+        max = count;
+
+    keep = (int *) calloc(total_servers + 1, sizeof(int));
+    for ( i = 0; i < total_servers; i++ )
+        keep[i] = mode != PEERS_REPLACE;
+    ips = (char **) calloc(total_servers + 1, sizeof(char *));
+    ids = (int *) malloc((total_servers + 1) * sizeof(int));
+    for ( i = 0; i < total_servers; i++ )
+        ids[i] = -1;
+    added = (peer *) calloc(max > 0 ? max : 1, sizeof(peer));
+
+    for ( ptr = strtok_r(list, "|", &save), count = 0; ptr && count < max; ptr = strtok_r(NULL, "|", &save) ) {
+        pname = strtok_r(ptr, ":", &field);
+        ip = strtok_r(NULL, ":", &field);
+        id = strtok_r(NULL, ":", &field);
+        if ( !pname || ( !ip && mode != PEERS_REMOVE ) )
+            continue;
+        count++;
+        if ( ( i = find_peer(pname) ) >= 0 ) {
+            keep[i] = mode != PEERS_REMOVE;
+            if ( mode != PEERS_REMOVE ) {
+                ips[i] = strcmp(peers[i].ip, ip) ? ip : NULL;
+                ids[i] = id ? atoi(id) : -1;
+                changed += ips[i] != NULL || ( ids[i] >= 0 && ids[i] != peers[i].node_id );
+            }
+            continue;
+        }
+        if ( mode == PEERS_REMOVE || mode == PEERS_UPDATE )
+            continue;
+        for ( j = 0; j < fresh && strcmp(added[j].name, pname); j++ )
+            ;
+        if ( j < fresh )
+            continue;
+        added[fresh].name = strdup(pname);
+        added[fresh].ip = strdup(ip);
+        added[fresh].node_id = id ? atoi(id) : -1;
+        added[fresh].epfd = -1;
+        added[fresh].joined = 1;
+        added[fresh].sampled = sample_size <= 0;
+        if ( peer_open(&added[fresh]) == 0 )
+            fresh++;
+        else {
+            close(added[fresh].sockfd);
+            free(added[fresh].name);
+            free(added[fresh].ip);
+        }
+    }
+
+    for ( i = 0, kept = 0; i < total_servers; i++ )
+        kept += keep[i];
+    if ( kept == total_servers && !fresh && !changed ) {
+        free(keep);
+        free(ips);
+        free(ids);
+        free(added);
+        return 0;
+    }
+
+    /* a peer added without an id gets one above every id in use, ours and the ones just given included */
+    free_id = node_id + 1;
+    for ( i = 0; i < total_servers; i++ ) {
+        if ( peers[i].node_id >= free_id )
+            free_id = peers[i].node_id + 1;
+        if ( ids[i] >= free_id )
+            free_id = ids[i] + 1;
+    }
+    for ( i = 0; i < fresh; i++ )
+        if ( added[i].node_id >= free_id )
+            free_id = added[i].node_id + 1;
+    for ( i = 0; i < fresh; i++ )
+        if ( added[i].node_id < 0 )
+            added[i].node_id = free_id++;
+
+    n = kept + fresh;
+    next = (peer *) calloc(n > 0 ? n : 1, sizeof(peer));
+    for ( i = 0; i < fresh; i++ )
+        added[i].id = peer_new_id();
+
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_lock(&workers[i].lock);
+    for ( i = 0, j = 0; i < total_servers; i++ ) {
+        if ( !keep[i] )
+            continue;
+        next[j] = peers[i];
+        if ( ips[i] )
+            peer_readdress(&next[j], ips[i]);
+        if ( ids[i] >= 0 )
+            next[j].node_id = ids[i];
+        j++;
+    }
+    memcpy(next + j, added, fresh * sizeof(peer));
+    i = total_servers;
+    install_peers(next, n);
+    for ( j = 0; j < nworkers; j++ )
+        pthread_mutex_unlock(&workers[j].lock);
+
+    /* the peers that left are out of every slice and epoll set by now */
+    for ( j = 0; j < i; j++ )
+        if ( !keep[j] ) {
+            printf("%s removed\n", old[j].name);
+            peer_close(&old[j]);
+        }
+    for ( j = 0; j < fresh; j++ )
+        printf("%s added at %s, id %d\n", added[j].name, added[j].ip, added[j].node_id);
+    printf("configured %d peer(s)\n", total_servers);
+
+    free(old);
+    free(keep);
+    free(ips);
+    free(ids);
+    free(added);
+    return 0;
+}
+
+/*
+ * Take the peer list of a round. Peers of the previous list that are in this one too (by name) keep their
+ * socket and all their state, see update_peers(); the workers need not be idle.
+ */
+int configure(int total, char *name, char *list, char *controller_ip, int node)
+{
+    node_id = node;
+    free(serverName);
+    free(serverIp);
+    serverName = strdup(name);
+    serverIp = strdup(controller_ip);
+    __atomic_store_n(&controller_addr, inet_addr(serverIp), __ATOMIC_RELAXED);
+
+    if ( peerList && strcmp(peerList, list) == 0 && total == total_servers )
+        return 0;
+
+    free(peerList);
+    peerList = strdup(list);
+    return update_peers(list, PEERS_REPLACE, total);
+}
+
+/* relays in the controller's numbering, us included */
+int relay_count()
+{
+    int i, n = self_id() + 1;
+
+    for ( i = 0; i < total_servers; i++ )
+        if ( peers[i].node_id >= n )
+            n = peers[i].node_id + 1;
+    return n;
+}
+
+/*
+ * The slot of p in a round of n relays, or -1 if it is not probed. Relay s probes relay (s + d) % n in slot k:
+ * without a sample the n - 1 distances d take turns in an order rotated by the round number; with -V only the
+ * sample_size distances after round * sample_size are probed, so every peer comes up once every
+ * (n - 1) / sample_size rounds and every relay probes the same distances at the same time.
+ */
+int peer_slot(peer *p, int n, uint32_t round)
+{
+    int d = ( ( p->node_id - self_id() ) % n + n ) % n, span = n - 1, k;
+
+    if ( d == 0 )
+        return -1;
+    if ( sample_size <= 0 || sample_size >= span )
+        return ( d - 1 + round ) % span;
+    k = (int) ( ( d - 1 - (int64_t) round * sample_size ) % span );
+    k = k < 0 ? k + span : k;
+    return k < sample_size ? k : -1;
+}
+
+/*
+ * Pick the peers of a round and when each one starts. Staggered rounds: a round is cut into one slot of
+ * slot_ms per probed distance, so that each reflector hears from one sender per slot. All the agents must
+ * agree on when slot 0 starts and on the round number: the d command says so, or else it is the next multiple
+ * of the round length in wall clock time. In continuous mode the same order spreads the first probes to the
+ * peers over one interval instead, and a peer that joins the sample starts at its slot.
+ * Returns the monotonic ms of the last slot.
+ */
+uint64_t plan_round(uint64_t now)
+{
+    uint64_t wall = probe_now_ns() / 1000000, start = wall, frame = 1, last = now;
+    uint32_t round;
+    int i, k, n = relay_count(), span, staggered, sampled = 0;
+    peer *p;
+
+    span = sample_size > 0 && sample_size < n - 1 ? sample_size : n - 1;
+    staggered = slot_ms && node_id >= 0 && total_servers > 0;
+    if ( staggered )
+        frame = probe_interval ? (uint64_t) probe_interval : (uint64_t) span * slot_ms;
+    if ( stagger_start > wall ) {
+        start = stagger_start;
+        round = stagger_round;
+        local_round = round + 1;
+    } else if ( staggered ) {
+        start = ( ( wall + STAGGER_GUARD_MS ) / frame + 1 ) * frame;
+        round = start / frame;
+    } else
+        round = local_round++;
+
+    for ( i = 0; i < total_servers; i++ ) {
+        p = &peers[i];
+        k = peer_slot(p, n, round);
+        p->first_send = staggered && k >= 0 ? now + ( start - wall ) +
+                        ( probe_interval ? (uint64_t) k * probe_interval / span : (uint64_t) k * slot_ms ) : now;
+        if ( k >= 0 && !p->sampled && probe_interval )
+            p->next_send = p->first_send;
+        p->sampled = k >= 0;
+        sampled += p->sampled;
+        if ( p->sampled && p->first_send > last )
+            last = p->first_send;
+    }
+    if ( staggered )
+        printf("staggered round %u: %d slot(s) of %d ms from %llu\n", round, span,
+               probe_interval ? (int) ( frame / span ) : slot_ms, (unsigned long long) start);
+    if ( sampled < total_servers )
+        printf("round %u probes %d of %d peer(s)\n", round, sampled, total_servers);
+    return last;
+}
+
+/* continuous mode: the next peers of the sample take over */
+void rotate_sample()
+{
+    int i;
+
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_lock(&workers[i].lock);
+    plan_round(monotonic_ms());
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_unlock(&workers[i].lock);
+}
+
+void start_round()
+{
+    uint64_t one = 1, last;
+    int i;
+
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_lock(&workers[i].lock);
+    last = plan_round(monotonic_ms());
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_unlock(&workers[i].lock);
+
+    round_end = last + ROUND_DEADLINE_MS;
+    pending = nworkers;
+    for ( i = 0; i < nworkers; i++ )
+        if ( write( workers[i].eventfd, &one, sizeof(one) ) < 0 )
+            perror("start_round eventfd write");
+}
+
+void reset_counters()
+{
+    int i;
+
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_lock(&workers[i].lock);
+    for ( i = 0; i < total_servers; i++ ) {
+        peers[i].sent = 0;
+        peers[i].received = 0;
+        peers[i].lost = 0;
+        peers[i].late = 0;
+        peers[i].duplicates = 0;
+        peers[i].reordered = 0;
+    }
+    for ( i = 0; i < nworkers; i++ )
+        pthread_mutex_unlock(&workers[i].lock);
+}
+
+/* Returns 1 when the last worker of the round has reported back. */
+int round_done()
+{
+    uint64_t value;
+
+    if ( read( done_fd, &value, sizeof(value) ) < 0 ) {
+        perror("round_done eventfd read");
+        return 0;
+    }
+    pending -= value;
+    return pending <= 0;
+}
+
+/*
+ * The history id of an address that is not a relay: ADDRESS_ID_BASE and up, in the order they were first seen,
+ * kept in ADDRESSES_FILE ("id ip" lines) next to the history. Only the ICMP thread calls it.
+ */
+int address_id(struct in_addr a)
+{
+    char path[4096], ip[INET_ADDRSTRLEN];
+    FILE *f;
+    int i, id;
+
+    if ( !addresses ) {
+        addresses = (struct in_addr *) calloc(ADDRESS_NONE - ADDRESS_ID_BASE, sizeof(struct in_addr));
+        snprintf(path, sizeof(path), "%s/%s", history_dir, ADDRESSES_FILE);
+        if ( history && ( f = fopen(path, "r") ) != NULL ) {
+            while ( naddresses < ADDRESS_NONE - ADDRESS_ID_BASE && fscanf(f, "%d %15s", &id, ip) == 2 )
+                if ( id == ADDRESS_ID_BASE + naddresses && inet_pton(AF_INET, ip, &addresses[naddresses]) == 1 )
+                    naddresses++;
+            fclose(f);
+        }
+    }
+
+    for ( i = 0; i < naddresses; i++ )
+        if ( addresses[i].s_addr == a.s_addr )
+            return ADDRESS_ID_BASE + i;
+    if ( naddresses == ADDRESS_NONE - ADDRESS_ID_BASE )
+        return ADDRESS_NONE;
+
+    addresses[naddresses] = a;
+    snprintf(path, sizeof(path), "%s/%s", history_dir, ADDRESSES_FILE);
+    if ( history && ( f = fopen(path, "a") ) != NULL ) {
+        fprintf(f, "%d %s\n", ADDRESS_ID_BASE + naddresses, inet_ntoa(a));
+        fclose(f);
+    }
+    return ADDRESS_ID_BASE + naddresses++;
+}
+
+/* Pings as samples of us to the target, hops as (hop, target) with the TTL in the forward delay column. */
+void history_icmp(icmp_target *t)
+{
+    int k, ttl, j, hop;
+
+    if ( !history )
+        return;
+    pthread_mutex_lock(&history_lock);
+    for ( k = 0; k < t->ping; k++ )
+        tsdb_append(history, t->time + (int64_t) k * ICMP_PING_SPACING_MS * 1000000, self_id(), t->id,
+                    t->ping_rtt[k], NAN, NAN, isnan(t->ping_rtt[k]) ? 1 : 0);
+    for ( ttl = 1; ttl <= t->hops; ttl++ )
+        for ( j = 0; j < ICMP_TRACE_PROBES; j++ ) {
+            hop = t->hop[ttl - 1][j].from.s_addr == INADDR_ANY ? ADDRESS_NONE :
+                  t->hop[ttl - 1][j].from.s_addr == t->addr.s_addr ? t->id : address_id(t->hop[ttl - 1][j].from);
+            tsdb_append(history, t->time, hop, t->id, t->hop[ttl - 1][j].rtt, ttl, NAN,
+                        isnan(t->hop[ttl - 1][j].rtt) ? 1 : 0);
+        }
+    pthread_mutex_unlock(&history_lock);
+}
+
+void print_icmp(icmp_target *t)
+{
+    double min = INFINITY, max = 0, sum = 0;
+    int k, received = 0;
+
+    if ( t->ping ) {
+        for ( k = 0; k < t->ping; k++ )
+            if ( !isnan(t->ping_rtt[k]) ) {
+                min = fmin(min, t->ping_rtt[k]);
+                max = fmax(max, t->ping_rtt[k]);
+                sum += t->ping_rtt[k];
+                received++;
+            }
+        if ( received )
+            printf("ping %s: %d/%d, rtt min/avg/max = %.3f/%.3f/%.3f ms\n", inet_ntoa(t->addr), received, t->ping,
+                   min, sum / received, max);
+        else
+            printf("ping %s: 0/%d\n", inet_ntoa(t->addr), t->ping);
+    }
+    if ( t->trace ) {
+        if ( t->reached )
+            printf("traceroute %s: %d hop(s)\n", inet_ntoa(t->addr), t->reached);
+        else
+            printf("traceroute %s: not reached in %d hops\n", inet_ntoa(t->addr), ICMP_MAX_TTL);
+    }
+}
+
+typedef struct icmp_job {
+    icmp_target *targets;
+    int n;
+} icmp_job;
+
+void * icmp_thread(void *ptr)
+{
+    icmp_job *job = (icmp_job *) ptr;
+    uint64_t start = monotonic_ms();
+    int i;
+
+    if ( icmp_run(icmp, job->targets, job->n) == 0 ) {
+        for ( i = 0; i < job->n; i++ ) {
+            if ( job->targets[i].id < 0 )
+                job->targets[i].id = address_id(job->targets[i].addr);
+            history_icmp(&job->targets[i]);
+            print_icmp(&job->targets[i]);
+        }
+        printf("icmp: %d target(s) in %llu ms\n", job->n, (unsigned long long) ( monotonic_ms() - start ));
+        fflush(stdout);
+    }
+    free(job->targets);
+    free(job);
+    __atomic_store_n(&icmp_busy, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Add the comma separated addresses of list to the targets, to ping or to trace. */
+int icmp_targets(icmp_target *t, int n, int max, char *list, int trace)
+{
+    struct in_addr a;
+    char *ip, *save;
+    int i;
+
+    for ( ip = strtok_r(list, ",", &save); ip; ip = strtok_r(NULL, ",", &save) ) {
+        if ( inet_pton(AF_INET, ip, &a) != 1 )
+            continue;
+        for ( i = 0; i < n && t[i].addr.s_addr != a.s_addr; i++ )
+            ;
+        if ( i == n ) {
+            if ( n == max )
+                continue;
+            t[n].addr = a;
+            t[n++].id = -1;
+        }
+        if ( trace )
+            t[i].trace = 1;
+        else
+            t[i].ping = ICMP_PING_COUNT;
+    }
+    return n;
+}
+
+/* i <ip,ip,...|-> <ip,ip,...|->: ping the first list and trace the second, in the background. */
+void start_icmp(char *ping, char *trace)
+{
+    pthread_t thread;
+    icmp_job *job;
+    int i, j, max = ( strlen(ping) + strlen(trace) ) / 8 + 2;
+
+    if ( __atomic_exchange_n(&icmp_busy, 1, __ATOMIC_ACQUIRE) ) {
+        printf("icmp run in progress, ignoring request\n");
+        return;
+    }
+    if ( !icmp && ( icmp = icmp_open() ) == NULL ) {
+        __atomic_store_n(&icmp_busy, 0, __ATOMIC_RELEASE);
+        return;
+    }
+
+    job = (icmp_job *) calloc(1, sizeof(icmp_job));
+    job->targets = (icmp_target *) calloc(max, sizeof(icmp_target));
+    job->n = icmp_targets(job->targets, 0, max, ping, 0);
+    job->n = icmp_targets(job->targets, job->n, max, trace, 1);
+
+    /* a relay keeps its own id, so its pings sit next to its one way delays */
+    for ( i = 0; i < job->n; i++ )
+        for ( j = 0; j < total_servers; j++ )
+            if ( peers[j].servaddr.sin_addr.s_addr == job->targets[i].addr.s_addr )
+                job->targets[i].id = peers[j].node_id;
+
+    if ( pthread_create( &thread, NULL, icmp_thread, (void *) job ) != 0 ) {
+        perror("start_icmp pthread_create");
+        free(job->targets);
+        free(job);
+        __atomic_store_n(&icmp_busy, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    pthread_detach(thread);
+}
+
+void handle_command(char *cmd)
+{
+    char *argv[9], *save;
+    int argc = 0;
+
+    while ( argc < 9 && ( argv[argc] = strtok_r(argc ? NULL : cmd, " \t\r\n", &save) ) != NULL )
+        argc++;
+
+    if ( ( argc == 5 || argc == 6 || argc >= 8 ) && strcmp(argv[0], "d") == 0 ) {
+        if ( pending > 0 ) {
+            printf("round in progress, ignoring request\n");
+            return;
+        }
+        configure(atoi(argv[1]), argv[2], argv[3], argv[4], argc >= 6 ? atoi(argv[5]) : -1);
+        /* d ... node_id start_ms:round slot_ms [sample]: the controller's staggered schedule */
+        if ( argc >= 8 ) {
+            stagger_start = strtoull(argv[6], NULL, 10);
+            stagger_round = strchr(argv[6], ':') ? strtoul(strchr(argv[6], ':') + 1, NULL, 10) : 0;
+            slot_ms = atoi(argv[7]);
+        }
+        if ( argc == 9 )
+            sample_size = atoi(argv[8]);
+        start_round();
+        if ( probe_interval ) {
+            /* the workers never finish a round: report the window and start counting the loss anew */
+            pending = 0;
+            send_report();
+            reset_counters();
+        }
+        return;
+    }
+
+    /* a <name:ip[:id]|...>: add peers (or move them), u: move them, r <name|...>: remove them */
+    if ( argc == 2 && ( strcmp(argv[0], "a") == 0 || strcmp(argv[0], "u") == 0 || strcmp(argv[0], "r") == 0 ) ) {
+        update_peers(argv[1], argv[0][0] == 'r' ? PEERS_REMOVE : argv[0][0] == 'u' ? PEERS_UPDATE : PEERS_ADD,
+                     MAX_PEER_ID);
+        return;
+    }
+
+    if ( argc == 3 && strcmp(argv[0], "i") == 0 ) {
+        start_icmp(argv[1], argv[2]);
+        return;
+    }
+
+    printf("unknown command: %s\n", argc ? argv[0] : "");
+}
+
+/* The metrics of the threads and the counters of every peer as a Prometheus text page, in main. */
+char *render_metrics(size_t *len)
+{
+    static const char *outcome[PEER_COUNTERS] = { "sent", "received", "lost", "late" };
+    size_t size = METRICS_PAGE, n;
+    char *page = NULL;
+    int i, c;
+
+    for (;;) {
+        page = (char *) realloc(page, size);
+        n = metrics_render(page, size);
+        if ( n < size )
+            n += snprintf(page + n, size - n, "# HELP cxp_probes_total Probes of every peer by outcome.\n"
+                          "# TYPE cxp_probes_total counter\n");
+        for ( i = 0; i < total_servers && n < size; i++ )
+            for ( c = 0; c < PEER_COUNTERS && n < size; c++ )
+                n += snprintf(page + n, size - n, "cxp_probes_total{peer=\"%s\",node=\"%d\",outcome=\"%s\"} %llu\n",
+                              peers[i].name, peers[i].node_id, outcome[c],
+                              (unsigned long long) __atomic_load_n(&peers[i].total[c], __ATOMIC_RELAXED));
+        if ( n < size )
+            break;
+        size *= 2;
+    }
+    *len = n;
+    return page;
+}
+
+int metrics_listen(int port)
+{
+    struct sockaddr_in local_addr;
+    int sockfd, on = 1;
+
+    if ( ( sockfd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP ) ) < 0 ) {
+        perror("metrics_listen socket");
+        return -1;
+    }
+    setsockopt( sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on) );
+
+    memset( &local_addr, 0, sizeof( local_addr ) );
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local_addr.sin_port = htons(port);
+
+    if ( bind( sockfd, ( struct sockaddr * ) &local_addr, sizeof( local_addr ) ) < 0 || listen( sockfd, 8 ) < 0 ) {
+        perror("metrics_listen bind");
+        close(sockfd);
+        return -1;
+    }
+    printf("metrics on http://127.0.0.1:%d/metrics\n", port);
+    return sockfd;
+}
+
+/* Answer one scrape, whatever it asked for, with the whole page. */
+void serve_metrics(int listenfd)
+{
+    static const char header[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                 "Connection: close\r\n\r\n";
+    struct timeval tv = { 0, 100000 };
+    char request[4096], *page;
+    size_t len, off;
+    ssize_t ret;
+    int fd;
+
+    if ( ( fd = accept( listenfd, NULL, NULL ) ) < 0 )
+        return;
+    setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv) );
+    setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv) );
+    if ( recv( fd, request, sizeof(request), 0 ) > 0 ) {
+        page = render_metrics(&len);
+        if ( send( fd, header, sizeof(header) - 1, MSG_NOSIGNAL ) > 0 )
+            for ( off = 0; off < len; off += ret )
+                if ( ( ret = send( fd, page + off, len - off, MSG_NOSIGNAL ) ) <= 0 )
+                    break;
+        free(page);
+    }
+    close(fd);
+}
+
+void run_daemon(int control_port)
+{
+    struct sockaddr_in local_addr;
+    struct epoll_event ev, events[4];
+    struct itimerspec its;
+    char cmd[65536];
+    int epfd, sockfd, reportfd = -1, metricsfd = -1, i, n;
+    uint64_t value;
+    ssize_t len;
+
+    if ( ( sockfd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP ) ) < 0 ) {
+        perror("run_daemon socket");
+        exit( EXIT_FAILURE );
+    }
+
+    memset( &local_addr, 0, sizeof( local_addr ) );
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local_addr.sin_port = htons(control_port);
+
+    if ( bind( sockfd, ( struct sockaddr * ) &local_addr, sizeof( local_addr ) ) < 0 ) {
+        perror("run_daemon bind");
+        exit( EXIT_FAILURE );
+    }
+
+    epfd = epoll_create1(0);
+    ev.events = EPOLLIN;
+    ev.data.fd = sockfd;
+    epoll_ctl( epfd, EPOLL_CTL_ADD, sockfd, &ev );
+    ev.data.fd = done_fd;
+    epoll_ctl( epfd, EPOLL_CTL_ADD, done_fd, &ev );
+
+    if ( report_interval > 0 && probe_interval ) {
+        reportfd = timerfd_create(CLOCK_MONOTONIC, 0);
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = its.it_interval.tv_sec = report_interval / 1000;
+        its.it_value.tv_nsec = its.it_interval.tv_nsec = (report_interval % 1000) * 1000000;
+        timerfd_settime(reportfd, 0, &its, NULL);
+        ev.data.fd = reportfd;
+        epoll_ctl( epfd, EPOLL_CTL_ADD, reportfd, &ev );
+    }
+
+    if ( metrics_port > 0 && ( metricsfd = metrics_listen(metrics_port) ) >= 0 ) {
+        metrics_register("main");
+        ev.data.fd = metricsfd;
+        epoll_ctl( epfd, EPOLL_CTL_ADD, metricsfd, &ev );
+    }
+
+    printf("waiting for commands on port %d\n", control_port);
+    fflush(stdout);
+
+    for (;;) {
+        if ( ( n = epoll_wait( epfd, events, 4, -1 ) ) < 0 ) {
+            perror("run_daemon epoll_wait");
+            continue;
+        }
+        for ( i = 0; i < n; i++ ) {
+            if ( events[i].data.fd == sockfd ) {
+                if ( ( len = recv( sockfd, cmd, sizeof(cmd) - 1, 0 ) ) <= 0 )
+                    continue;
+                cmd[len] = '\0';
+                handle_command(cmd);
+            } else if ( events[i].data.fd == metricsfd ) {
+                serve_metrics(metricsfd);
+            } else if ( events[i].data.fd == reportfd ) {
+                if ( read( reportfd, &value, sizeof(value) ) < 0 )
+                    perror("run_daemon timerfd read");
+                /* nothing to report before the first d command */
+                if ( serverIp && total_servers > 0 ) {
+                    send_report();
+                    reset_counters();
+                    if ( sample_size > 0 )
+                        rotate_sample();
+                }
+            } else if ( round_done() ) {
+                send_report();
+            }
+        }
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char**argv)
+{
+    int i, c, daemon_mode = 0, control_port = CONTROL_PORT, reflector_workers = 0;
+    char *ring_if = NULL;
+    pthread_t pacer, historian;
+
+    printf("Arguments:\n");
+    for (i=0;i<argc;i++) {
+        printf("\targv[%d]: %s\n",i,argv[i]);
+    }
+
+    while ( ( c = getopt(argc, argv, "A:B:bC:Dc:H:kM:m:R:S:T:t:u:V:w:W:X:") ) != -1 ) {
+        switch (c) {
+        case 'A':
+            adaptive = 1;
+            sched_cfg.max_ms = atoi(optarg);
+            sched_cfg.sensitivity = strchr(optarg, ':') ? atof(strchr(optarg, ':') + 1) : SCHED_SENSITIVITY;
+            break;
+        case 'B':
+            budget_pps = atof(optarg);
+            budget_bps = strchr(optarg, ':') ? atof(strchr(optarg, ':') + 1) : 0;
+            break;
+        case 'b':
+            binary_report = 1;
+            break;
+        case 'u':
+            delta_threshold = atof(optarg);
+            break;
+        case 'C':
+            probe_interval = atoi(optarg);
+            break;
+        case 'D':
+            daemon_mode = 1;
+            break;
+        case 'c':
+            control_port = atoi(optarg);
+            break;
+        case 'H':
+            history_dir = optarg;
+            break;
+        case 'k':
+            kernel_ts = 1;
+            break;
+        case 'M':
+            shm_name = optarg;
+            break;
+        case 'm':
+            metrics_port = atoi(optarg);
+            break;
+        case 'R':
+            report_interval = atoi(optarg);
+            break;
+        case 'S':
+            slot_ms = atoi(optarg);
+            break;
+        case 'T':
+            train_packets = atoi(optarg);
+            if ( strchr(optarg, ':') ) {
+                train_size = atoi(strchr(optarg, ':') + 1);
+                if ( strchr(strchr(optarg, ':') + 1, ':') )
+                    train_budget = atof(strchr(strchr(optarg, ':') + 1, ':') + 1);
+            }
+            break;
+        case 't':
+            nworkers = atoi(optarg);
+            break;
+        case 'V':
+            sample_size = atoi(optarg);
+            break;
+        case 'w':
+            reflector_workers = atoi(optarg);
+            break;
+        case 'W':
+            stats_window = atoi(optarg);
+            break;
+        case 'X':
+            ring_if = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-D [-c control_port] [-m metrics_port] [-C interval_ms [-A max_ms[:sensitivity]] [-R report_ms]]] [-B pps[:bytes_per_s]] [-b [-u ms]] [-H history_dir] [-k] [-M shm_name] [-S slot_ms] [-T packets[:bytes[:budget]]] [-t threads] [-V sample] [-w reflector_workers] [-W window_ms] [-X ifname] <total_servers> <name> <name:ip[:id]|...> <controller_ip> [node_id]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ( !daemon_mode && argc - optind < 4 ) {
+        fprintf(stderr, "Usage: %s [-D [-c control_port] [-m metrics_port] [-C interval_ms [-A max_ms[:sensitivity]] [-R report_ms]]] [-B pps[:bytes_per_s]] [-b [-u ms]] [-H history_dir] [-k] [-M shm_name] [-S slot_ms] [-T packets[:bytes[:budget]]] [-t threads] [-V sample] [-w reflector_workers] [-W window_ms] [-X ifname] <total_servers> <name> <name:ip[:id]|...> <controller_ip> [node_id]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* continuous probing only makes sense for a daemon that is asked for reports */
+    if ( !daemon_mode || probe_interval < 0 )
+        probe_interval = 0;
+    if ( adaptive && !probe_interval && daemon_mode )
+        probe_interval = SCHED_MIN_MS;
+    if ( !probe_interval )
+        adaptive = 0;
+    sched_cfg.min_ms = probe_interval > 0 ? probe_interval : 1;
+    if ( sched_cfg.max_ms < sched_cfg.min_ms )
+        sched_cfg.max_ms = sched_cfg.min_ms;
+    if ( sched_cfg.sensitivity <= 0 )
+        sched_cfg.sensitivity = SCHED_SENSITIVITY;
+    if ( probe_interval > 0 )
+        stats_samples = stats_window / probe_interval + 1;
+    if ( stats_samples > STATS_MAX_SAMPLES )
+        fprintf(stderr, "-W %u ms holds %u samples at -C %d ms, only the last %d are kept\n", stats_window,
+                stats_samples, probe_interval, STATS_MAX_SAMPLES);
+    if ( train_packets == 1 || train_packets < 0 )
+        train_packets = 2;
+    if ( train_packets > TRAIN_MAX_PACKETS )
+        train_packets = TRAIN_MAX_PACKETS;
+    if ( train_size < (int) PROBE_WIRE_SIZE )
+        train_size = PROBE_WIRE_SIZE;
+    if ( train_size > TRAIN_MAX_SIZE )
+        train_size = TRAIN_MAX_SIZE;
+
+    if ( history_dir[0] && ( history = tsdb_open(history_dir) ) == NULL )
+        fprintf(stderr, "%s: no delay history\n", history_dir);
+
+    if ( reflector_start( reflector_workers, kernel_ts, ring_if ) < 0 )
+        exit(EXIT_FAILURE);
+
+    if ( !daemon_mode && nworkers > atoi(argv[optind]) && atoi(argv[optind]) > 0 )
+        nworkers = atoi(argv[optind]);
+    start_workers();
+    if ( train_packets && pthread_create( &pacer, NULL, train_pacer, NULL ) != 0 ) {
+        perror("train_pacer pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    if ( history && pthread_create( &historian, NULL, history_thread, NULL ) != 0 ) {
+        perror("history_thread pthread_create");
+        exit(EXIT_FAILURE);
+    }
+
+    if ( daemon_mode ) {
+        run_daemon(control_port);
+        return 0;
+    }
+
+    configure(atoi(argv[optind]), argv[optind + 1], argv[optind + 2], argv[optind + 3],
+              argc - optind > 4 ? atoi(argv[optind + 4]) : -1);
+    start_round();
+    while ( !round_done() )
+        ;
+    send_report();
+    if ( history )
+        history_flush();
+    printf("exiting\n");
+
+    return 0;
+}
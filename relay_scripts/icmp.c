@@ -0,0 +1,360 @@
+/**
+ * [Title]: icmp.c -- parallel ping and traceroute over one raw socket
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * The probes of a run go out in two streams: the ping waves, wave k to every ping target at
+ * k * ICMP_PING_SPACING_MS, and the trace probes, target after target with all of its TTLs back to back. The
+ * waves go first whenever they are due, so their spacing holds, and the token bucket of sched.h paces both.
+ * The run ends when nothing is in flight or ICMP_TIMEOUT_MS after the last send.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/icmp.h>
+
+#include "sched.h"
+#include "icmp.h"
+
+#define ICMP_HEADER     8
+#define FLIGHTS         65536           /* one per sequence number */
+#define RECV_BUFFER     ( 1 << 20 )
+
+enum { FLIGHT_FREE, FLIGHT_WAIT };
+
+typedef struct flight {
+    int state;
+    int target;
+    int ttl;                        /* 0 for a ping */
+    int index;                      /* ping number or trace attempt */
+    int64_t sent;                   /* unix ns */
+} flight;
+
+struct icmp_engine {
+    int fd;
+    int ttl;                        /* set on fd */
+    uint16_t ident;
+    uint16_t seq;
+    int outstanding;
+    flight *flights;
+};
+
+static int64_t realtime_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t monotonic_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint16_t checksum(const uint8_t *b, size_t len)
+{
+    uint32_t sum = 0;
+    size_t i;
+
+    for ( i = 0; i + 1 < len; i += 2 )
+        sum += (uint32_t) b[i] << 8 | b[i + 1];
+    if ( len & 1 )
+        sum += (uint32_t) b[len - 1] << 8;
+    while ( sum >> 16 )
+        sum = ( sum & 0xffff ) + ( sum >> 16 );
+    return (uint16_t) ~sum;
+}
+
+icmp_engine *icmp_open()
+{
+    struct icmp_filter filter;
+    icmp_engine *e;
+    int on = 1, size = RECV_BUFFER;
+
+    if ( ( e = (icmp_engine *) calloc(1, sizeof(icmp_engine)) ) == NULL )
+        return NULL;
+    if ( ( e->flights = (flight *) calloc(FLIGHTS, sizeof(flight)) ) == NULL ) {
+        free(e);
+        return NULL;
+    }
+
+    if ( ( e->fd = socket( AF_INET, SOCK_RAW | SOCK_NONBLOCK, IPPROTO_ICMP ) ) < 0 ) {
+        perror("icmp_open socket");
+        free(e->flights);
+        free(e);
+        return NULL;
+    }
+
+    filter.data = ~( ( 1U << ICMP_ECHOREPLY ) | ( 1U << ICMP_DEST_UNREACH ) | ( 1U << ICMP_TIME_EXCEEDED ) );
+    if ( setsockopt( e->fd, SOL_RAW, ICMP_FILTER, &filter, sizeof(filter) ) < 0 )
+        perror("icmp_open ICMP_FILTER");
+    if ( setsockopt( e->fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on) ) < 0 )
+        perror("icmp_open SO_TIMESTAMPNS");
+    setsockopt( e->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size) );
+
+    e->ident = (uint16_t) getpid();
+    e->ttl = -1;
+    return e;
+}
+
+void icmp_close(icmp_engine *e)
+{
+    if ( !e )
+        return;
+    close(e->fd);
+    free(e->flights);
+    free(e);
+}
+
+static int icmp_send(icmp_engine *e, icmp_target *targets, int target, int ttl, int index)
+{
+    uint8_t packet[ICMP_HEADER + ICMP_PAYLOAD];
+    struct sockaddr_in addr;
+    flight *f;
+    int want = ttl ? ttl : 64;
+    uint16_t seq = e->seq++, sum;
+
+    if ( want != e->ttl ) {
+        if ( setsockopt( e->fd, IPPROTO_IP, IP_TTL, &want, sizeof(want) ) < 0 ) {
+            perror("icmp_send IP_TTL");
+            return -1;
+        }
+        e->ttl = want;
+    }
+
+    memset(packet, 0, sizeof(packet));
+    packet[0] = ICMP_ECHO;
+    packet[4] = e->ident >> 8;
+    packet[5] = e->ident & 0xff;
+    packet[6] = seq >> 8;
+    packet[7] = seq & 0xff;
+    sum = checksum(packet, sizeof(packet));
+    packet[2] = sum >> 8;
+    packet[3] = sum & 0xff;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr = targets[target].addr;
+
+    /* a probe still waiting for this sequence number is lost by now */
+    f = &e->flights[seq];
+    if ( f->state == FLIGHT_WAIT )
+        e->outstanding--;
+    f->target = target;
+    f->ttl = ttl;
+    f->index = index;
+    f->sent = realtime_ns();
+    if ( !targets[target].time )
+        targets[target].time = f->sent;
+
+    if ( sendto( e->fd, packet, sizeof(packet), 0, (struct sockaddr *) &addr, sizeof(addr) ) < 0 ) {
+        f->state = FLIGHT_FREE;
+        return errno == EAGAIN || errno == ENOBUFS ? 0 : -1;
+    }
+    f->state = FLIGHT_WAIT;
+    e->outstanding++;
+    return 0;
+}
+
+/* Match one datagram (with its IP header) to the probe it answers. */
+static void icmp_answer(icmp_engine *e, icmp_target *targets, int n, const uint8_t *b, ssize_t len, int64_t when)
+{
+    const uint8_t *icmp, *inner;
+    struct in_addr from, about;
+    uint16_t ident, seq;
+    int ihl, type;
+    icmp_target *t;
+    flight *f;
+    float rtt;
+
+    if ( len < 20 || ( ihl = ( b[0] & 0x0f ) * 4 ) < 20 || len < ihl + ICMP_HEADER )
+        return;
+    icmp = b + ihl;
+    type = icmp[0];
+    memcpy(&from, b + 12, 4);
+
+    if ( type == ICMP_ECHOREPLY ) {
+        ident = icmp[4] << 8 | icmp[5];
+        seq = icmp[6] << 8 | icmp[7];
+        about = from;
+    } else if ( type == ICMP_TIME_EXCEEDED || type == ICMP_DEST_UNREACH ) {
+        /* the quote: the IP header of our probe and the first 8 bytes of its ICMP header */
+        inner = icmp + ICMP_HEADER;
+        if ( len < inner - b + 20 || inner[9] != IPPROTO_ICMP )
+            return;
+        ihl = ( inner[0] & 0x0f ) * 4;
+        if ( ihl < 20 || len < inner - b + ihl + ICMP_HEADER || inner[ihl] != ICMP_ECHO )
+            return;
+        ident = inner[ihl + 4] << 8 | inner[ihl + 5];
+        seq = inner[ihl + 6] << 8 | inner[ihl + 7];
+        memcpy(&about, inner + 16, 4);
+    } else
+        return;
+
+    f = &e->flights[seq];
+    if ( ident != e->ident || f->state != FLIGHT_WAIT || f->target >= n ||
+         targets[f->target].addr.s_addr != about.s_addr )
+        return;
+    f->state = FLIGHT_FREE;
+    e->outstanding--;
+
+    t = &targets[f->target];
+    rtt = ( when - f->sent ) / 1e6;
+    if ( !f->ttl ) {
+        if ( type == ICMP_ECHOREPLY )
+            t->ping_rtt[f->index] = rtt;
+        return;
+    }
+    t->hop[f->ttl - 1][f->index].from = from;
+    t->hop[f->ttl - 1][f->index].rtt = rtt;
+    if ( type == ICMP_ECHOREPLY && ( !t->reached || f->ttl < t->reached ) )
+        t->reached = f->ttl;
+}
+
+static void icmp_drain(icmp_engine *e, icmp_target *targets, int n)
+{
+    uint8_t buf[1500];
+    char control[256];
+    struct iovec iov = { buf, sizeof(buf) };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct timespec *ts;
+    int64_t when;
+    ssize_t len;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if ( ( len = recvmsg( e->fd, &msg, 0 ) ) < 0 ) {
+            if ( errno != EAGAIN && errno != EINTR )
+                perror("icmp_drain recvmsg");
+            return;
+        }
+        when = 0;
+        for ( cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg) )
+            if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS ) {
+                ts = (struct timespec *) CMSG_DATA(cmsg);
+                when = (int64_t) ts->tv_sec * 1000000000LL + ts->tv_nsec;
+            }
+        icmp_answer(e, targets, n, buf, len, when ? when : realtime_ns());
+    }
+}
+
+int icmp_run(icmp_engine *e, icmp_target *targets, int n)
+{
+    token_bucket bucket;
+    uint64_t start = monotonic_ms(), now, wake, last_send = start;
+    int i, j, waves = 0, wave = 0, next = 0, traces = 0, trace = 0, timeout;
+    int *traced = (int *) malloc((n > 0 ? n : 1) * sizeof(int));
+
+    for ( i = 0; i < n; i++ ) {
+        if ( targets[i].ping > ICMP_PING_COUNT )
+            targets[i].ping = ICMP_PING_COUNT;
+        if ( targets[i].ping > waves )
+            waves = targets[i].ping;
+        if ( targets[i].trace )
+            traced[traces++] = i;
+        targets[i].time = 0;
+        targets[i].reached = 0;
+        targets[i].hops = 0;
+        for ( j = 0; j < ICMP_PING_COUNT; j++ )
+            targets[i].ping_rtt[j] = NAN;
+        for ( j = 0; j < ICMP_MAX_TTL * ICMP_TRACE_PROBES; j++ ) {
+            targets[i].hop[j / ICMP_TRACE_PROBES][j % ICMP_TRACE_PROBES].from.s_addr = INADDR_ANY;
+            targets[i].hop[j / ICMP_TRACE_PROBES][j % ICMP_TRACE_PROBES].rtt = NAN;
+        }
+    }
+    /* trace probe k: attempt k / (traces * ICMP_MAX_TTL), then the target, then the TTL */
+    traces *= ICMP_MAX_TTL * ICMP_TRACE_PROBES;
+
+    bucket_init(&bucket, ICMP_RATE, 1, start);
+    e->outstanding = 0;
+
+    for (;;) {
+        now = monotonic_ms();
+        for (;;) {
+            if ( wave < waves && now >= start + (uint64_t) wave * ICMP_PING_SPACING_MS ) {
+                if ( wave < targets[next].ping ) {
+                    if ( !bucket_take(&bucket, now, 1) )
+                        break;
+                    if ( icmp_send(e, targets, next, 0, wave) < 0 )
+                        goto fail;
+                    last_send = now;
+                }
+                if ( ++next == n ) {
+                    next = 0;
+                    wave++;
+                }
+            } else if ( trace < traces ) {
+                if ( !bucket_take(&bucket, now, 1) )
+                    break;
+                i = trace % ( traces / ICMP_TRACE_PROBES );
+                if ( icmp_send(e, targets, traced[i / ICMP_MAX_TTL], i % ICMP_MAX_TTL + 1,
+                               trace / ( traces / ICMP_TRACE_PROBES )) < 0 )
+                    goto fail;
+                trace++;
+                last_send = now;
+            } else
+                break;
+        }
+
+        if ( wave == waves && trace == traces && ( !e->outstanding || now >= last_send + ICMP_TIMEOUT_MS ) )
+            break;
+
+        wake = last_send + ICMP_TIMEOUT_MS;
+        if ( wave < waves && start + (uint64_t) wave * ICMP_PING_SPACING_MS > now ) {
+            if ( start + (uint64_t) wave * ICMP_PING_SPACING_MS < wake )
+                wake = start + (uint64_t) wave * ICMP_PING_SPACING_MS;
+        } else if ( wave < waves || trace < traces ) {
+            if ( bucket_ready(&bucket, now, 1) < wake )
+                wake = bucket_ready(&bucket, now, 1);
+        }
+        if ( trace < traces && bucket_ready(&bucket, now, 1) < wake )
+            wake = bucket_ready(&bucket, now, 1);
+        timeout = wake > now ? (int) ( wake - now ) : 0;
+
+        if ( poll( &(struct pollfd) { e->fd, POLLIN, 0 }, 1, timeout ) < 0 && errno != EINTR ) {
+            perror("icmp_run poll");
+            goto fail;
+        }
+        icmp_drain(e, targets, n);
+    }
+
+    for ( i = 0; i < n; i++ )
+        if ( targets[i].trace )
+            targets[i].hops = targets[i].reached ? targets[i].reached : ICMP_MAX_TTL;
+    for ( i = 0; i < FLIGHTS; i++ )
+        e->flights[i].state = FLIGHT_FREE;
+    free(traced);
+    return 0;
+
+fail:
+    for ( i = 0; i < FLIGHTS; i++ )
+        e->flights[i].state = FLIGHT_FREE;
+    free(traced);
+    return -1;
+}
@@ -0,0 +1,63 @@
+/**
+ * [Title]: icmp.h -- parallel ping and traceroute over one raw socket
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Replaces the /bin/ping and traceroute processes server.py used to start for every target. icmp_run() sends
+ * the echo requests of all the targets from one raw ICMP socket and one thread: ping_count of them per ping
+ * target, ICMP_PING_SPACING_MS apart like ping does, and ICMP_TRACE_PROBES per TTL up to ICMP_MAX_TTL for the
+ * targets to trace, all TTLs at once instead of hop by hop. The path is traced with echo requests (traceroute
+ * -I) rather than UDP, so the time exceeded quote carries our id and sequence number and tells which probe it
+ * answers; the hops past the first one the target answered itself are dropped.
+ *
+ * Every sequence number indexes a table of the probes in flight, the socket filters anything but echo
+ * replies, time exceeded and unreachables, and the receive times are the kernel's (SO_TIMESTAMPNS). The sends
+ * of a run are paced to ICMP_RATE per second. Needs CAP_NET_RAW.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_ICMP_H
+#define CXP_ICMP_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define ICMP_PING_COUNT         10              /* ping -c10 */
+#define ICMP_PING_SPACING_MS    1000
+#define ICMP_TRACE_PROBES       3               /* per TTL, as traceroute */
+#define ICMP_MAX_TTL            30
+#define ICMP_TIMEOUT_MS         2000
+#define ICMP_RATE               1000            /* probes per second of a run */
+#define ICMP_PAYLOAD            32
+
+typedef struct icmp_hop {
+    struct in_addr from;            /* INADDR_ANY if nobody answered */
+    float rtt;                      /* ms, NaN if nobody answered */
+} icmp_hop;
+
+typedef struct icmp_target {
+    struct in_addr addr;
+    int id;                         /* the caller's, e.g. for the history */
+    int ping;                       /* echo requests to send, at most ICMP_PING_COUNT */
+    int trace;
+    int64_t time;                   /* unix ns of its first probe */
+    float ping_rtt[ICMP_PING_COUNT];    /* ms, NaN if lost */
+    int reached;                    /* TTL the target answered the trace at, 0 if it did not */
+    int hops;                       /* TTLs of the trace that are valid */
+    icmp_hop hop[ICMP_MAX_TTL][ICMP_TRACE_PROBES];
+} icmp_target;
+
+typedef struct icmp_engine icmp_engine;
+
+icmp_engine *icmp_open();
+int icmp_run(icmp_engine *e, icmp_target *targets, int n);
+void icmp_close(icmp_engine *e);
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * [Title]: metrics.c -- self telemetry of the agent
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * The registry of the per thread blocks of metrics.h and their rendering. A block lives as long as the
+ * process, so a scrape reads it while its thread writes, bucket by bucket; the count printed is the sum of the
+ * buckets read, so it always matches +Inf, and the sum may be an observation or two off.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+static metrics_thread *threads[METRICS_MAX_THREADS];
+static int nthreads;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *histogram_names[METRIC_HISTOGRAMS][2] = {
+    { "cxp_reflector_turnaround_seconds", "Time from receiving a probe to answering it (t3 - t2)." },
+    { "cxp_send_seconds", "Duration of the send syscalls of the probes." },
+    { "cxp_recv_seconds", "Duration of the receive syscalls of the probes." },
+    { "cxp_wakeup_lateness_seconds", "How late a timer woke its thread up." },
+};
+
+static const char *counter_names[METRIC_COUNTERS][2] = {
+    { "cxp_reflector_replies_total", "Probes answered by the reflector." },
+};
+
+metrics_thread *metrics_register(const char *name)
+{
+    metrics_thread *m = NULL;
+
+    pthread_mutex_lock(&threads_lock);
+    if ( nthreads < METRICS_MAX_THREADS && posix_memalign( (void **) &m, 64, sizeof(metrics_thread) ) == 0 ) {
+        memset(m, 0, sizeof(*m));
+        m->thread = pthread_self();
+        snprintf(m->name, sizeof(m->name), "%s", name);
+        threads[nthreads++] = m;
+    }
+    pthread_mutex_unlock(&threads_lock);
+    return m;
+}
+
+static size_t append(char *buf, size_t size, size_t len, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if ( len >= size )
+        return len;
+    va_start(ap, fmt);
+    n = vsnprintf(buf + len, size - len, fmt, ap);
+    va_end(ap);
+    return n < 0 ? len : len + n;
+}
+
+/* The blocks of all the threads in the Prometheus text format; returns the length, which is >= size if it
+ * did not fit. */
+size_t metrics_render(char *buf, size_t size)
+{
+    metrics_thread *m;
+    metrics_histogram *hist;
+    struct timespec ts;
+    clockid_t cid;
+    uint64_t cumulative, count;
+    size_t len = 0;
+    int n, i, h, b;
+
+    pthread_mutex_lock(&threads_lock);
+    n = nthreads;
+    pthread_mutex_unlock(&threads_lock);
+
+    len = append(buf, size, len, "# HELP cxp_thread_cpu_seconds_total CPU time of the thread.\n"
+                 "# TYPE cxp_thread_cpu_seconds_total counter\n");
+    for ( i = 0; i < n; i++ )
+        if ( pthread_getcpuclockid( threads[i]->thread, &cid ) == 0 && clock_gettime( cid, &ts ) == 0 )
+            len = append(buf, size, len, "cxp_thread_cpu_seconds_total{thread=\"%s\"} %.6f\n", threads[i]->name,
+                         ts.tv_sec + ts.tv_nsec / 1e9);
+
+    for ( h = 0; h < METRIC_HISTOGRAMS; h++ ) {
+        len = append(buf, size, len, "# HELP %s %s\n# TYPE %s histogram\n", histogram_names[h][0],
+                     histogram_names[h][1], histogram_names[h][0]);
+        for ( i = 0; i < n; i++ ) {
+            m = threads[i];
+            hist = &m->histogram[h];
+            if ( ( count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED) ) == 0 )
+                continue;
+            for ( b = 0, cumulative = 0; b < METRICS_BUCKETS - 1; b++ ) {
+                cumulative += __atomic_load_n(&hist->bucket[b], __ATOMIC_RELAXED);
+                len = append(buf, size, len, "%s_bucket{thread=\"%s\",le=\"%g\"} %llu\n", histogram_names[h][0],
+                             m->name, ( 1ULL << b ) * 1e-6, (unsigned long long) cumulative);
+            }
+            cumulative += __atomic_load_n(&hist->bucket[b], __ATOMIC_RELAXED);
+            len = append(buf, size, len, "%s_bucket{thread=\"%s\",le=\"+Inf\"} %llu\n", histogram_names[h][0],
+                         m->name, (unsigned long long) cumulative);
+            len = append(buf, size, len, "%s_sum{thread=\"%s\"} %.9f\n", histogram_names[h][0], m->name,
+                         __atomic_load_n(&hist->sum, __ATOMIC_RELAXED) / 1e9);
+            len = append(buf, size, len, "%s_count{thread=\"%s\"} %llu\n", histogram_names[h][0], m->name,
+                         (unsigned long long) cumulative);
+        }
+    }
+
+    for ( h = 0; h < METRIC_COUNTERS; h++ ) {
+        len = append(buf, size, len, "# HELP %s %s\n# TYPE %s counter\n", counter_names[h][0], counter_names[h][1],
+                     counter_names[h][0]);
+        for ( i = 0; i < n; i++ )
+            if ( ( count = __atomic_load_n(&threads[i]->counter[h], __ATOMIC_RELAXED) ) > 0 )
+                len = append(buf, size, len, "%s{thread=\"%s\"} %llu\n", counter_names[h][0], threads[i]->name,
+                             (unsigned long long) count);
+    }
+    return len;
+}
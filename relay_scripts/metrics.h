@@ -0,0 +1,80 @@
+/**
+ * [Title]: metrics.h -- self telemetry of the agent
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Every thread that measures anything registers a metrics_thread block of its own, 64 byte aligned, and is
+ * the only one to write it: a counter or a histogram bucket is bumped with a relaxed store, no lock, no atomic
+ * read-modify-write and no cache line shared with another thread. metrics_render() sums nothing, it prints
+ * the blocks of all the threads in the Prometheus text format, one series per thread, along with the CPU
+ * time of each thread (pthread_getcpuclockid), so the cost of a scrape is on the scraper.
+ *
+ * The histograms are of durations in ns, in power of two buckets from 1 us (le="1e-06", "2e-06", ...) up to
+ * METRICS_BUCKETS - 1 doublings, plus +Inf:
+ *
+ *     turnaround  the reflector's t3 - t2 of every probe it answered
+ *     send, recv  the send/recv syscalls of the probes
+ *     wakeup      how late a timer woke its thread up, after the deadline it was armed for
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_METRICS_H
+#define CXP_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define METRICS_BUCKETS         24              /* 1 us .. 4.2 s and +Inf */
+#define METRICS_MAX_THREADS     160
+
+enum { METRIC_TURNAROUND, METRIC_SEND, METRIC_RECV, METRIC_WAKEUP, METRIC_HISTOGRAMS };
+enum { METRIC_REPLIES, METRIC_COUNTERS };
+
+typedef struct metrics_histogram {
+    uint64_t bucket[METRICS_BUCKETS];
+    uint64_t count;
+    uint64_t sum;                   /* ns */
+} metrics_histogram;
+
+typedef struct metrics_thread {
+    metrics_histogram histogram[METRIC_HISTOGRAMS];
+    uint64_t counter[METRIC_COUNTERS];
+    pthread_t thread;
+    char name[32];
+} __attribute__((aligned(64))) metrics_thread;
+
+/* Called by the thread itself; NULL once METRICS_MAX_THREADS are registered, which the helpers below take. */
+metrics_thread *metrics_register(const char *name);
+size_t metrics_render(char *buf, size_t size);
+
+static inline void metrics_count(metrics_thread *m, int c, uint64_t n)
+{
+    if ( m )
+        __atomic_store_n(&m->counter[c], m->counter[c] + n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_observe(metrics_thread *m, int h, uint64_t ns)
+{
+    metrics_histogram *hist;
+    uint64_t us = ns / 1000;
+    int b = us ? 64 - __builtin_clzll(us) : 0;
+
+    if ( !m )
+        return;
+    hist = &m->histogram[h];
+    if ( b >= METRICS_BUCKETS )
+        b = METRICS_BUCKETS - 1;
+    __atomic_store_n(&hist->bucket[b], hist->bucket[b] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->sum, hist->sum + ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->count, hist->count + 1, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -368,6 +368,7 @@ int main(int argc, char**argv)
     ipname * k;
     int i, j;
     char *ptr, **ips, **tmp;
+    sigset_t alarm_set, old_set;
 
     printf("Arguments:\n");
     for (i=0;i<argc;i++) {
@@ -408,6 +409,11 @@ int main(int argc, char**argv)
         }
     }
 
+    /* the threads inherit SIGALRM blocked, so the report runs on this thread, in sigsuspend() */
+    sigemptyset(&alarm_set);
+    sigaddset(&alarm_set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm_set, &old_set);
+
     pthread_mutex_lock(&lock);
     pthread_create( &server_thread, NULL, one_way_server, (void *) NULL );
     sleep(1);
@@ -422,7 +428,8 @@ int main(int argc, char**argv)
 
     interrupt_enable();
 
-    while(interrupt_occured == 0);
+    while(interrupt_occured == 0)
+        sigsuspend(&old_set);
     printf("exiting\n");
 
     return 0;
@@ -0,0 +1,224 @@
+/**
+ * [Title]: probe.c -- encoding, reflection and kernel timestamps of the one way delay probes
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Wide probe layout, all fields in network byte order:
+ *
+ *     0: magic    4: version, flags, peer id     8: seq    12: zero
+ *    16: t1 (ns)  24: t2 (ns)                   32: t3 (ns)
+ *    40: coordinate of the reflector (coord.h), only with PROBE_F_COORD
+ *
+ * Kernel timestamps are software RX/TX stamps requested with SO_TIMESTAMPING (SO_TIMESTAMPNS as RX-only
+ * fallback). RX stamps arrive as control messages of recvmsg, TX stamps on the socket error queue.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+#include "probe.h"
+
+uint64_t probe_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+size_t probe_encode(void *buf, const probe_msg *m)
+{
+    uint8_t *b = (uint8_t *) buf;
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+
+    u32 = htonl(PROBE_MAGIC);
+    memcpy(b, &u32, 4);
+    b[4] = PROBE_VERSION;
+    b[5] = m->flags;
+    u16 = htons(m->peer);
+    memcpy(b + 6, &u16, 2);
+    u32 = htonl(m->seq);
+    memcpy(b + 8, &u32, 4);
+    memset(b + 12, 0, 4);
+    u64 = htobe64(m->t1);
+    memcpy(b + 16, &u64, 8);
+    u64 = htobe64(m->t2);
+    memcpy(b + 24, &u64, 8);
+    u64 = htobe64(m->t3);
+    memcpy(b + 32, &u64, 8);
+
+    return PROBE_WIRE_SIZE;
+}
+
+/*
+ * Returns PROBE_VERSION for a wide probe, 1 for the legacy 2/4 x uint32 format (t2 == t3 for a legacy
+ * reply, both zero for a legacy request) and -1 for anything else.
+ */
+int probe_decode(const void *buf, size_t len, probe_msg *m)
+{
+    const uint8_t *b = (const uint8_t *) buf;
+    uint32_t u32[4];
+    uint16_t u16;
+    uint64_t u64;
+
+    memset(m, 0, sizeof(*m));
+
+    if ( len >= PROBE_WIRE_SIZE ) {
+        memcpy(u32, b, 4);
+        if ( ntohl(u32[0]) == PROBE_MAGIC && b[4] >= PROBE_VERSION ) {
+            m->version = b[4];
+            m->flags = b[5];
+            memcpy(&u16, b + 6, 2);
+            m->peer = ntohs(u16);
+            memcpy(u32, b + 8, 4);
+            m->seq = ntohl(u32[0]);
+            memcpy(&u64, b + 16, 8);
+            m->t1 = be64toh(u64);
+            memcpy(&u64, b + 24, 8);
+            m->t2 = be64toh(u64);
+            memcpy(&u64, b + 32, 8);
+            m->t3 = be64toh(u64);
+            return PROBE_VERSION;
+        }
+    }
+
+    if ( len < PROBE_LEGACY_REQUEST )
+        return -1;
+
+    memcpy(u32, b, len >= PROBE_LEGACY_REPLY ? PROBE_LEGACY_REPLY : PROBE_LEGACY_REQUEST);
+    m->version = 1;
+    m->t1 = (uint64_t) ntohl(u32[0]) * 1000000000ULL + (uint64_t) ntohl(u32[1]) * 1000ULL;
+    if ( len >= PROBE_LEGACY_REPLY ) {
+        m->flags = PROBE_F_REPLY;
+        m->t2 = (uint64_t) ntohl(u32[2]) * 1000000000ULL + (uint64_t) ntohl(u32[3]) * 1000ULL;
+        m->t3 = m->t2;
+    }
+    return 1;
+}
+
+/*
+ * Turn the request in buf into its reply in place. buf must hold at least PROBE_MAX_SIZE bytes. Legacy
+ * requests get the legacy 4 x uint32 reply so old clients keep working. Returns the reply length, which is
+ * PROBE_COORD_SIZE when the request asks for the coordinate: the caller writes it after PROBE_WIRE_SIZE.
+ */
+size_t probe_reflect(void *buf, size_t len, uint64_t t2, uint64_t t3, int kernel_rx)
+{
+    uint32_t *u32 = (uint32_t *) buf;
+    probe_msg m;
+
+    switch ( probe_decode(buf, len, &m) ) {
+    case PROBE_VERSION:
+        m.flags |= PROBE_F_REPLY;
+        if ( kernel_rx )
+            m.flags |= PROBE_F_KERNEL_RX;
+        m.t2 = t2;
+        m.t3 = t3;
+        probe_encode(buf, &m);
+        return ( m.flags & PROBE_F_COORD ) && len >= PROBE_COORD_SIZE ? PROBE_COORD_SIZE : PROBE_WIRE_SIZE;
+    case 1:
+        u32[2] = htonl(t2 / 1000000000ULL);
+        u32[3] = htonl((t2 % 1000000000ULL) / 1000);
+        return PROBE_LEGACY_REPLY;
+    default:
+        return 0;
+    }
+}
+
+int probe_enable_timestamps(int sockfd, int tx)
+{
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    int on = 1;
+
+    if ( tx )
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    if ( setsockopt( sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags) ) == 0 )
+        return 0;
+    perror("probe_enable_timestamps SO_TIMESTAMPING");
+
+    if ( setsockopt( sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on) ) == 0 )
+        return 0;
+    perror("probe_enable_timestamps SO_TIMESTAMPNS");
+
+    return -1;
+}
+
+/* Kernel receive time of the datagram read with msg, or 0 when the kernel did not stamp it. */
+uint64_t probe_rx_timestamp(struct msghdr *msg)
+{
+    struct cmsghdr *cmsg;
+    struct scm_timestamping *tss;
+    struct timespec *ts;
+
+    for ( cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg) ) {
+        if ( cmsg->cmsg_level != SOL_SOCKET )
+            continue;
+        if ( cmsg->cmsg_type == SCM_TIMESTAMPING ) {
+            tss = (struct scm_timestamping *) CMSG_DATA(cmsg);
+            if ( tss->ts[0].tv_sec || tss->ts[0].tv_nsec )
+                return (uint64_t) tss->ts[0].tv_sec * 1000000000ULL + tss->ts[0].tv_nsec;
+        } else if ( cmsg->cmsg_type == SCM_TIMESTAMPNS ) {
+            ts = (struct timespec *) CMSG_DATA(cmsg);
+            return (uint64_t) ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read one TX timestamp from the error queue. id is the per-socket counter of the datagram it belongs to
+ * (SOF_TIMESTAMPING_OPT_ID). Returns 1 when a timestamp was read, 0 when the queue is empty.
+ */
+int probe_tx_timestamp(int sockfd, uint64_t *ts, uint32_t *id)
+{
+    char control[256];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct scm_timestamping *tss;
+    struct sock_extended_err *serr;
+    int found;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if ( recvmsg( sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 ) {
+            if ( errno != EAGAIN && errno != EWOULDBLOCK )
+                perror("probe_tx_timestamp recvmsg");
+            return 0;
+        }
+
+        found = 0;
+        for ( cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg) ) {
+            if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING ) {
+                tss = (struct scm_timestamping *) CMSG_DATA(cmsg);
+                *ts = (uint64_t) tss->ts[0].tv_sec * 1000000000ULL + tss->ts[0].tv_nsec;
+                found = 1;
+            } else if ( cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR ) {
+                serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+                if ( serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING )
+                    *id = serr->ee_data;
+            }
+        }
+        if ( found )
+            return 1;
+    }
+}
@@ -0,0 +1,68 @@
+/**
+ * [Title]: probe.h -- wire format of the one way delay probes
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * The original probe is 2 x uint32 (sec, usec) sent by the client, answered with 4 x uint32 where the reflector
+ * appends its own arrival time. The wide probe carries a magic, a sequence number and three nanosecond
+ * timestamps (client send, reflector receive, reflector send). Reflectors answer both formats. The sequence
+ * number and the peer id are the client's and come back unchanged, so a reply can be matched to its request
+ * with several probes in flight. A wide probe with PROBE_F_COORD is PROBE_COORD_SIZE bytes long and the
+ * reflector fills the tail of the reply with its network coordinate (coord.h). The probes of a packet train
+ * (PROBE_F_TRAIN, train.h) are up to a full MTU of padding; the reflector reads their header only and its reply
+ * is the plain wide one, so the trains load the forward path alone.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_PROBE_H
+#define CXP_PROBE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#define PROBE_PORT              32000
+
+#define PROBE_LEGACY_REQUEST    (2 * sizeof(uint32_t))
+#define PROBE_LEGACY_REPLY      (4 * sizeof(uint32_t))
+
+#define PROBE_MAGIC             0x43585032      /* "CXP2" */
+#define PROBE_VERSION           2
+#define PROBE_WIRE_SIZE         40
+#define PROBE_COORD_SIZE        64              /* the wide probe and a coordinate */
+#define PROBE_MAX_SIZE          64
+
+#define PROBE_F_REPLY           0x01            /* set by the reflector */
+#define PROBE_F_KERNEL_RX       0x02            /* t2 was taken by the kernel */
+#define PROBE_F_COORD           0x04            /* the reply carries the reflector's coordinate */
+#define PROBE_F_TRAIN           0x08            /* one of the packets of a train, seq is id << 8 | index */
+
+/* Decoded probe; every timestamp is CLOCK_REALTIME in nanoseconds. */
+typedef struct probe_msg {
+    uint8_t version;
+    uint8_t flags;
+    uint16_t peer;              /* sender's id of the peer, echoed back */
+    uint32_t seq;
+    uint64_t t1;                /* client send */
+    uint64_t t2;                /* reflector receive */
+    uint64_t t3;                /* reflector send */
+} probe_msg;
+
+uint64_t probe_now_ns();
+
+size_t probe_encode(void *buf, const probe_msg *m);
+int probe_decode(const void *buf, size_t len, probe_msg *m);
+size_t probe_reflect(void *buf, size_t len, uint64_t t2, uint64_t t3, int kernel_rx);
+
+int probe_enable_timestamps(int sockfd, int tx);
+uint64_t probe_rx_timestamp(struct msghdr *msg);
+int probe_tx_timestamp(int sockfd, uint64_t *ts, uint32_t *id);
+
+#endif
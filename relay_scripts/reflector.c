@@ -0,0 +1,382 @@
+/**
+ * [Title]: reflector.c -- the one_way_server side of the probes
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Answers the probes of the other VMs with the reflector timestamps (see probe.c). The batched mode prints the
+ * aggregate packets/sec of all its workers once per second while there is traffic, with the most probes a
+ * single recvmmsg found waiting, i.e. how deep the socket queue got when senders burst at the same time.
+ * Replies that ask for it carry our network coordinate, read once per batch. Without -k a batch has one time
+ * for t2 and t3, the time it was drained, so the turnaround (t3 - t2) is only measured with the kernel receive
+ * timestamps: the replies without PROBE_F_KERNEL_RX have none and the agents leave it out of their reports.
+ *
+ * With an interface name the workers take the probes from PACKET_MMAP rings of that interface instead (see
+ * ring.h): the turnaround then leaves out the IP/UDP stack and the socket queue, and t2 is the time the frame
+ * came off the device. The UDP socket stays bound but silenced. When a ring cannot be set up (no CAP_NET_RAW,
+ * no such interface) the socket workers take over.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "probe.h"
+#include "reflector.h"
+#include "coord.h"
+#include "ring.h"
+#include "metrics.h"
+
+typedef struct reflector_worker {
+    pthread_t thread;
+    int sockfd;
+    int cpu;
+    uint64_t packets;
+    uint32_t deepest;               /* most probes one recvmmsg drained since the last print */
+    ring *ring;                     /* PACKET_MMAP backend, NULL for the socket */
+} __attribute__((aligned(64))) reflector_worker;
+
+static reflector_worker *workers;
+static int nworkers;
+static int kernel_ts;
+
+static int reflector_open(int reuseport)
+{
+    int sockfd;
+    struct sockaddr_in local_addr;
+    struct timeval tv;
+    int on = 1;
+
+    if ( ( sockfd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP ) ) < 0 ) {
+        perror("one_way_server socket");
+        exit( EXIT_FAILURE );
+    }
+
+    if ( setsockopt( sockfd, SOL_SOCKET, SO_REUSEADDR, (char *) &on, sizeof(on) ) < 0)
+        perror("one_way_server setsockopt");
+
+    if ( reuseport ) {
+        if ( setsockopt( sockfd, SOL_SOCKET, SO_REUSEPORT, (char *) &on, sizeof(on) ) < 0)
+            perror("one_way_server SO_REUSEPORT");
+
+        /* wake up now and then so the packets/sec report is printed even on an idle worker */
+        tv.tv_sec = REFLECTOR_REPORT_MS / 1000;
+        tv.tv_usec = (REFLECTOR_REPORT_MS % 1000) * 1000;
+        if ( setsockopt( sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv) ) < 0)
+            perror("one_way_server SO_RCVTIMEO");
+    }
+
+    memset( &local_addr, 0, sizeof( local_addr ) );
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+    local_addr.sin_port = htons(PROBE_PORT);
+
+    if ( bind( sockfd, ( struct sockaddr * ) &local_addr, sizeof( local_addr ) ) < 0 )
+        perror("one_way_server bind");
+
+    if ( kernel_ts && probe_enable_timestamps( sockfd, 0 ) < 0 )
+        fprintf(stderr, "one_way_server: no kernel timestamps, using user space ones\n");
+
+    return sockfd;
+}
+
+static uint64_t monotonic_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void * one_way_server( void * ptr ) {
+    reflector_worker *w = (reflector_worker *) ptr;
+    struct sockaddr_in remote_addr;
+    uint8_t buf[PROBE_MAX_SIZE];
+    char control[256];
+    struct iovec iov;
+    struct msghdr msg;
+    uint64_t t2, t3, before;
+    ssize_t ret;
+    size_t len;
+    int kernel_rx;
+    coord local;
+    metrics_thread *metrics = metrics_register("reflector0");
+
+    do {
+        iov.iov_base = buf;
+        iov.iov_len = sizeof(buf);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &remote_addr;
+        msg.msg_namelen = sizeof(remote_addr);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if ( ( ret = recvmsg( w->sockfd, &msg, 0 ) ) <= 0 ) {
+            if ( ret < 0 )
+                perror("one_way_server recv");
+            continue;
+        }
+
+        kernel_rx = kernel_ts && ( t2 = probe_rx_timestamp(&msg) ) != 0;
+        if ( !kernel_rx )
+            t2 = probe_now_ns();
+
+        t3 = probe_now_ns();
+        if ( ( len = probe_reflect( buf, ret, t2, t3, kernel_rx ) ) == 0 )
+            continue;
+        if ( len == PROBE_COORD_SIZE ) {
+            coord_local(&local);
+            coord_encode(buf + PROBE_WIRE_SIZE, &local);
+        }
+
+        before = monotonic_ns();
+        if ( sendto( w->sockfd, buf, len, 0, (struct sockaddr *)&remote_addr, sizeof(remote_addr) ) < 0 )
+            perror("one_way_server send");
+        else {
+            __atomic_store_n(&w->packets, w->packets + 1, __ATOMIC_RELAXED);
+            metrics_observe(metrics, METRIC_SEND, monotonic_ns() - before);
+            if ( kernel_rx )
+                metrics_observe(metrics, METRIC_TURNAROUND, t3 > t2 ? t3 - t2 : 0);
+            metrics_count(metrics, METRIC_REPLIES, 1);
+        }
+
+    } while ( 1 );
+
+    return NULL;
+}
+
+/* the packets/sec of all the workers, once per REFLECTOR_REPORT_MS while there is traffic */
+static void print_rate(uint64_t *last, uint64_t *last_at)
+{
+    uint64_t now, total;
+    uint32_t deepest, d;
+    int i;
+
+    if ( ( now = monotonic_ns() ) - *last_at < REFLECTOR_REPORT_MS * 1000000ULL )
+        return;
+    total = reflector_packets();
+    for ( i = 0, deepest = 0; i < nworkers; i++ ) {
+        d = __atomic_exchange_n(&workers[i].deepest, 0, __ATOMIC_RELAXED);
+        deepest = d > deepest ? d : deepest;
+    }
+    if ( total != *last ) {
+        printf("one_way_server: %.0f packets/s over %d worker(s), up to %d queued\n",
+               (total - *last) * 1e9 / (now - *last_at), nworkers, deepest);
+        fflush(stdout);
+    }
+    *last = total;
+    *last_at = now;
+}
+
+static void * one_way_server_batch( void * ptr ) {
+    reflector_worker *w = (reflector_worker *) ptr;
+    struct mmsghdr msgs[REFLECTOR_BATCH];
+    struct iovec iovs[REFLECTOR_BATCH];
+    struct sockaddr_in addrs[REFLECTOR_BATCH];
+    uint8_t bufs[REFLECTOR_BATCH][PROBE_MAX_SIZE];
+    uint8_t wire[COORD_WIRE_SIZE];
+    coord local;
+    char controls[REFLECTOR_BATCH][256];
+    char name[32];
+    uint64_t now, t2, t3, last = 0, last_at, before;
+    size_t len;
+    int i, n, sent, ret, kernel_rx;
+    cpu_set_t cpus;
+    metrics_thread *metrics;
+
+    snprintf(name, sizeof(name), "reflector%d", (int) ( w - workers ));
+    metrics = metrics_register(name);
+
+    CPU_ZERO(&cpus);
+    CPU_SET(w->cpu, &cpus);
+    if ( pthread_setaffinity_np( pthread_self(), sizeof(cpus), &cpus ) != 0 )
+        fprintf(stderr, "one_way_server: could not pin worker to cpu %d\n", w->cpu);
+
+    last_at = monotonic_ns();
+
+    for (;;) {
+        for ( i = 0; i < REFLECTOR_BATCH; i++ ) {
+            iovs[i].iov_base = bufs[i];
+            iovs[i].iov_len = PROBE_MAX_SIZE;
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = controls[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+        }
+
+        n = recvmmsg( w->sockfd, msgs, REFLECTOR_BATCH, MSG_WAITFORONE, NULL );
+        if ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+            perror("one_way_server recvmmsg");
+
+        if ( n > 0 ) {
+            if ( (uint32_t) n > w->deepest )
+                __atomic_store_n(&w->deepest, n, __ATOMIC_RELAXED);
+            now = probe_now_ns();
+            t3 = now;
+            coord_local(&local);
+            coord_encode(wire, &local);
+            for ( i = 0, sent = 0; i < n; i++ ) {
+                kernel_rx = kernel_ts && ( t2 = probe_rx_timestamp(&msgs[i].msg_hdr) ) != 0;
+                if ( !kernel_rx )
+                    t2 = now;
+                len = probe_reflect( bufs[i], msgs[i].msg_len, t2, t3, kernel_rx );
+                if ( len == 0 )
+                    continue;
+                if ( kernel_rx )
+                    metrics_observe(metrics, METRIC_TURNAROUND, t3 > t2 ? t3 - t2 : 0);
+                if ( len == PROBE_COORD_SIZE )
+                    memcpy(bufs[i] + PROBE_WIRE_SIZE, wire, COORD_WIRE_SIZE);
+
+                /* compact the replies to the front of the vector */
+                iovs[sent].iov_base = bufs[i];
+                iovs[sent].iov_len = len;
+                msgs[sent].msg_hdr.msg_name = &addrs[i];
+                msgs[sent].msg_hdr.msg_namelen = sizeof(addrs[i]);
+                msgs[sent].msg_hdr.msg_iov = &iovs[sent];
+                msgs[sent].msg_hdr.msg_iovlen = 1;
+                msgs[sent].msg_hdr.msg_control = NULL;
+                msgs[sent].msg_hdr.msg_controllen = 0;
+                sent++;
+            }
+
+            for ( i = 0; i < sent; i += ret ) {
+                before = monotonic_ns();
+                if ( ( ret = sendmmsg( w->sockfd, msgs + i, sent - i, 0 ) ) <= 0 ) {
+                    perror("one_way_server sendmmsg");
+                    break;
+                }
+                metrics_observe(metrics, METRIC_SEND, monotonic_ns() - before);
+            }
+            __atomic_store_n(&w->packets, w->packets + i, __ATOMIC_RELAXED);
+            metrics_count(metrics, METRIC_REPLIES, i);
+        }
+
+        if ( w == &workers[0] )
+            print_rate(&last, &last_at);
+    }
+
+    return NULL;
+}
+
+static void * one_way_server_ring( void * ptr ) {
+    reflector_worker *w = (reflector_worker *) ptr;
+    uint8_t wire[COORD_WIRE_SIZE];
+    uint64_t last = 0, last_at = monotonic_ns();
+    coord local;
+    cpu_set_t cpus;
+    char name[32];
+    int n;
+    metrics_thread *metrics;
+
+    snprintf(name, sizeof(name), "reflector%d", (int) ( w - workers ));
+    metrics = metrics_register(name);
+
+    CPU_ZERO(&cpus);
+    CPU_SET(w->cpu, &cpus);
+    if ( pthread_setaffinity_np( pthread_self(), sizeof(cpus), &cpus ) != 0 )
+        fprintf(stderr, "one_way_server: could not pin worker to cpu %d\n", w->cpu);
+
+    for (;;) {
+        coord_local(&local);
+        coord_encode(wire, &local);
+        if ( ( n = ring_reflect( w->ring, REFLECTOR_REPORT_MS, wire, metrics ) ) > 0 ) {
+            if ( (uint32_t) n > w->deepest )
+                __atomic_store_n(&w->deepest, n, __ATOMIC_RELAXED);
+            __atomic_store_n(&w->packets, w->packets + n, __ATOMIC_RELAXED);
+            metrics_count(metrics, METRIC_REPLIES, n);
+        }
+        if ( w == &workers[0] )
+            print_rate(&last, &last_at);
+    }
+
+    return NULL;
+}
+
+uint64_t reflector_packets()
+{
+    uint64_t total = 0;
+    int i;
+
+    for ( i = 0; i < nworkers; i++ )
+        total += __atomic_load_n(&workers[i].packets, __ATOMIC_RELAXED);
+    return total;
+}
+
+int reflector_start(int n, int kts, const char *ifname)
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, batch = n > 0;
+
+    kernel_ts = kts;
+    nworkers = batch ? n : 1;
+    if ( nworkers > REFLECTOR_MAX_WORKERS )
+        nworkers = REFLECTOR_MAX_WORKERS;
+    if ( ncpu < 1 )
+        ncpu = 1;
+
+    if ( posix_memalign( (void **) &workers, 64, nworkers * sizeof(reflector_worker) ) != 0 )
+        return -1;
+    memset(workers, 0, nworkers * sizeof(reflector_worker));
+
+    /* the rings first: if any of them fails the sockets take over */
+    if ( ifname && ifname[0] ) {
+        for ( i = 0; i < nworkers; i++ ) {
+            workers[i].cpu = i % ncpu;
+            if ( ( workers[i].ring = ring_open( ifname, nworkers > 1 ? ( getpid() & 0xffff ) | 1 : 0 ) ) == NULL )
+                break;
+        }
+        if ( i == nworkers ) {
+            workers[0].sockfd = reflector_open(0);
+            ring_silence(workers[0].sockfd);
+            for ( i = 0; i < nworkers; i++ )
+                if ( pthread_create( &workers[i].thread, NULL, one_way_server_ring, &workers[i] ) != 0 ) {
+                    perror("reflector_start pthread_create");
+                    return -1;
+                }
+            printf("one_way_server started with %d PACKET_MMAP ring(s) on %s\n", nworkers, ifname);
+            return 0;
+        }
+        fprintf(stderr, "one_way_server: no PACKET_MMAP ring on %s, using the socket\n", ifname);
+        while ( i-- > 0 ) {
+            ring_close(workers[i].ring);
+            workers[i].ring = NULL;
+        }
+    }
+
+    /* open every socket before any thread runs so the SO_REUSEPORT group is complete */
+    for ( i = 0; i < nworkers; i++ ) {
+        workers[i].sockfd = reflector_open(batch);
+        workers[i].cpu = i % ncpu;
+    }
+
+    for ( i = 0; i < nworkers; i++ )
+        if ( pthread_create( &workers[i].thread, NULL, batch ? one_way_server_batch : one_way_server, &workers[i] ) != 0 ) {
+            perror("reflector_start pthread_create");
+            return -1;
+        }
+
+    if ( batch )
+        printf("one_way_server started with %d batched worker(s)\n", nworkers);
+    return 0;
+}
@@ -0,0 +1,34 @@
+/**
+ * [Title]: reflector.h -- the one_way_server side of the probes
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * reflector_start(0, ...) runs the classic one_way_server: one thread, one datagram per recvmsg/sendto.
+ * reflector_start(N, ...) runs N worker threads, each pinned to a core with its own SO_REUSEPORT socket on
+ * port 32000, draining and answering the probes in batches with recvmmsg/sendmmsg.
+ * With an interface name the workers (one for N = 0) answer from PACKET_MMAP rings of that interface instead,
+ * falling back to the above when the rings cannot be set up; only the probes that arrive on that interface
+ * are answered then.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_REFLECTOR_H
+#define CXP_REFLECTOR_H
+
+#include <stdint.h>
+
+#define REFLECTOR_BATCH         32
+#define REFLECTOR_MAX_WORKERS   64
+#define REFLECTOR_REPORT_MS     1000
+
+int reflector_start(int nworkers, int kernel_ts, const char *ifname);
+uint64_t reflector_packets();
+
+#endif
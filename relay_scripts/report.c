@@ -0,0 +1,219 @@
+/**
+ * [Title]: report.c -- binary delay report sent from the relays to the CXP delay controller
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Encodes the per-peer records into as many fragments as needed (see report.h for the layouts).
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "report.h"
+
+static void put16(uint8_t *b, uint16_t v)
+{
+    v = htons(v);
+    memcpy(b, &v, 2);
+}
+
+static void put32(uint8_t *b, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(b, &v, 4);
+}
+
+/* ms to ns, saturated to what fits in the 32 bit fields */
+static uint32_t ms_to_ns32(double ms)
+{
+    if ( ms <= 0 )
+        return 0;
+    if ( ms * 1e6 >= (double) UINT32_MAX )
+        return UINT32_MAX;
+    return (uint32_t) (ms * 1e6 + 0.5);
+}
+
+static void encode_header(uint8_t *b, int kind, uint16_t node, uint32_t seq, int flags, uint16_t fragment,
+                          uint16_t fragments, int count)
+{
+    put32(b, REPORT_MAGIC);
+    b[4] = REPORT_VERSION;
+    b[5] = kind;
+    b[6] = flags;
+    b[7] = 0;
+    put16(b + 8, node);
+    put16(b + 10, count);
+    put32(b + 12, seq);
+    put16(b + 16, fragment);
+    put16(b + 18, fragments);
+}
+
+static void encode_delay(uint8_t *b, const void *records, int i)
+{
+    const report_delay *r = (const report_delay *) records + i;
+    double loss = r->loss < 0 ? 0 : r->loss > 1 ? 1 : r->loss;
+    double reorder = r->reorder < 0 ? 0 : r->reorder > 1 ? 1 : r->reorder;
+
+    put16(b, r->peer);
+    put16(b + 2, r->samples);
+    put16(b + 4, (uint16_t) (loss * 65535 + 0.5));
+    put16(b + 6, (uint16_t) (reorder * 65535 + 0.5));
+    put32(b + 8, ms_to_ns32(r->median));
+    put32(b + 12, ms_to_ns32(r->p90));
+}
+
+static void encode_stats(uint8_t *b, const void *records, int i)
+{
+    const report_stats *r = (const report_stats *) records + i;
+
+    put16(b, r->peer);
+    b[2] = r->metric;
+    b[3] = 0;
+    put32(b + 4, r->count);
+    put32(b + 8, ms_to_ns32(r->min));
+    put32(b + 12, ms_to_ns32(r->median));
+    put32(b + 16, ms_to_ns32(r->p90));
+    put32(b + 20, ms_to_ns32(r->p99));
+    put32(b + 24, ms_to_ns32(r->ewma));
+    put32(b + 28, ms_to_ns32(r->jitter));
+}
+
+static void encode_clock(uint8_t *b, const void *records, int i)
+{
+    const report_clock *r = (const report_clock *) records + i;
+    int64_t offset = (int64_t) llround(r->offset * 1e6);
+    double skew = r->skew * 1e3;
+
+    put16(b, r->peer);
+    put16(b + 2, r->points);
+    put32(b + 4, ms_to_ns32(r->error));
+    put32(b + 8, (uint32_t) ( (uint64_t) offset >> 32 ));
+    put32(b + 12, (uint32_t) offset);
+    put32(b + 16, (uint32_t) (int32_t) ( skew > INT32_MAX ? INT32_MAX : skew < -INT32_MAX ? -INT32_MAX : lround(skew) ));
+    put32(b + 20, ms_to_ns32(r->min_delay));
+}
+
+static void encode_coord(uint8_t *b, const void *records, int i)
+{
+    const report_coord *r = (const report_coord *) records + i;
+    double us;
+    int d;
+
+    put16(b, r->node);
+    put16(b + 2, r->updates);
+    for ( d = 0; d < REPORT_COORD_DIMS; d++ ) {
+        us = r->v[d] * 1e3;
+        put32(b + 4 + 4 * d, (uint32_t) (int32_t) ( us > INT32_MAX ? INT32_MAX : us < -INT32_MAX ? -INT32_MAX : lround(us) ));
+    }
+    put32(b + 16, ms_to_ns32(r->height / 1e3));        /* us */
+    put32(b + 20, (uint32_t) ( r->error > 0 ? r->error * 1e6 + 0.5 : 0 ));
+}
+
+static void encode_link(uint8_t *b, const void *records, int i)
+{
+    const report_link *r = (const report_link *) records + i;
+
+    put16(b, r->peer);
+    b[2] = r->state;
+    b[3] = 0;
+    put32(b + 4, r->losses);
+    put32(b + 8, ms_to_ns32(r->silent));
+}
+
+/* Mbit/s to kbit/s, saturated */
+static uint32_t mbps_to_kbps32(double mbps)
+{
+    if ( !( mbps > 0 ) )
+        return 0;
+    if ( mbps * 1e3 >= (double) UINT32_MAX )
+        return UINT32_MAX;
+    return (uint32_t) (mbps * 1e3 + 0.5);
+}
+
+static void encode_bandwidth(uint8_t *b, const void *records, int i)
+{
+    const report_bandwidth *r = (const report_bandwidth *) records + i;
+
+    put16(b, r->peer);
+    b[2] = r->trains;
+    b[3] = r->paced;
+    put32(b + 4, mbps_to_kbps32(r->capacity));
+    put32(b + 8, mbps_to_kbps32(r->available));
+    put32(b + 12, mbps_to_kbps32(r->rate));
+}
+
+/* Send the records in as many fragments as needed. An empty report is still sent as one empty fragment. */
+static int report_send(int sockfd, const struct sockaddr_in *to, int kind, size_t size,
+                       void (*encode)(uint8_t *, const void *, int), uint16_t node, uint32_t seq, int flags,
+                       const void *records, int count)
+{
+    uint8_t buf[REPORT_MAX_DATAGRAM];
+    int per_fragment, fragments, fragment, first, n, i;
+
+    per_fragment = (REPORT_MAX_DATAGRAM - REPORT_HEADER_SIZE) / size;
+    fragments = count ? (count + per_fragment - 1) / per_fragment : 1;
+
+    for ( fragment = 0; fragment < fragments; fragment++ ) {
+        first = fragment * per_fragment;
+        n = count - first < per_fragment ? count - first : per_fragment;
+
+        encode_header(buf, kind, node, seq, flags, fragment, fragments, n);
+        for ( i = 0; i < n; i++ )
+            encode(buf + REPORT_HEADER_SIZE + i * size, records, first + i);
+
+        if ( sendto( sockfd, buf, REPORT_HEADER_SIZE + n * size, 0, (const struct sockaddr *) to, sizeof(*to) ) < 0 ) {
+            perror("report_send sendto");
+            return -1;
+        }
+    }
+
+    return fragments;
+}
+
+int report_send_delays(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                       const report_delay *records, int count)
+{
+    return report_send(sockfd, to, REPORT_KIND_DELAY, REPORT_DELAY_SIZE, encode_delay, node, seq, flags, records, count);
+}
+
+int report_send_stats(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                      const report_stats *records, int count)
+{
+    return report_send(sockfd, to, REPORT_KIND_STATS, REPORT_STATS_SIZE, encode_stats, node, seq, flags, records, count);
+}
+
+int report_send_clocks(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                       const report_clock *records, int count)
+{
+    return report_send(sockfd, to, REPORT_KIND_CLOCK, REPORT_CLOCK_SIZE, encode_clock, node, seq, flags, records, count);
+}
+
+int report_send_coords(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                       const report_coord *records, int count)
+{
+    return report_send(sockfd, to, REPORT_KIND_COORD, REPORT_COORD_SIZE, encode_coord, node, seq, flags, records, count);
+}
+
+int report_send_links(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                      const report_link *records, int count)
+{
+    return report_send(sockfd, to, REPORT_KIND_LINK, REPORT_LINK_SIZE, encode_link, node, seq, flags, records, count);
+}
+
+int report_send_bandwidths(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                           const report_bandwidth *records, int count)
+{
+    return report_send(sockfd, to, REPORT_KIND_BANDWIDTH, REPORT_BANDWIDTH_SIZE, encode_bandwidth, node, seq, flags,
+                       records, count);
+}
@@ -0,0 +1,139 @@
+/**
+ * [Title]: report.h -- binary delay report sent from the relays to the CXP delay controller
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * A report is one or more datagrams of at most REPORT_MAX_DATAGRAM bytes. Each fragment has the fixed header
+ * below followed by `count` fixed-size records of the fragment's kind, all fields in network byte order:
+ *
+ *     header (20 bytes)                       delay record (16 bytes)
+ *      0: magic "CXPR"                         0: peer id        2: samples
+ *      4: version  5: kind  6: flags  7: 0     4: loss (x/65535) 6: reordering (x/65535)
+ *      8: node id  10: record count            8: median (ns)
+ *     12: sequence number                     12: p90 (ns)
+ *     16: fragment index  18: fragment count
+ *
+ * Every fragment of a report carries the same sequence number. With REPORT_F_DELTA only the peers that changed
+ * since the previous report are present. The decoder lives in CXP.py (decode_report).
+ *
+ *     stats record (32 bytes), one per peer and metric (forward, reverse, RTT, reflector turnaround)
+ *      0: peer id  2: metric  3: 0  4: sample count
+ *      8: min  12: median  16: p90  20: p99  24: ewma  28: jitter (all ns)
+ *
+ *     clock record (24 bytes), the peer's clock relative to the node's
+ *      0: peer id  2: fit points  4: error bound (ns)  8: offset (ns, signed 64 bit)
+ *     16: skew (ppb, signed)  20: smallest round trip of the fit (ns)
+ *
+ *     coord record (24 bytes), the node's own network coordinate (see coord.h)
+ *      0: node id  2: updates (saturated)  4, 8, 12: position (us, signed)  16: height (us)
+ *     20: relative error (x/1e6)
+ *
+ *     link record (12 bytes), sent on its own as soon as a peer stops or starts answering again
+ *      0: peer id  2: state (0 down, 1 up)  3: 0  4: probes lost in a row  8: since the last reply (ns)
+ *
+ *     bandwidth record (16 bytes), of the peers the packet trains of train.h reached (-T)
+ *      0: peer id  2: trains  3: paced trains (0: no available bandwidth)  4: capacity  8: available bandwidth
+ *     12: dispersion rate (all kbit/s)
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_REPORT_H
+#define CXP_REPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#define REPORT_MAGIC            0x43585052      /* "CXPR" */
+#define REPORT_VERSION          1
+#define REPORT_MAX_DATAGRAM     1400
+#define REPORT_HEADER_SIZE      20
+
+#define REPORT_KIND_DELAY       1
+#define REPORT_DELAY_SIZE       16
+#define REPORT_KIND_STATS       2
+#define REPORT_STATS_SIZE       32
+#define REPORT_KIND_CLOCK       3
+#define REPORT_CLOCK_SIZE       24
+#define REPORT_KIND_COORD       4
+#define REPORT_COORD_SIZE       24
+#define REPORT_COORD_DIMS       3
+#define REPORT_KIND_LINK        5
+#define REPORT_LINK_SIZE        12
+#define REPORT_KIND_BANDWIDTH   6
+#define REPORT_BANDWIDTH_SIZE   16
+
+#define REPORT_LINK_DOWN        0
+#define REPORT_LINK_UP          1
+
+#define REPORT_F_DELTA          0x01
+
+typedef struct report_delay {
+    uint16_t peer;
+    uint16_t samples;
+    double loss;                /* 0..1 */
+    double reorder;             /* 0..1, replies that overtook an earlier probe */
+    double median;              /* ms */
+    double p90;                 /* ms */
+} report_delay;
+
+typedef struct report_stats {
+    uint16_t peer;
+    uint8_t metric;
+    uint32_t count;
+    double min, median, p90, p99, ewma, jitter;     /* ms */
+} report_stats;
+
+typedef struct report_clock {
+    uint16_t peer;
+    uint16_t points;
+    double offset;              /* ms */
+    double skew;                /* ppm */
+    double error;               /* ms */
+    double min_delay;           /* ms */
+} report_clock;
+
+typedef struct report_coord {
+    uint16_t node;
+    uint16_t updates;
+    double v[REPORT_COORD_DIMS];    /* ms */
+    double height;                  /* ms */
+    double error;                   /* relative */
+} report_coord;
+
+typedef struct report_link {
+    uint16_t peer;
+    uint8_t state;              /* REPORT_LINK_DOWN or REPORT_LINK_UP */
+    uint32_t losses;            /* in a row */
+    double silent;              /* ms since the last reply */
+} report_link;
+
+typedef struct report_bandwidth {
+    uint16_t peer;
+    uint8_t trains, paced;
+    double capacity;            /* Mbit/s */
+    double available;           /* Mbit/s */
+    double rate;                /* Mbit/s */
+} report_bandwidth;
+
+int report_send_delays(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                       const report_delay *records, int count);
+int report_send_stats(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                      const report_stats *records, int count);
+int report_send_clocks(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                       const report_clock *records, int count);
+int report_send_coords(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                       const report_coord *records, int count);
+int report_send_links(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                      const report_link *records, int count);
+int report_send_bandwidths(int sockfd, const struct sockaddr_in *to, uint16_t node, uint32_t seq, int flags,
+                           const report_bandwidth *records, int count);
+
+#endif
@@ -0,0 +1,320 @@
+/**
+ * [Title]: ring.c -- PACKET_MMAP backend of the reflector
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * One mmap holds the receive ring and then the transmit ring. A reply is built in the next free transmit
+ * frame: the Ethernet addresses swapped, a fresh IPv4 header (no options) from the request's, the UDP ports
+ * swapped and the payload from probe_reflect(), with both checksums; the frames of a batch leave with one
+ * send(). Only the frames addressed to us (PACKET_HOST) are answered: on a promiscuous interface, an OVS bridge
+ * or a mirror port, the probes of other hosts come up the ring too, and a reply to them would go out with
+ * their address as its source. Fragments are skipped.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+
+#include "probe.h"
+#include "coord.h"
+#include "ring.h"
+
+#define ETH_HEADER      14
+#define IP_HEADER       20
+#define UDP_HEADER      8
+
+struct ring {
+    int fd;
+    uint8_t *map;
+    size_t size;
+    unsigned int frames;
+    unsigned int rx;                /* next receive frame */
+    unsigned int tx;                /* next transmit frame */
+};
+
+/* udp and dst port PROBE_PORT over IPv4, not a fragment (tcpdump -dd) */
+static struct sock_filter probe_filter[] = {
+    { 0x28, 0, 0, 0x0000000c },
+    { 0x15, 0, 8, 0x00000800 },
+    { 0x30, 0, 0, 0x00000017 },
+    { 0x15, 0, 6, 0x00000011 },
+    { 0x28, 0, 0, 0x00000014 },
+    { 0x45, 4, 0, 0x00001fff },
+    { 0xb1, 0, 0, 0x0000000e },
+    { 0x48, 0, 0, 0x00000010 },
+    { 0x15, 0, 1, PROBE_PORT },
+    { 0x06, 0, 0, 0x00040000 },
+    { 0x06, 0, 0, 0x00000000 },
+};
+
+static struct sock_filter drop_filter[] = {
+    { 0x06, 0, 0, 0x00000000 },
+};
+
+static uint32_t checksum_add(uint32_t sum, const uint8_t *b, size_t len)
+{
+    size_t i;
+
+    for ( i = 0; i + 1 < len; i += 2 )
+        sum += (uint32_t) b[i] << 8 | b[i + 1];
+    if ( len & 1 )
+        sum += (uint32_t) b[len - 1] << 8;
+    return sum;
+}
+
+static uint16_t checksum_fold(uint32_t sum)
+{
+    while ( sum >> 16 )
+        sum = ( sum & 0xffff ) + ( sum >> 16 );
+    return (uint16_t) ~sum;
+}
+
+/* Stop a socket from receiving anything, e.g. the UDP one the ring answers for: the port stays bound, so the
+ * stack does not send port unreachables, but nothing reaches its queue. */
+int ring_silence(int sockfd)
+{
+    struct sock_fprog prog = { 1, drop_filter };
+
+    if ( setsockopt( sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog) ) < 0 ) {
+        perror("ring_silence SO_ATTACH_FILTER");
+        return -1;
+    }
+    return 0;
+}
+
+ring *ring_open(const char *ifname, int fanout)
+{
+    struct sock_fprog prog = { sizeof(probe_filter) / sizeof(probe_filter[0]), probe_filter };
+    struct tpacket_req req;
+    struct sockaddr_ll addr;
+    struct ifreq ifr;
+    int version = TPACKET_V2, on = 1, fanout_arg;
+    ring *r;
+
+    if ( ( r = (ring *) calloc(1, sizeof(ring)) ) == NULL )
+        return NULL;
+
+    if ( ( r->fd = socket( AF_PACKET, SOCK_RAW, htons(ETH_P_IP) ) ) < 0 ) {
+        perror("ring_open socket");
+        free(r);
+        return NULL;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RING_BLOCK_SIZE;
+    req.tp_block_nr = RING_BLOCKS;
+    req.tp_frame_size = RING_FRAME_SIZE;
+    req.tp_frame_nr = RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCKS;
+    r->frames = req.tp_frame_nr;
+    r->size = 2 * (size_t) RING_BLOCK_SIZE * RING_BLOCKS;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_IP);
+    if ( ( addr.sll_ifindex = if_nametoindex(ifname) ) == 0 ) {
+        perror(ifname);
+        goto fail;
+    }
+
+    /* the stack drops what a packet socket sends on the loopback, so the replies would never arrive */
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if ( ioctl( r->fd, SIOCGIFFLAGS, &ifr ) == 0 && ( ifr.ifr_flags & IFF_LOOPBACK ) ) {
+        fprintf(stderr, "%s: no rings on a loopback device\n", ifname);
+        goto fail;
+    }
+
+    /* the filter goes on before the bind, so the ring never sees other traffic */
+    if ( setsockopt( r->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog) ) < 0 ||
+         setsockopt( r->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version) ) < 0 ||
+         setsockopt( r->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req) ) < 0 ||
+         setsockopt( r->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req) ) < 0 ) {
+        perror("ring_open setsockopt");
+        goto fail;
+    }
+#ifdef PACKET_IGNORE_OUTGOING
+    setsockopt( r->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &on, sizeof(on) );
+#endif
+    /* the replies go straight to the driver like the ones of a NIC queue of our own */
+    setsockopt( r->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &on, sizeof(on) );
+
+    if ( ( r->map = (uint8_t *) mmap( NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, r->fd, 0 ) ) == MAP_FAILED &&
+         ( r->map = (uint8_t *) mmap( NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0 ) ) == MAP_FAILED ) {
+        perror("ring_open mmap");
+        r->map = NULL;
+        goto fail;
+    }
+
+    if ( bind( r->fd, (struct sockaddr *) &addr, sizeof(addr) ) < 0 ) {
+        perror("ring_open bind");
+        goto fail;
+    }
+
+    if ( fanout ) {
+        fanout_arg = ( fanout & 0xffff ) | ( PACKET_FANOUT_HASH << 16 );
+        if ( setsockopt( r->fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg) ) < 0 ) {
+            perror("ring_open PACKET_FANOUT");
+            goto fail;
+        }
+    }
+    return r;
+
+fail:
+    ring_close(r);
+    return NULL;
+}
+
+void ring_close(ring *r)
+{
+    if ( !r )
+        return;
+    if ( r->map )
+        munmap(r->map, r->size);
+    close(r->fd);
+    free(r);
+}
+
+/* Build the reply to the request in frame (len bytes from the Ethernet header) into out. Returns its length. */
+static size_t build_reply(const uint8_t *frame, size_t len, uint8_t *out, uint64_t t2, uint64_t t3,
+                          const uint8_t *coord)
+{
+    uint8_t payload[PROBE_MAX_SIZE], *ip = out + ETH_HEADER, *udp = ip + IP_HEADER;
+    const uint8_t *rip = frame + ETH_HEADER, *rudp;
+    size_t ihl, plen, reply;
+    uint32_t sum;
+    uint16_t u16;
+
+    if ( len < ETH_HEADER + IP_HEADER + UDP_HEADER || ( rip[0] >> 4 ) != 4 )
+        return 0;
+    ihl = ( rip[0] & 0x0f ) * 4;
+    rudp = rip + ihl;
+    if ( ihl < IP_HEADER || len < ETH_HEADER + ihl + UDP_HEADER )
+        return 0;
+    plen = ( (size_t) rudp[4] << 8 | rudp[5] ) - UDP_HEADER;
+    if ( ETH_HEADER + ihl + UDP_HEADER + plen > len )
+        return 0;
+    /* the rest of a train packet is padding */
+    if ( plen > sizeof(payload) )
+        plen = sizeof(payload);
+
+    memcpy(payload, rudp + UDP_HEADER, plen);
+    if ( ( reply = probe_reflect(payload, plen, t2, t3, 1) ) == 0 )
+        return 0;
+    if ( reply == PROBE_COORD_SIZE )
+        memcpy(payload + PROBE_WIRE_SIZE, coord, COORD_WIRE_SIZE);
+
+    memcpy(out, frame + 6, 6);
+    memcpy(out + 6, frame, 6);
+    memcpy(out + 12, frame + 12, 2);
+
+    ip[0] = 0x45;
+    ip[1] = rip[1];
+    u16 = htons(IP_HEADER + UDP_HEADER + reply);
+    memcpy(ip + 2, &u16, 2);
+    memcpy(ip + 4, rip + 4, 2);                 /* id */
+    ip[6] = 0x40;                               /* don't fragment */
+    ip[7] = 0;
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    ip[10] = ip[11] = 0;
+    memcpy(ip + 12, rip + 16, 4);
+    memcpy(ip + 16, rip + 12, 4);
+    u16 = htons(checksum_fold(checksum_add(0, ip, IP_HEADER)));
+    memcpy(ip + 10, &u16, 2);
+
+    memcpy(udp, rudp + 2, 2);
+    memcpy(udp + 2, rudp, 2);
+    u16 = htons(UDP_HEADER + reply);
+    memcpy(udp + 4, &u16, 2);
+    udp[6] = udp[7] = 0;
+    memcpy(udp + UDP_HEADER, payload, reply);
+
+    /* pseudo header, then the datagram */
+    sum = checksum_add(0, ip + 12, 8) + IPPROTO_UDP + UDP_HEADER + reply;
+    u16 = checksum_fold(checksum_add(sum, udp, UDP_HEADER + reply));
+    u16 = htons(u16 ? u16 : 0xffff);
+    memcpy(udp + 6, &u16, 2);
+
+    return ETH_HEADER + IP_HEADER + UDP_HEADER + reply;
+}
+
+/*
+ * Wait up to timeout_ms for probes and answer every one in the receive ring, with coord (COORD_WIRE_SIZE
+ * bytes) in the replies that ask for it, and their turnaround and the send that kicks the transmit ring off
+ * into metrics. Returns how many were answered, -1 on error.
+ */
+int ring_reflect(ring *r, int timeout_ms, const uint8_t *coord, metrics_thread *metrics)
+{
+    struct pollfd pfd = { r->fd, POLLIN, 0 };
+    struct tpacket2_hdr *hdr, *out;
+    struct sockaddr_ll *sll;
+    uint8_t *frame;
+    uint64_t t2, t3;
+    struct timespec before, after;
+    size_t len;
+    int answered = 0;
+
+    hdr = (struct tpacket2_hdr *) ( r->map + (size_t) r->rx * RING_FRAME_SIZE );
+    if ( !( __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER ) ) {
+        if ( poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR ) {
+            perror("ring_reflect poll");
+            return -1;
+        }
+    }
+
+    while ( __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER ) {
+        sll = (struct sockaddr_ll *) ( (uint8_t *) hdr + TPACKET_ALIGN(sizeof(struct tpacket2_hdr)) );
+        frame = (uint8_t *) hdr + hdr->tp_mac;
+        out = (struct tpacket2_hdr *) ( r->map + ( (size_t) r->frames + r->tx ) * RING_FRAME_SIZE );
+
+        if ( sll->sll_pkttype == PACKET_HOST && hdr->tp_snaplen == hdr->tp_len &&
+             out->tp_status == TP_STATUS_AVAILABLE ) {
+            t2 = hdr->tp_sec || hdr->tp_nsec ? (uint64_t) hdr->tp_sec * 1000000000ULL + hdr->tp_nsec : probe_now_ns();
+            t3 = probe_now_ns();
+            len = build_reply(frame, hdr->tp_snaplen,
+                              (uint8_t *) out + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll), t2, t3, coord);
+            if ( len > 0 ) {
+                out->tp_len = len;
+                __atomic_store_n(&out->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+                r->tx = ( r->tx + 1 ) % r->frames;
+                metrics_observe(metrics, METRIC_TURNAROUND, t3 > t2 ? t3 - t2 : 0);
+                answered++;
+            }
+        }
+
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        r->rx = ( r->rx + 1 ) % r->frames;
+        hdr = (struct tpacket2_hdr *) ( r->map + (size_t) r->rx * RING_FRAME_SIZE );
+    }
+
+    if ( !answered )
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &before);
+    if ( send( r->fd, NULL, 0, MSG_DONTWAIT ) < 0 && errno != EAGAIN && errno != ENOBUFS )
+        perror("ring_reflect send");
+    clock_gettime(CLOCK_MONOTONIC, &after);
+    metrics_observe(metrics, METRIC_SEND,
+                    ( after.tv_sec - before.tv_sec ) * 1000000000ULL + after.tv_nsec - before.tv_nsec);
+    return answered;
+}
@@ -0,0 +1,42 @@
+/**
+ * [Title]: ring.h -- PACKET_MMAP backend of the reflector
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Receives the probes from a TPACKET_V2 receive ring of an AF_PACKET socket bound to one interface and
+ * answers them through its transmit ring, so a probe never goes up the IP/UDP stack nor waits in a socket
+ * queue. t2 is the timestamp the kernel put on the frame when the driver handed it over (the frame header of
+ * the ring), which leaves out everything after the device layer. A classic BPF filter keeps anything but UDP
+ * to PROBE_PORT out of the ring. The probes are parsed and answered with probe_reflect() like on the socket.
+ *
+ * Rings of several workers join one PACKET_FANOUT group and split the flows between them. Needs CAP_NET_RAW.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_RING_H
+#define CXP_RING_H
+
+#include <stdint.h>
+
+#include "metrics.h"
+
+#define RING_FRAME_SIZE         2048
+#define RING_BLOCK_SIZE         ( 1 << 16 )
+#define RING_BLOCKS             32              /* 1024 frames per ring */
+
+typedef struct ring ring;
+
+ring *ring_open(const char *ifname, int fanout);
+int ring_reflect(ring *r, int timeout_ms, const uint8_t *coord, metrics_thread *metrics);
+void ring_close(ring *r);
+
+int ring_silence(int sockfd);
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * [Title]: sched.c -- adaptive probe intervals and the probe budget of the agent
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * See sched.h.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <math.h>
+
+#include "sched.h"
+
+/* a new peer is probed at the fastest rate until the EWMAs know it */
+void sched_init(sched_peer *s, const sched_config *c)
+{
+    s->fast = s->slow = s->deviation = 0;
+    s->interval = c->min_ms;
+    s->primed = 0;
+}
+
+uint32_t sched_sample(sched_peer *s, const sched_config *c, double delay)
+{
+    double volatility;
+
+    if ( !s->primed ) {
+        s->fast = s->slow = delay;
+        s->deviation = 0;
+        s->primed = 1;
+        return s->interval;
+    }
+
+    s->fast += ( delay - s->fast ) / 4;
+    s->slow += ( delay - s->slow ) / 32;
+    s->deviation += ( fabs(delay - s->slow) - s->deviation ) / 8;
+
+    volatility = ( s->deviation + fabs(s->fast - s->slow) ) / ( s->slow > SCHED_FLOOR_MS ? s->slow : SCHED_FLOOR_MS );
+    s->interval = c->min_ms + ( c->max_ms - c->min_ms ) * exp(-volatility / c->sensitivity);
+    return s->interval;
+}
+
+uint32_t sched_loss(sched_peer *s, const sched_config *c)
+{
+    s->interval = s->interval / 2 > c->min_ms ? s->interval / 2 : c->min_ms;
+    return s->interval;
+}
+
+void bucket_init(token_bucket *b, double per_second, double unit, uint64_t now_ms)
+{
+    b->rate = per_second > 0 ? per_second / 1000 : 0;
+    b->burst = b->rate * SCHED_BURST_MS > unit ? b->rate * SCHED_BURST_MS : unit;
+    b->tokens = b->burst;
+    b->last = now_ms;
+}
+
+static void bucket_refill(token_bucket *b, uint64_t now_ms)
+{
+    if ( now_ms <= b->last )
+        return;
+    b->tokens += ( now_ms - b->last ) * b->rate;
+    if ( b->tokens > b->burst )
+        b->tokens = b->burst;
+    b->last = now_ms;
+}
+
+/* 1 and the tokens are spent if amount is available now, 0 otherwise */
+int bucket_take(token_bucket *b, uint64_t now_ms, double amount)
+{
+    if ( b->rate == 0 )
+        return 1;
+    bucket_refill(b, now_ms);
+    if ( b->tokens < amount )
+        return 0;
+    b->tokens -= amount;
+    return 1;
+}
+
+/* monotonic ms at which amount will be available */
+uint64_t bucket_ready(const token_bucket *b, uint64_t now_ms, double amount)
+{
+    double tokens;
+
+    if ( b->rate == 0 )
+        return now_ms;
+    tokens = b->tokens + ( now_ms > b->last ? ( now_ms - b->last ) * b->rate : 0 );
+    if ( tokens >= amount )
+        return now_ms;
+    return now_ms + (uint64_t) ceil( ( amount - tokens ) / b->rate );
+}
@@ -0,0 +1,63 @@
+/**
+ * [Title]: sched.h -- adaptive probe intervals and the probe budget of the agent
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Every peer gets a probe interval between min_ms and max_ms from how much its forward delay moves: a fast
+ * (1/4) and a slow (1/32) EWMA of the delay and an EWMA (1/8) of the deviation from the slow one give
+ *
+ *     volatility = ( deviation + |fast - slow| ) / max(slow, SCHED_FLOOR_MS)
+ *     interval   = min_ms + ( max_ms - min_ms ) * exp(-volatility / sensitivity)
+ *
+ * so a link that holds still drifts to max_ms, and one that jitters or shifts by more than a few times the
+ * sensitivity (relative, 0.05 by default) is probed every min_ms. A lost probe halves the interval.
+ *
+ * The token buckets cap what all that costs: one in packets and one in bytes per second, refilled every ms,
+ * with a burst of SCHED_BURST_MS of the rate (at least one unit, e.g. one probe). A rate of 0 means no limit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_SCHED_H
+#define CXP_SCHED_H
+
+#include <stdint.h>
+
+#define SCHED_SENSITIVITY       0.05
+#define SCHED_FLOOR_MS          1.0             /* sub ms delays are compared to 1 ms */
+#define SCHED_BURST_MS          100
+
+typedef struct sched_config {
+    uint32_t min_ms;
+    uint32_t max_ms;
+    double sensitivity;
+} sched_config;
+
+typedef struct sched_peer {
+    double fast, slow, deviation;   /* ms */
+    uint32_t interval;              /* ms */
+    int primed;
+} sched_peer;
+
+typedef struct token_bucket {
+    double rate;                    /* per ms, 0 for no limit */
+    double burst;
+    double tokens;
+    uint64_t last;                  /* monotonic ms of the last refill */
+} token_bucket;
+
+void sched_init(sched_peer *s, const sched_config *c);
+uint32_t sched_sample(sched_peer *s, const sched_config *c, double delay);
+uint32_t sched_loss(sched_peer *s, const sched_config *c);
+
+void bucket_init(token_bucket *b, double per_second, double unit, uint64_t now_ms);
+int bucket_take(token_bucket *b, uint64_t now_ms, double amount);
+uint64_t bucket_ready(const token_bucket *b, uint64_t now_ms, double amount);
+
+#endif
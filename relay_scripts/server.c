@@ -100,11 +100,11 @@ typedef struct ip_name {
 void * one_way_client(void * ptr)
 {
     ipname *k;
-    int sockfd, n, i;
+    int sockfd, n, i, got, lost;
     struct sockaddr_in servaddr, cliaddr;
-    struct timeval before, arrival_time, received_time;
+    struct timeval before, arrival_time, received_time, timeout;
     char * buf, * tmp;
-    uint32_t sec, usec;
+    uint32_t sec, usec, sent[2];
     double first_trip, second_trip, ping, drift;
     double avg_rtt[10], avg_forward[10], avg_reverse[10];
     FILE *fptr;
@@ -113,6 +113,11 @@ void * one_way_client(void * ptr)
 
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
 
+    /* a lost datagram must not block the thread forever */
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
     bzero(&servaddr, sizeof(servaddr));
     servaddr.sin_family = AF_INET;
     servaddr.sin_addr.s_addr = inet_addr(k->ip);
@@ -121,6 +126,7 @@ void * one_way_client(void * ptr)
     buf = (unsigned char *) malloc (4 * sizeof(uint32_t));
 
     for (;;) {
+        got = lost = 0;
         for ( i = 0; i < 10 ; i++ ) {
             gettimeofday(&before, 0);
             sec = htonl(before.tv_sec);
@@ -131,7 +137,19 @@ void * one_way_client(void * ptr)
             sendto(sockfd, buf, 2 * sizeof(uint32_t), 0,
                    (struct sockaddr *)&servaddr, sizeof(servaddr));
 
-            recvfrom(sockfd, buf, 4 * sizeof(uint32_t), 0, NULL, NULL);
+            /* the reply echoes our timestamp, anything else is a late reply to an earlier probe */
+            sent[0] = sec;
+            sent[1] = usec;
+            do {
+                n = recvfrom(sockfd, buf, 4 * sizeof(uint32_t), 0, NULL, NULL);
+            } while ( n >= 0 && memcmp(buf, sent, sizeof(sent)) != 0 );
+
+            /* a probe without a reply is lost, the round goes on with the next one */
+            if ( n < 0 ) {
+                printf("time out occured for %s\n", k->name);
+                lost++;
+                continue;
+            }
 
             gettimeofday(&arrival_time, 0);
 
@@ -156,17 +174,22 @@ void * one_way_client(void * ptr)
             drift = (first_trip + second_trip) / ping;
             // if ( drift < 0 ) drift = -drift;
 
-            avg_rtt[i] = ping;
+            avg_rtt[got] = ping;
             if ( drift >= 1.0f ) {
-                avg_forward[i] = first_trip / drift;
-                avg_reverse[i] = second_trip / drift;
+                avg_forward[got] = first_trip / drift;
+                avg_reverse[got] = second_trip / drift;
             } else {
-                avg_forward[i] = first_trip;
-                avg_reverse[i] = second_trip;
+                avg_forward[got] = first_trip;
+                avg_reverse[got] = second_trip;
             }
+            got++;
         }
 
-        delays[k->id] = quick_select_median(avg_forward, 10);
+        if ( lost )
+            printf("%s: %d of 10 probes lost\n", k->name, lost);
+        /* without a reply the last delay stays */
+        if ( got )
+            delays[k->id] = quick_select_median(avg_forward, got);
 
         sleep(10);
     }
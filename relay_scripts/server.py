@@ -24,6 +24,10 @@ lock = threading.Lock()
 # List of ripe probe IPs to run traceroutes to.
 ripe_nodes = []
 
+# server.out runs as a daemon (-D) and takes the 'd' requests on its control port.
+agent = None
+agent_address = ('127.0.0.1', 32034)
+
 def get_ip_address(ifname):
     s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
     return socket.inet_ntoa(fcntl.ioctl(
@@ -74,6 +78,18 @@ def run_traceroutes(do_nodes):
 		print "running traceroute to %s" % (node)
 		thread.start_new_thread(write_to_file_traceroute,(node,))
 		
+def start_agent():
+	'''
+		Start server.out once and keep it running. A server.out that cannot run as a daemon exits right away
+		and is then spawned on every 'd' request instead.
+	'''
+	global agent
+	agent = subprocess.Popen(["./server.out", "-D", "-c", str(agent_address[1])])
+	time.sleep(0.5)
+	if agent.poll() is not None:
+		print "./server.out does not run as a daemon, spawning it on each request"
+		agent = None
+
 def main():
 	# Create a TCP/IP socket
 	sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
@@ -88,8 +104,10 @@ def main():
 	if not os.path.exists('./logs'):
 		os.makedirs('./logs')
 
+	start_agent()
+
 	while True:
-		data, address = sock.recvfrom(4096)
+		data, address = sock.recvfrom(65535)
 		data = simplejson.loads(data)
 
 		print "received data %s from %s" % (data, address)
@@ -98,16 +116,60 @@ def main():
 		# We run pings and traceroutes to specified RIPE and remote nodes to log them. Also, server.out is going
 		# to calculate the oneway delays and inform the controller with the results.
 		if data[0] == 'd':
-			thread.start_new_thread(run_pings,())
 			tmp = ""
 			do_nodes = []
+			ids = []
+			schedule = None
 			for s in range(2,len(data)):
-				tmp += str(data[s][0]) + ":"  + str(data[s][1]) + "|"
+				# The controller's staggered schedule comes after the nodes.
+				if isinstance(data[s], dict):
+					schedule = data[s]
+					continue
+				tmp += str(data[s][0]) + ":"  + str(data[s][1])
+				# Newer controllers send their numbering of the relays along, which the binary report needs.
+				if len(data[s]) > 3:
+					tmp += ":" + str(data[s][3])
+					ids.append(int(data[s][3]))
+				tmp += "|"
 				do_nodes.append(str(data[s][1]));
 			tmp = tmp[:-1]
-			thread.start_new_thread(run_traceroutes,(do_nodes,))
-			print "calling ./server.out " + str(len(data)-2) + " " + str(data[1]) + " \"" + str(tmp) + "\" " + address[0]
-			subprocess.call(["./server.out", str(len(data)-2), str(data[1]), str(tmp), address[0]])
+			if agent is not None and agent.poll() is None:
+				command = "d " + str(len(do_nodes)) + " " + str(data[1]) + " " + str(tmp) + " " + address[0]
+				if ids:
+					command += " " + str(min(set(range(len(ids) + 1)) - set(ids)))
+					if schedule:
+						command += " %d:%d %d %d" % (schedule['start'], schedule['round'], schedule['slot'],
+						                             schedule.get('sample', 0))
+				print "sending to ./server.out: " + command
+				sock.sendto(command, agent_address)
+				# The daemon pings and traces them itself, from one raw socket into its delay history.
+				command = "i " + (",".join(ripe_nodes) or "-") + " " + (",".join(ripe_nodes + do_nodes) or "-")
+				print "sending to ./server.out: " + command
+				sock.sendto(command, agent_address)
+			else:
+				thread.start_new_thread(run_pings,())
+				thread.start_new_thread(run_traceroutes,(do_nodes,))
+				print "calling ./server.out " + str(len(do_nodes)) + " " + str(data[1]) + " \"" + str(tmp) + "\" " + address[0]
+				subprocess.call(["./server.out", str(len(do_nodes)), str(data[1]), str(tmp), address[0]])
+
+		# Options a, u and r:
+		# The controller adds relays (or moves them to another address), moves them or removes them. The daemon
+		# applies it while it runs and every other relay keeps its state.
+		elif data[0] in ('a', 'u', 'r'):
+			if agent is None or agent.poll() is not None:
+				print "./server.out does not run as a daemon, ignoring %s" % (data[0])
+				continue
+			nodes = []
+			for node in data[1:]:
+				if data[0] == 'r':
+					nodes.append(str(node[0] if isinstance(node, list) else node))
+				elif len(node) > 3:
+					nodes.append(str(node[0]) + ":" + str(node[1]) + ":" + str(node[3]))
+				else:
+					nodes.append(str(node[0]) + ":" + str(node[1]))
+			command = data[0] + " " + "|".join(nodes)
+			print "sending to ./server.out: " + command
+			sock.sendto(command, agent_address)
 
 		# Option s:
 		# We execute each bash command that is sent from the controller in order to setup the OVS bridge.
@@ -0,0 +1,192 @@
+/**
+ * [Title]: stats.c -- streaming per-peer latency statistics
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * See stats.h. A histogram bucket covers [ (8 + sub) << (e - 3), (9 + sub) << (e - 3) ) nanoseconds for the
+ * power of two e of the value, and the quantiles report the middle of their bucket.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stats.h"
+
+#define STATS_SUB_SHIFT     3                   /* log2(STATS_SUB_BUCKETS) */
+#define STATS_EWMA_GAIN     (1. / 8)
+#define STATS_JITTER_GAIN   (1. / 16)
+
+static int bucket_of(double ms)
+{
+    uint64_t ns;
+    int e;
+
+    if ( !( ms > 0 ) )
+        return 0;
+    ns = (uint64_t) (ms * 1e6);
+    if ( ns < ( 1ULL << STATS_MIN_SHIFT ) )
+        return 0;
+    e = 63 - __builtin_clzll(ns);
+    if ( e >= STATS_MAX_SHIFT )
+        return STATS_BUCKETS - 1;
+    return 1 + (e - STATS_MIN_SHIFT) * STATS_SUB_BUCKETS + ( ( ns >> (e - STATS_SUB_SHIFT) ) & (STATS_SUB_BUCKETS - 1) );
+}
+
+/* middle of bucket i, in ms */
+static double bucket_value(int i)
+{
+    int e, sub;
+    uint64_t width;
+
+    if ( i == 0 )
+        return ( 1ULL << STATS_MIN_SHIFT ) / 2 / 1e6;
+    e = STATS_MIN_SHIFT + (i - 1) / STATS_SUB_BUCKETS;
+    sub = (i - 1) % STATS_SUB_BUCKETS;
+    width = 1ULL << (e - STATS_SUB_SHIFT);
+    return ( (STATS_SUB_BUCKETS + sub) * width + width / 2 ) / 1e6;
+}
+
+/*
+ * The stats of a window_ms window whose ring holds samples, rounded up to a power of two within
+ * STATS_MIN_SAMPLES and STATS_MAX_SAMPLES. The ring is allocated with the struct, so free() releases both.
+ */
+peer_stats *stats_create(uint32_t window_ms, uint32_t samples)
+{
+    uint32_t size = STATS_MIN_SAMPLES;
+    peer_stats *s;
+    uint8_t *ring;
+    int m;
+
+    while ( size < samples && size < STATS_MAX_SAMPLES )
+        size <<= 1;
+    s = (peer_stats *) malloc(sizeof(peer_stats) + (size_t) size * ( sizeof(uint32_t) * ( 1 + STATS_METRICS ) +
+                                                                    sizeof(float) * STATS_METRICS ));
+    if ( !s )
+        return NULL;
+    s->mask = size - 1;
+    ring = (uint8_t *) ( s + 1 );
+    s->time = (uint32_t *) ring;
+    ring += size * sizeof(uint32_t);
+    for ( m = 0; m < STATS_METRICS; m++, ring += size * sizeof(uint32_t) )
+        s->minq[m] = (uint32_t *) ring;
+    s->value = (float (*)[STATS_METRICS]) ring;
+    stats_init(s, window_ms);
+    return s;
+}
+
+/* Empty the window, keeping the ring. */
+void stats_init(peer_stats *s, uint32_t window_ms)
+{
+    s->window = window_ms;
+    s->head = s->tail = 0;
+    memset(s->hist, 0, sizeof(s->hist));
+    memset(s->minq_head, 0, sizeof(s->minq_head));
+    memset(s->minq_tail, 0, sizeof(s->minq_tail));
+    memset(s->ewma, 0, sizeof(s->ewma));
+    memset(s->jitter, 0, sizeof(s->jitter));
+    memset(s->last, 0, sizeof(s->last));
+}
+
+static void drop_oldest(peer_stats *s)
+{
+    uint32_t idx = s->head & s->mask;
+    int m;
+
+    for ( m = 0; m < STATS_METRICS; m++ ) {
+        s->hist[m][bucket_of(s->value[idx][m])]--;
+        if ( s->minq_head[m] != s->minq_tail[m] && s->minq[m][s->minq_head[m] & s->mask] == s->head )
+            s->minq_head[m]++;
+    }
+    s->head++;
+}
+
+void stats_expire(peer_stats *s, uint64_t now_ms)
+{
+    while ( s->head != s->tail && (uint32_t) ( (uint32_t) now_ms - s->time[s->head & s->mask] ) > s->window )
+        drop_oldest(s);
+}
+
+void stats_add(peer_stats *s, uint64_t now_ms, const double value[STATS_METRICS])
+{
+    uint32_t seq, idx;
+    double v;
+    int m;
+
+    stats_expire(s, now_ms);
+    if ( s->tail - s->head == s->mask + 1 )
+        drop_oldest(s);
+
+    seq = s->tail++;
+    idx = seq & s->mask;
+    s->time[idx] = (uint32_t) now_ms;
+
+    for ( m = 0; m < STATS_METRICS; m++ ) {
+        v = value[m];
+        s->value[idx][m] = v;
+        s->hist[m][bucket_of(v)]++;
+
+        /* the queue keeps increasing values, so its head is the minimum of the window */
+        while ( s->minq_tail[m] != s->minq_head[m] &&
+                s->value[s->minq[m][(s->minq_tail[m] - 1) & s->mask] & s->mask][m] >= (float) v )
+            s->minq_tail[m]--;
+        s->minq[m][s->minq_tail[m]++ & s->mask] = seq;
+
+        if ( seq == 0 ) {
+            s->ewma[m] = v;
+            s->jitter[m] = 0;
+        } else {
+            s->ewma[m] += STATS_EWMA_GAIN * (v - s->ewma[m]);
+            s->jitter[m] += STATS_JITTER_GAIN * (fabs(v - s->last[m]) - s->jitter[m]);
+        }
+        s->last[m] = v;
+    }
+}
+
+void stats_summarize(peer_stats *s, int metric, uint64_t now_ms, stats_summary *out)
+{
+    double q[3] = { 0.5, 0.9, 0.99 }, *res[3];
+    uint32_t rank, seen = 0;
+    int i, k = 0;
+
+    stats_expire(s, now_ms);
+    memset(out, 0, sizeof(*out));
+    out->count = s->tail - s->head;
+    out->ewma = s->ewma[metric];
+    out->jitter = s->jitter[metric];
+    if ( out->count == 0 )
+        return;
+
+    out->min = s->value[s->minq[metric][s->minq_head[metric] & s->mask] & s->mask][metric];
+
+    res[0] = &out->median;
+    res[1] = &out->p90;
+    res[2] = &out->p99;
+    for ( i = 0; i < STATS_BUCKETS && k < 3; i++ ) {
+        seen += s->hist[metric][i];
+        while ( k < 3 && seen >= ( rank = (uint32_t) ceil(q[k] * out->count) ) && rank > 0 ) {
+            *res[k] = bucket_value(i) < out->min ? out->min : bucket_value(i);
+            k++;
+        }
+    }
+}
+
+/* The samples in the window as of the last expiry, oldest first, if there are at most max of them; else 0. */
+uint32_t stats_values(const peer_stats *s, int metric, float *out, uint32_t max)
+{
+    uint32_t seq, n = s->tail - s->head;
+
+    if ( n > max )
+        return 0;
+    for ( seq = s->head; seq != s->tail; seq++ )
+        *out++ = s->value[seq & s->mask][metric];
+    return n;
+}
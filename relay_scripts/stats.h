@@ -0,0 +1,63 @@
+/**
+ * [Title]: stats.h -- streaming per-peer latency statistics
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * Keeps the forward, reverse and RTT samples of one peer over a sliding time window. Memory is fixed: a ring
+ * sized at stats_create for the samples the window should hold, from STATS_MIN_SAMPLES to STATS_MAX_SAMPLES
+ * (older ones leave the window early if the ring fills up), a log-linear
+ * histogram per metric for the quantiles (8 buckets per power of two, about 6% error) and a monotonic queue per
+ * metric for the exact window minimum. Adding a sample and expiring one are O(1); a summary walks the
+ * STATS_BUCKETS buckets once. EWMA (1/8) and jitter (RFC 3550, 1/16) are updated with every sample.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_STATS_H
+#define CXP_STATS_H
+
+#include <stdint.h>
+
+#define STATS_MIN_SAMPLES       256             /* ring sizes, powers of two */
+#define STATS_MAX_SAMPLES       32768           /* the histogram counts are 16 bit */
+#define STATS_SUB_BUCKETS       8
+#define STATS_MIN_SHIFT         6               /* values under 64 ns share bucket 0 */
+#define STATS_MAX_SHIFT         35              /* values over ~34 s share the last bucket */
+#define STATS_BUCKETS           (1 + (STATS_MAX_SHIFT - STATS_MIN_SHIFT) * STATS_SUB_BUCKETS)
+
+/* the turnaround is the time a probe spent in the reflector, from its RX timestamp to its reply */
+enum { STATS_FORWARD, STATS_REVERSE, STATS_RTT, STATS_TURNAROUND, STATS_METRICS };
+
+typedef struct stats_summary {
+    uint32_t count;
+    double min, median, p90, p99, ewma, jitter;     /* ms */
+} stats_summary;
+
+typedef struct peer_stats {
+    uint32_t window;                                /* ms */
+    uint32_t mask;                                  /* ring size - 1 */
+    uint32_t head, tail;                            /* sample sequence numbers, ring index = seq & mask */
+    uint32_t *time;                                 /* ms, wraps */
+    float (*value)[STATS_METRICS];                  /* ms */
+    uint16_t hist[STATS_METRICS][STATS_BUCKETS];
+    uint32_t *minq[STATS_METRICS];
+    uint32_t minq_head[STATS_METRICS], minq_tail[STATS_METRICS];
+    double ewma[STATS_METRICS];
+    double jitter[STATS_METRICS];
+    double last[STATS_METRICS];
+} peer_stats;
+
+peer_stats *stats_create(uint32_t window_ms, uint32_t samples);
+void stats_init(peer_stats *s, uint32_t window_ms);
+void stats_add(peer_stats *s, uint64_t now_ms, const double value[STATS_METRICS]);
+void stats_expire(peer_stats *s, uint64_t now_ms);
+void stats_summarize(peer_stats *s, int metric, uint64_t now_ms, stats_summary *out);
+uint32_t stats_values(const peer_stats *s, int metric, float *out, uint32_t max);
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * [Title]: train.c -- capacity and available bandwidth of a path from the dispersion of packet trains
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * See train.h. The replies of a train are matched by its id only; a reply of an older train, or a second
+ * reply to the same packet, is dropped.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "train.h"
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* the value at fraction q of the n sorted values, which it sorts in place */
+static double quantile(double *v, int n, double q)
+{
+    qsort(v, n, sizeof(double), compare_double);
+    return v[(int) ( q * ( n - 1 ) )];
+}
+
+void train_init(peer_train *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+/* Reduce the train in flight to a result, if two of its packets came back, and forget it. */
+static void train_close(peer_train *t, uint64_t now)
+{
+    double gaps[TRAIN_MAX_PACKETS], bits = ( t->size + TRAIN_OVERHEAD ) * 8.0, in, cross;
+    train_result r;
+    int i, first = -1, last = -1, n = 0;
+
+    for ( i = 0; i < t->packets; i++ ) {
+        if ( !t->t2[i] )
+            continue;
+        if ( first < 0 )
+            first = i;
+        last = i;
+        if ( i > 0 && t->t2[i - 1] && t->t2[i] > t->t2[i - 1] )
+            gaps[n++] = ( t->t2[i] - t->t2[i - 1] ) / 1e9;
+    }
+    t->id = 0;
+    if ( first < 0 || last == first || t->t2[last] <= t->t2[first] )
+        return;
+
+    memset(&r, 0, sizeof(r));
+    r.time = now;
+    r.paced = t->pace > 0;
+    r.rate = bits * ( last - first ) / ( ( t->t2[last] - t->t2[first] ) / 1e9 );
+    if ( !r.paced ) {
+        r.capacity = n ? bits / quantile(gaps, n, 0.25) : 0;
+    } else {
+        if ( t->t1[last] <= t->t1[first] )
+            return;
+        in = bits * ( last - first ) / ( ( t->t1[last] - t->t1[first] ) / 1e9 );
+        cross = in * ( t->pace / r.rate - 1 );
+        r.available = cross < 0 ? t->pace : cross > t->pace ? 0 : t->pace - cross;
+    }
+    t->results[t->next] = r;
+    t->next = ( t->next + 1 ) % TRAIN_HISTORY;
+    if ( t->nresults < TRAIN_HISTORY )
+        t->nresults++;
+}
+
+/*
+ * A new train of packets datagrams of size bytes (UDP payload), paced at pace bit/s or back to back for 0; the
+ * one still in flight ends. Returns its id.
+ */
+uint32_t train_start(peer_train *t, int packets, int size, double pace, uint64_t now)
+{
+    if ( t->id )
+        train_close(t, now);
+    if ( ( t->last_id = ( t->last_id + 1 ) & 0xffffff ) == 0 )
+        t->last_id = 1;
+    t->id = t->last_id;
+    t->packets = packets > TRAIN_MAX_PACKETS ? TRAIN_MAX_PACKETS : packets;
+    t->size = size;
+    t->pace = pace;
+    t->got = 0;
+    t->deadline = now + TRAIN_TIMEOUT_MS;
+    memset(t->t1, 0, sizeof(t->t1));
+    memset(t->t2, 0, sizeof(t->t2));
+    return t->id;
+}
+
+void train_reply(peer_train *t, uint32_t seq, uint64_t t2, uint64_t now)
+{
+    uint32_t i = seq & 0xff;
+
+    if ( !t->id || seq >> 8 != t->id || i >= (uint32_t) t->packets || t->t2[i] || !t2 )
+        return;
+    t->t2[i] = t2;
+    if ( ++t->got == t->packets )
+        train_close(t, now);
+}
+
+void train_expire(peer_train *t, uint64_t now)
+{
+    if ( t->id && t->deadline <= now )
+        train_close(t, now);
+}
+
+/* End the train in flight now, with the replies it has. */
+void train_end(peer_train *t, uint64_t now)
+{
+    if ( t->id )
+        train_close(t, now);
+}
+
+/* The medians of the trains that ended in the last window_ms; trains is 0 if there are none. */
+void train_estimate_at(const peer_train *t, uint64_t now, uint32_t window_ms, train_estimate *out)
+{
+    double capacity[TRAIN_HISTORY], available[TRAIN_HISTORY], rate[TRAIN_HISTORY];
+    const train_result *r;
+    int i, nc = 0, na = 0, nr = 0;
+
+    memset(out, 0, sizeof(*out));
+    for ( i = 0; i < t->nresults; i++ ) {
+        r = &t->results[i];
+        if ( now - r->time > window_ms )
+            continue;
+        out->trains++;
+        if ( r->paced ) {
+            available[na++] = r->available;
+            continue;
+        }
+        rate[nr++] = r->rate;
+        if ( r->capacity > 0 )
+            capacity[nc++] = r->capacity;
+    }
+
+    out->paced = na;
+    if ( nr )
+        out->rate = quantile(rate, nr, 0.5) / 1e6;
+    if ( nc )
+        out->capacity = quantile(capacity, nc, 0.5) / 1e6;
+    if ( out->capacity < out->rate )
+        out->capacity = out->rate;
+    if ( na )
+        out->available = quantile(available, na, 0.5) / 1e6;
+    if ( out->available > out->capacity && out->capacity > 0 )
+        out->available = out->capacity;
+}
@@ -0,0 +1,78 @@
+/**
+ * [Title]: train.h -- capacity and available bandwidth of a path from the dispersion of packet trains
+ * [Author]: Dimitris Mavrommatis (mavromat@ics.forth.gr) -- @inspire_forth
+ * -----------------------------------------------------------------------------------------------------------
+ * [Details]:
+ * A train is a burst of probes of the same size (PROBE_F_TRAIN, sequence number id << 8 | index) and the
+ * reflector stamps the arrival t2 of every one of them. A train sent back to back measures the capacity: the
+ * narrowest link of the path spreads the packets to its own rate, so the gap between two consecutive arrivals
+ * is one packet's bits at the bottleneck capacity C, unless cross traffic got in between, which only widens it;
+ * the capacity of a train is taken from the lower quartile of its gaps.
+ *
+ * Cross traffic that arrives after a back to back train only queues behind it, so the available bandwidth
+ * takes a train paced at C. It enters the bottleneck at R_in (from the send times t1) and leaves it at
+ * R_out = R_in * C / (R_in + X) for cross traffic X (the fluid model of a FIFO hop), hence the available
+ * bandwidth C - X = C - R_in * (C / R_out - 1), clamped to [0, C].
+ *
+ * A train ends with its last reply or TRAIN_TIMEOUT_MS after it left; it counts if two of its packets came
+ * back. The estimates are the medians over the last TRAIN_HISTORY trains within the window. The sizes are the
+ * IP datagrams', TRAIN_OVERHEAD bytes more than the UDP payloads.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Warning]:
+ * This script comes as-is with no promise of functionality or accuracy. I did not write it to be efficient nor
+ * secured. Feel free to change or improve it any way you see fit.
+ * -----------------------------------------------------------------------------------------------------------
+ * [Modification, Distribution, and Attribution]:
+ * You are free to modify and/or distribute this script as you wish. I only ask that you maintain original
+ * author attribution.
+**/
+
+#ifndef CXP_TRAIN_H
+#define CXP_TRAIN_H
+
+#include <stdint.h>
+
+#define TRAIN_MAX_PACKETS       64
+#define TRAIN_MAX_SIZE          1472            /* UDP payload in a 1500 byte MTU */
+#define TRAIN_OVERHEAD          28              /* IP and UDP headers */
+#define TRAIN_HISTORY           8
+#define TRAIN_TIMEOUT_MS        1000
+#define TRAIN_SEQ(id, i)        ( (uint32_t) (id) << 8 | (uint32_t) (i) )
+
+typedef struct train_result {
+    uint64_t time;              /* monotonic ms the train ended */
+    int paced;
+    double capacity;            /* bit/s, back to back trains with two consecutive replies, else 0 */
+    double available;           /* bit/s, paced trains, else 0 */
+    double rate;                /* bit/s, R_out */
+} train_result;
+
+typedef struct peer_train {
+    uint32_t id;                /* of the train in flight, 0 for none */
+    uint32_t last_id;
+    int packets, size;
+    int got;
+    double pace;                /* bit/s the train was paced at, 0 for back to back */
+    uint64_t deadline;          /* monotonic ms */
+    uint64_t t1[TRAIN_MAX_PACKETS];     /* send ns, filled in by the sender */
+    uint64_t t2[TRAIN_MAX_PACKETS];     /* reflector receive ns, 0 until the reply */
+    train_result results[TRAIN_HISTORY];
+    int nresults, next;
+} peer_train;
+
+typedef struct train_estimate {
+    int trains;
+    int paced;                  /* of them; available is 0 without one */
+    double capacity;            /* Mbit/s */
+    double available;           /* Mbit/s */
+    double rate;                /* Mbit/s, median R_out of the back to back trains */
+} train_estimate;
+
+void train_init(peer_train *t);
+uint32_t train_start(peer_train *t, int packets, int size, double pace, uint64_t now);
+void train_reply(peer_train *t, uint32_t seq, uint64_t t2, uint64_t now);
+void train_expire(peer_train *t, uint64_t now);
+void train_end(peer_train *t, uint64_t now);
+void train_estimate_at(const peer_train *t, uint64_t now, uint32_t window_ms, train_estimate *out);
+
+#endif